@@ -0,0 +1,570 @@
+#include "tensor_protocol.h"
+#include "fp16.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <httplib.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+enum class LoadMode {
+    CLOSED,  // each connection sends its next request when the last one returns
+    OPEN     // requests start on a fixed schedule, whether or not earlier ones returned
+};
+
+struct LoadConfig {
+    std::string host = "localhost";
+    int port = 8000;
+    std::string path = "/infer";
+    LoadMode mode = LoadMode::CLOSED;
+    size_t connections = 16;
+    double rate = 0;              // open loop: requests per second
+    size_t total_requests = 1000;
+    double duration_s = 0;        // > 0: run this long instead of total_requests
+    bool binary = false;
+    TensorDType input_dtype = TensorDType::FLOAT32;  // binary only; JSON is always float32
+    std::vector<int64_t> shape{1, 3, 224, 224};  // ResNet-50 input
+    double duplicate_ratio = 0;   // share of requests repeating an earlier input
+    // closed loop: the intended time between a connection's requests, used to
+    // back-fill the samples a stall hides; 0 = no correction
+    std::chrono::microseconds expected_interval{0};
+    std::string output = "benchmark_results.json";
+    bool server_stats = true;
+    uint64_t seed = 42;
+    bool batch_priority = false;  // requests ask for the workers' batch lane
+    std::string model;            // model requests name, empty = the default
+};
+
+// Every input is one fixed random tensor with its input number written into
+// the first two elements, so each number is a distinct cache key and a
+// duplicate repeats an earlier input exactly. The JSON text of the fixed part
+// is rendered once; only the request id and the first two values change.
+// Binary uint8 and float16 inputs carry the number in the first five bytes
+// or the mantissas of the first four values instead.
+class PayloadFactory {
+public:
+    PayloadFactory(const LoadConfig& config)
+        : shape_(config.shape), binary_(config.binary),
+          dtype_(config.binary ? config.input_dtype : TensorDType::FLOAT32),
+          batch_priority_(config.batch_priority), model_(config.model) {
+        if (!model_.empty()) {
+            model_field_ = "\"model\":" + json(model_).dump() + ",";
+        }
+        size_t elements = 1;
+        for (int64_t dim : shape_) {
+            elements *= static_cast<size_t>(dim);
+        }
+        if (elements < (dtype_ == TensorDType::FLOAT32 ? 2 : 5)) {
+            throw std::runtime_error("Input shape too small to number the inputs");
+        }
+        std::mt19937_64 rng(config.seed);
+        std::uniform_real_distribution<float> value(0.0f, 1.0f);
+        base_.resize(elements);
+        for (float& v : base_) {
+            v = value(rng);
+        }
+        if (dtype_ == TensorDType::UINT8) {
+            for (float v : base_) {
+                base_raw_.push_back(static_cast<char>(static_cast<uint8_t>(v * 255.0f)));
+            }
+        } else if (dtype_ == TensorDType::FLOAT16) {
+            base_raw_.resize(elements * sizeof(uint16_t));
+            floatsToHalves(base_.data(), reinterpret_cast<uint16_t*>(&base_raw_[0]), elements);
+        }
+        if (!binary_) {
+            char number[32];
+            for (size_t i = 2; i < elements; ++i) {
+                json_tail_ += ',';
+                json_tail_.append(number, std::snprintf(number, sizeof(number), "%.6g", base_[i]));
+            }
+            json_tail_ += "]}";
+        }
+    }
+
+    // scratch is the caller's buffer for the binary payload, reused per call
+    std::string body(const std::string& request_id, uint64_t input, std::vector<float>& scratch) const {
+        float low = static_cast<float>(input & 0xFFFFF);
+        float high = static_cast<float>(input >> 20);
+        if (binary_) {
+            TensorFrame frame;
+            frame.kind = FrameKind::REQUEST;
+            frame.dtype = dtype_;
+            frame.shape = shape_;
+            frame.request_id = request_id;
+            frame.model = model_;
+            frame.flags = batch_priority_ ? kFrameFlagBatchPriority : 0;
+            if (dtype_ == TensorDType::FLOAT32) {
+                scratch = base_;
+                scratch[0] = low;
+                scratch[1] = high;
+                return encodeTensorFrame(frame, scratch.data(), scratch.size());
+            }
+            std::string payload = base_raw_;
+            if (dtype_ == TensorDType::UINT8) {
+                for (size_t i = 0; i < 5; ++i) {
+                    payload[i] = static_cast<char>((input >> (8 * i)) & 0xFF);
+                }
+            } else {
+                // in [1, 2): exponent fixed, 10 bits of the number per value
+                uint16_t* halves = reinterpret_cast<uint16_t*>(&payload[0]);
+                for (size_t i = 0; i < 4; ++i) {
+                    halves[i] = static_cast<uint16_t>(0x3C00 | ((input >> (10 * i)) & 0x3FF));
+                }
+            }
+            std::string out;
+            appendTensorFrameRaw(out, frame, payload.data(), base_.size());
+            return out;
+        }
+        std::string out;
+        out.reserve(json_tail_.size() + model_field_.size() + request_id.size() + 96);
+        out += batch_priority_ ? "{\"priority\":\"batch\"," : "{";
+        out += model_field_;
+        out += "\"request_id\":\"";
+        out += request_id;
+        out += "\",\"input_data\":[";
+        out += std::to_string(static_cast<int64_t>(low));
+        out += ',';
+        out += std::to_string(static_cast<int64_t>(high));
+        out += json_tail_;
+        return out;
+    }
+
+    size_t payloadBytes() const {
+        return binary_ ? base_.size() * dtypeSize(dtype_) : json_tail_.size();
+    }
+
+private:
+    std::vector<int64_t> shape_;
+    bool binary_;
+    TensorDType dtype_;
+    bool batch_priority_;
+    std::string model_;
+    std::string model_field_;  // "model":"...", before the request_id
+    std::vector<float> base_;
+    std::string base_raw_;  // base_ as uint8 or float16
+    std::string json_tail_;
+};
+
+// what one connection saw; merged once the run is over
+struct ConnectionStats {
+    std::vector<int64_t> latency_us;      // coordinated-omission corrected
+    std::vector<int64_t> raw_latency_us;  // send to response only
+    int64_t successful = 0;
+    int64_t failed = 0;
+    int64_t cache_hits = 0;
+    std::map<std::string, int64_t> nodes;
+    std::map<std::string, int64_t> errors;
+};
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const LoadConfig& config) : config_(config), payloads_(config) {}
+
+    json run() {
+        std::vector<ConnectionStats> stats(config_.connections);
+        std::vector<std::thread> connections;
+        start_ = Clock::now();
+        if (config_.duration_s > 0) {
+            end_ = start_ + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(config_.duration_s));
+        }
+        for (size_t c = 0; c < config_.connections; ++c) {
+            connections.emplace_back([this, c, &stats] { connectionLoop(c, stats[c]); });
+        }
+        for (auto& connection : connections) {
+            connection.join();
+        }
+        double total_time = std::chrono::duration<double>(Clock::now() - start_).count();
+        return report(stats, total_time);
+    }
+
+private:
+    void connectionLoop(size_t connection, ConnectionStats& stats) {
+        httplib::Client client(config_.host, config_.port);
+        client.set_keep_alive(true);
+        client.set_connection_timeout(5, 0);
+        client.set_read_timeout(60, 0);
+        std::mt19937_64 rng(config_.seed + 1 + connection);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        std::vector<float> scratch;
+        const char* content_type = config_.binary ? kTensorContentType : kJsonContentType;
+        auto period = config_.mode == LoadMode::OPEN
+            ? std::chrono::duration<double, std::micro>(1e6 / config_.rate)
+            : std::chrono::duration<double, std::micro>(0);
+
+        while (true) {
+            uint64_t index = next_request_.fetch_add(1);
+            if (config_.duration_s <= 0 && index >= config_.total_requests) break;
+            Clock::time_point intended = Clock::now();
+            if (config_.mode == LoadMode::OPEN) {
+                intended = start_ + std::chrono::duration_cast<Clock::duration>(period * index);
+            }
+            if (config_.duration_s > 0 && intended >= end_) break;
+
+            // a duplicate repeats an input that has already been handed out
+            uint64_t sent = next_input_.load();
+            uint64_t input = sent > 0 && coin(rng) < config_.duplicate_ratio
+                ? rng() % sent
+                : next_input_.fetch_add(1);
+            std::string body = payloads_.body("req_" + std::to_string(index), input, scratch);
+
+            if (config_.mode == LoadMode::OPEN) {
+                std::this_thread::sleep_until(intended);
+            }
+            auto sent_at = Clock::now();
+            if (config_.mode == LoadMode::CLOSED) {
+                intended = sent_at;
+            }
+            auto result = client.Post(config_.path, body, content_type);
+            auto done = Clock::now();
+            // open loop: from the scheduled start, so time spent behind
+            // schedule counts against the server, not just time on the wire
+            int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                done - intended).count();
+            int64_t raw = std::chrono::duration_cast<std::chrono::microseconds>(
+                done - sent_at).count();
+
+            if (!result) {
+                stats.failed++;
+                stats.errors[httplib::to_string(result.error())]++;
+                continue;
+            }
+            if (result->status != 200) {
+                stats.failed++;
+                stats.errors["HTTP " + std::to_string(result->status)]++;
+                continue;
+            }
+            stats.successful++;
+            recordLatency(stats, latency, raw);
+            recordResponse(stats, result->body);
+        }
+    }
+
+    void recordLatency(ConnectionStats& stats, int64_t latency, int64_t raw) {
+        stats.raw_latency_us.push_back(raw);
+        stats.latency_us.push_back(latency);
+        // closed loop: a response slower than the intended interval hid the
+        // requests that would have been sent meanwhile; add them as they
+        // would have been measured
+        int64_t interval = config_.expected_interval.count();
+        if (config_.mode == LoadMode::CLOSED && interval > 0) {
+            for (int64_t missed = latency - interval; missed >= interval; missed -= interval) {
+                stats.latency_us.push_back(missed);
+            }
+        }
+    }
+
+    void recordResponse(ConnectionStats& stats, const std::string& body) {
+        try {
+            if (config_.binary) {
+                TensorFrame frame;
+                decodeTensorFrame(body.data(), body.size(), frame);
+                stats.cache_hits += (frame.flags & kFrameFlagCached) ? 1 : 0;
+                stats.nodes[frame.node_id]++;
+            } else {
+                auto response = json::parse(body);
+                stats.cache_hits += response.value("cached", false) ? 1 : 0;
+                stats.nodes[response.value("node_id", "")]++;
+            }
+        } catch (const std::exception& e) {
+            stats.errors[std::string("bad response: ") + e.what()]++;
+        }
+    }
+
+    static json summarize(std::vector<int64_t>& latency_us) {
+        json latency;
+        if (latency_us.empty()) {
+            for (const char* key : {"mean", "p50", "p90", "p95", "p99", "p999", "max"}) {
+                latency[key] = 0;
+            }
+            return latency;
+        }
+        std::sort(latency_us.begin(), latency_us.end());
+        auto percentile = [&](double q) {
+            size_t rank = static_cast<size_t>(std::ceil(q * latency_us.size()));
+            return latency_us[std::min(latency_us.size() - 1, rank > 0 ? rank - 1 : 0)] / 1000.0;
+        };
+        double sum = std::accumulate(latency_us.begin(), latency_us.end(), 0.0);
+        latency["mean"] = sum / latency_us.size() / 1000.0;
+        latency["p50"] = percentile(0.50);
+        latency["p90"] = percentile(0.90);
+        latency["p95"] = percentile(0.95);
+        latency["p99"] = percentile(0.99);
+        latency["p999"] = percentile(0.999);
+        latency["max"] = latency_us.back() / 1000.0;
+        return latency;
+    }
+
+    json report(std::vector<ConnectionStats>& stats, double total_time) {
+        ConnectionStats total;
+        for (auto& connection : stats) {
+            total.latency_us.insert(total.latency_us.end(),
+                                    connection.latency_us.begin(), connection.latency_us.end());
+            total.raw_latency_us.insert(total.raw_latency_us.end(),
+                                        connection.raw_latency_us.begin(), connection.raw_latency_us.end());
+            total.successful += connection.successful;
+            total.failed += connection.failed;
+            total.cache_hits += connection.cache_hits;
+            for (const auto& [node, count] : connection.nodes) total.nodes[node] += count;
+            for (const auto& [error, count] : connection.errors) total.errors[error] += count;
+        }
+
+        json config;
+        config["target"] = config_.host + ":" + std::to_string(config_.port) + config_.path;
+        config["mode"] = config_.mode == LoadMode::OPEN ? "open" : "closed";
+        config["connections"] = config_.connections;
+        config["rate"] = config_.rate;
+        config["format"] = config_.binary ? "binary" : "json";
+        config["input_dtype"] = !config_.binary || config_.input_dtype == TensorDType::FLOAT32 ? "f32"
+                                : config_.input_dtype == TensorDType::FLOAT16 ? "f16" : "u8";
+        config["shape"] = config_.shape;
+        config["payload_bytes"] = payloads_.payloadBytes();
+        config["duplicate_ratio"] = config_.duplicate_ratio;
+        config["priority"] = config_.batch_priority ? "batch" : "interactive";
+        config["model"] = config_.model;
+        config["expected_interval_us"] = config_.expected_interval.count();
+
+        json results;
+        results["schema_version"] = 1;
+        results["config"] = config;
+        results["total_requests"] = total.successful + total.failed;
+        results["successful"] = total.successful;
+        results["failed"] = total.failed;
+        results["total_time"] = total_time;
+        results["throughput"] = total_time > 0 ? total.successful / total_time : 0.0;
+        // milliseconds; latency is corrected for coordinated omission
+        results["latency"] = summarize(total.latency_us);
+        results["latency_uncorrected"] = summarize(total.raw_latency_us);
+        json cache;
+        cache["hits"] = total.cache_hits;
+        cache["misses"] = total.successful - total.cache_hits;
+        cache["hit_rate"] = total.successful > 0 ? (double)total.cache_hits / total.successful : 0.0;
+        results["cache"] = cache;
+        results["node_distribution"] = total.nodes;
+        results["errors"] = total.errors;
+        return results;
+    }
+
+    LoadConfig config_;
+    PayloadFactory payloads_;
+    Clock::time_point start_;
+    Clock::time_point end_;
+    std::atomic<uint64_t> next_request_{0};
+    std::atomic<uint64_t> next_input_{0};
+};
+
+// gateway /stats or worker /health, whichever the target serves
+static json fetchServerStats(const LoadConfig& config) {
+    httplib::Client client(config.host, config.port);
+    client.set_connection_timeout(5, 0);
+    client.set_read_timeout(5, 0);
+    for (const char* path : {"/stats", "/health"}) {
+        auto result = client.Get(path);
+        if (result && result->status == 200) {
+            try {
+                return json::parse(result->body);
+            } catch (const std::exception&) {
+                // not JSON; try the next one
+            }
+        }
+    }
+    return nullptr;
+}
+
+static void printResults(const json& results) {
+    auto line = [](const char* label, const json& latency) {
+        std::printf("  %-12s mean %8.2f  p50 %8.2f  p90 %8.2f  p99 %8.2f  p999 %8.2f  max %8.2f\n",
+                    label,
+                    latency["mean"].get<double>(), latency["p50"].get<double>(),
+                    latency["p90"].get<double>(), latency["p99"].get<double>(),
+                    latency["p999"].get<double>(), latency["max"].get<double>());
+    };
+    std::cout << "======================================================================" << std::endl;
+    std::cout << "BENCHMARK RESULTS (" << results["config"]["mode"].get<std::string>() << " loop, "
+              << results["config"]["format"].get<std::string>() << ")" << std::endl;
+    std::cout << "======================================================================" << std::endl;
+    std::printf("  Requests:    %lld ok, %lld failed in %.2fs\n",
+                static_cast<long long>(results["successful"].get<int64_t>()),
+                static_cast<long long>(results["failed"].get<int64_t>()),
+                results["total_time"].get<double>());
+    std::printf("  Throughput:  %.1f requests/s\n", results["throughput"].get<double>());
+    std::printf("  Cache hits:  %.1f%%\n", results["cache"]["hit_rate"].get<double>() * 100);
+    std::cout << "Latency (ms):" << std::endl;
+    line("corrected", results["latency"]);
+    line("uncorrected", results["latency_uncorrected"]);
+    if (!results["errors"].empty()) {
+        std::cout << "Errors:" << std::endl;
+        for (auto it = results["errors"].begin(); it != results["errors"].end(); ++it) {
+            std::cout << "  " << it.key() << ": " << it.value() << std::endl;
+        }
+    }
+    std::cout << "======================================================================" << std::endl;
+}
+
+static bool parseTarget(const std::string& target, LoadConfig& config) {
+    std::string rest = target;
+    size_t proto = rest.find("://");
+    if (proto != std::string::npos) {
+        rest = rest.substr(proto + 3);
+    }
+    size_t slash = rest.find('/');
+    if (slash != std::string::npos) {
+        rest = rest.substr(0, slash);
+    }
+    size_t colon = rest.find_last_of(':');
+    if (colon == std::string::npos) {
+        config.host = rest;
+        return !rest.empty();
+    }
+    config.host = rest.substr(0, colon);
+    try {
+        config.port = std::stoi(rest.substr(colon + 1));
+    } catch (...) {
+        return false;
+    }
+    return !config.host.empty();
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --target URL         gateway or worker (default: http://localhost:8000)" << std::endl;
+    std::cerr << "  --path P             endpoint (default: /infer)" << std::endl;
+    std::cerr << "  --mode closed|open   closed: connections wait for responses; open: fixed rate (default: closed)" << std::endl;
+    std::cerr << "  --connections N      concurrent connections (default: 16)" << std::endl;
+    std::cerr << "  --rate R             open loop: requests per second" << std::endl;
+    std::cerr << "  --requests N         total requests (default: 1000)" << std::endl;
+    std::cerr << "  --duration-s S       run for S seconds instead of --requests" << std::endl;
+    std::cerr << "  --format json|binary request body format (default: json)" << std::endl;
+    std::cerr << "  --input-dtype f32|f16|u8  binary input element type; u8 sends uint8 images (default: f32)" << std::endl;
+    std::cerr << "  --shape 1,3,224,224  input tensor shape (default: ResNet-50 input)" << std::endl;
+    std::cerr << "  --duplicate-ratio X  share of requests repeating an earlier input (default: 0)" << std::endl;
+    std::cerr << "  --expected-interval-ms N  closed loop: correct for coordinated omission (default: off)" << std::endl;
+    std::cerr << "  --output FILE        results file (default: benchmark_results.json)" << std::endl;
+    std::cerr << "  --server-stats 0|1   embed the target's /stats or /health (default: 1)" << std::endl;
+    std::cerr << "  --seed N             input and duplicate choice seed (default: 42)" << std::endl;
+    std::cerr << "  --priority interactive|batch  worker queue lane requested (default: interactive)" << std::endl;
+    std::cerr << "  --model NAME         model the requests name (default: the worker's default)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    LoadConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: missing value for " << flag << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--target") {
+            if (!parseTarget(value, config)) {
+                std::cerr << "Error: bad target " << value << std::endl;
+                return 1;
+            }
+        } else if (flag == "--path") {
+            config.path = value;
+        } else if (flag == "--mode") {
+            if (value != "closed" && value != "open") {
+                std::cerr << "Error: unknown mode " << value << std::endl;
+                return 1;
+            }
+            config.mode = value == "open" ? LoadMode::OPEN : LoadMode::CLOSED;
+        } else if (flag == "--connections") {
+            config.connections = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--rate") {
+            config.rate = std::stod(value);
+        } else if (flag == "--requests") {
+            config.total_requests = std::stoul(value);
+        } else if (flag == "--duration-s") {
+            config.duration_s = std::stod(value);
+        } else if (flag == "--format") {
+            if (value != "json" && value != "binary") {
+                std::cerr << "Error: unknown format " << value << std::endl;
+                return 1;
+            }
+            config.binary = value == "binary";
+        } else if (flag == "--input-dtype") {
+            if (value == "f32") {
+                config.input_dtype = TensorDType::FLOAT32;
+            } else if (value == "f16") {
+                config.input_dtype = TensorDType::FLOAT16;
+            } else if (value == "u8") {
+                config.input_dtype = TensorDType::UINT8;
+            } else {
+                std::cerr << "Error: unknown input dtype " << value << std::endl;
+                return 1;
+            }
+        } else if (flag == "--shape") {
+            config.shape.clear();
+            std::stringstream dims(value);
+            std::string dim;
+            while (std::getline(dims, dim, ',')) {
+                config.shape.push_back(std::stoll(dim));
+            }
+        } else if (flag == "--duplicate-ratio") {
+            config.duplicate_ratio = std::stod(value);
+        } else if (flag == "--expected-interval-ms") {
+            config.expected_interval = std::chrono::milliseconds(std::stol(value));
+        } else if (flag == "--output") {
+            config.output = value;
+        } else if (flag == "--server-stats") {
+            config.server_stats = value == "1" || value == "true";
+        } else if (flag == "--model") {
+            config.model = value;
+        } else if (flag == "--priority") {
+            if (value != "interactive" && value != "batch") {
+                std::cerr << "Error: unknown priority " << value << std::endl;
+                return 1;
+            }
+            config.batch_priority = value == "batch";
+        } else if (flag == "--seed") {
+            config.seed = std::stoull(value);
+        } else {
+            std::cerr << "Error: unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+    if (config.mode == LoadMode::OPEN && config.rate <= 0) {
+        std::cerr << "Error: --mode open needs --rate" << std::endl;
+        return 1;
+    }
+
+    json results;
+    try {
+        LoadGenerator generator(config);
+        std::cout << "Sending to " << config.host << ":" << config.port << config.path << " over "
+                  << config.connections << " connections" << std::endl;
+        results = generator.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (config.server_stats) {
+        results["server_stats"] = fetchServerStats(config);
+    }
+    printResults(results);
+
+    std::ofstream out(config.output);
+    out << results.dump(2) << std::endl;
+    if (!out) {
+        std::cerr << "Error: could not write " << config.output << std::endl;
+        return 1;
+    }
+    std::cout << "Results written to " << config.output << std::endl;
+    return 0;
+}
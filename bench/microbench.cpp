@@ -0,0 +1,364 @@
+#include "batch_processor.h"
+#include "batch_packing.h"
+#include "consistent_hash.h"
+#include "lru_cache.h"
+#include "sharded_cache.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <random>
+#include <functional>
+#include <cstdio>
+#include <nlohmann/json.hpp>
+
+// Component benchmarks for the hot paths, no cluster or model needed. Each
+// case runs until --min-time-ms has passed and reports operations per
+// second; multi-threaded cases count the operations of all threads.
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct BenchResult {
+    std::string name;
+    double ops_per_sec;
+    double ns_per_op;
+    double bytes_per_sec;  // 0 when the case does not move data
+};
+
+class Suite {
+public:
+    Suite(std::string filter, std::chrono::milliseconds min_time)
+        : filter_(std::move(filter)), min_time_(min_time) {}
+
+    bool enabled(const std::string& name) const {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+
+    // run(ops) performs ops operations; it is repeated with growing counts
+    // until one call takes at least min_time
+    void add(const std::string& name, const std::function<void(size_t ops)>& run,
+             size_t bytes_per_op = 0) {
+        if (!enabled(name)) return;
+        run(1);  // warm caches, threads and allocators
+        size_t ops = 16;
+        while (true) {
+            auto start = Clock::now();
+            run(ops);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds * 1000 >= min_time_.count() || ops >= (size_t(1) << 32)) {
+                record(name, ops, seconds, bytes_per_op);
+                return;
+            }
+            // aim a bit past min_time so the next round is likely the last
+            double scale = seconds > 0 ? 1.4 * min_time_.count() / (seconds * 1000) : 100;
+            ops = static_cast<size_t>(ops * std::min(100.0, std::max(2.0, scale)));
+        }
+    }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+private:
+    void record(const std::string& name, size_t ops, double seconds, size_t bytes_per_op) {
+        BenchResult result{name, ops / seconds, seconds * 1e9 / ops,
+                           bytes_per_op > 0 ? bytes_per_op * ops / seconds : 0.0};
+        std::printf("%-52s %14.0f ops/s %12.1f ns/op", name.c_str(), result.ops_per_sec, result.ns_per_op);
+        if (result.bytes_per_sec > 0) {
+            std::printf(" %8.2f GB/s", result.bytes_per_sec / 1e9);
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+        results_.push_back(result);
+    }
+
+    std::string filter_;
+    std::chrono::milliseconds min_time_;
+    std::vector<BenchResult> results_;
+};
+
+// runs body(thread, ops_for_thread) on threads threads that start together
+void runThreads(size_t threads, size_t ops, const std::function<void(size_t, size_t)>& body) {
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        size_t share = ops / threads + (t < ops % threads ? 1 : 0);
+        workers.emplace_back([&, t, share] {
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            body(t, share);
+        });
+    }
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) worker.join();
+}
+
+// keeps a computed value alive so the loop producing it is not optimized out
+template<typename T>
+void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+std::vector<float> randomVector(size_t size, std::mt19937& rng) {
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::vector<float> out(size);
+    for (float& v : out) v = value(rng);
+    return out;
+}
+
+using IntProcessor = BatchProcessor<int, int>;
+
+std::unique_ptr<IntProcessor> makeProcessor(bool lock_free) {
+    auto processor = std::make_unique<IntProcessor>(
+        32, std::chrono::milliseconds(1),
+        [](const std::vector<int>& batch) { return batch; });
+    if (lock_free) {
+        processor->useLockFreeQueue(4096);
+    }
+    processor->start();
+    return processor;
+}
+
+// BatchProcessor: blocking process() and callback submit() against the
+// number of producer threads, for both queue backends
+void benchBatchProcessor(Suite& suite) {
+    for (bool lock_free : {false, true}) {
+        const char* backend = lock_free ? "lockfree" : "mutex";
+        for (size_t producers : {1, 2, 4, 8, 16}) {
+            std::string suffix = std::string(backend) + "/producers:" + std::to_string(producers);
+            if (suite.enabled("batch_processor/process/" + suffix)) {
+                auto processor = makeProcessor(lock_free);
+                suite.add("batch_processor/process/" + suffix, [&](size_t ops) {
+                    runThreads(producers, ops, [&](size_t, size_t share) {
+                        for (size_t i = 0; i < share; ++i) {
+                            processor->process(static_cast<int>(i));
+                        }
+                    });
+                });
+            }
+            if (suite.enabled("batch_processor/submit/" + suffix)) {
+                auto processor = makeProcessor(lock_free);
+                suite.add("batch_processor/submit/" + suffix, [&](size_t ops) {
+                    std::atomic<size_t> completed{0};
+                    runThreads(producers, ops, [&](size_t, size_t share) {
+                        for (size_t i = 0; i < share; ++i) {
+                            processor->submit(static_cast<int>(i), [&completed](int*, std::exception_ptr) {
+                                completed.fetch_add(1, std::memory_order_relaxed);
+                            });
+                        }
+                    });
+                    while (completed.load() < ops) std::this_thread::yield();
+                });
+            }
+        }
+    }
+}
+
+// LRUCache keyed by the input itself (as the worker used to be) and the
+// digest-keyed ShardedCache, with inputs the size of a classifier output and
+// of a ResNet-50 input; 512 distinct keys over 256 entries, so about half
+// the lookups miss and put
+void benchCaches(Suite& suite) {
+    constexpr size_t kKeys = 512;
+    constexpr size_t kCapacity = 256;
+    for (size_t key_floats : {size_t(1000), size_t(3 * 224 * 224)}) {
+        std::mt19937 rng(7);
+        std::vector<std::vector<float>> keys;
+        for (size_t i = 0; i < kKeys; ++i) keys.push_back(randomVector(key_floats, rng));
+        TensorView value = TensorView::fromVector(std::vector<float>(1000, 0.5f));
+
+        for (size_t threads : {1, 4, 8}) {
+            std::string suffix = "key_floats:" + std::to_string(key_floats) +
+                                 "/threads:" + std::to_string(threads);
+            if (suite.enabled("lru_cache/get_put/" + suffix)) {
+                LRUCache<std::vector<float>, TensorView, VectorHash> cache(kCapacity);
+                suite.add("lru_cache/get_put/" + suffix, [&](size_t ops) {
+                    runThreads(threads, ops, [&](size_t t, size_t share) {
+                        std::mt19937 pick(static_cast<unsigned>(t));
+                        for (size_t i = 0; i < share; ++i) {
+                            const auto& key = keys[pick() % kKeys];
+                            if (!cache.get(key)) cache.put(key, value);
+                        }
+                    });
+                }, key_floats * sizeof(float));
+            }
+            if (suite.enabled("sharded_cache/get_put/" + suffix)) {
+                ShardedCache<TensorView> cache(kCapacity, 16);
+                suite.add("sharded_cache/get_put/" + suffix, [&](size_t ops) {
+                    runThreads(threads, ops, [&](size_t t, size_t share) {
+                        std::mt19937 pick(static_cast<unsigned>(t));
+                        for (size_t i = 0; i < share; ++i) {
+                            const auto& key = keys[pick() % kKeys];
+                            ContentDigest digest = digestFloats(key.data(), key.size());
+                            if (!cache.get(digest)) cache.put(digest, value);
+                        }
+                    });
+                }, key_floats * sizeof(float));
+            }
+        }
+    }
+}
+
+// ConsistentHash lookups against ring size (150 virtual nodes per node)
+void benchConsistentHash(Suite& suite) {
+    constexpr size_t kKeys = 4096;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < kKeys; ++i) keys.push_back("req_" + std::to_string(i));
+
+    for (size_t nodes : {3, 16, 64, 256}) {
+        ConsistentHash ring;
+        for (size_t n = 0; n < nodes; ++n) ring.addNode("worker-" + std::to_string(n) + ":8001");
+        for (size_t threads : {1, 8}) {
+            std::string suffix = "nodes:" + std::to_string(nodes) + "/threads:" + std::to_string(threads);
+            suite.add("consistent_hash/get_node/" + suffix, [&](size_t ops) {
+                runThreads(threads, ops, [&](size_t t, size_t share) {
+                    size_t sink = 0;
+                    for (size_t i = 0; i < share; ++i) {
+                        sink += ring.getNode(keys[(i + t * 977) % kKeys]).size();
+                    }
+                    doNotOptimize(sink);
+                });
+            });
+        }
+        suite.add("consistent_hash/get_successors/nodes:" + std::to_string(nodes), [&](size_t ops) {
+            const std::string* order[ConsistentHash::kMaxSuccessors];
+            size_t sink = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                sink += ring.getSuccessors(keys[i % kKeys], order, 3);
+            }
+            doNotOptimize(sink);
+        });
+    }
+}
+
+// What InferenceEngine::packBatch and the output fan-out cost around a Run,
+// with a stub engine: the same bucket choice, row packing and slicing over
+// plain heap buffers instead of pooled (pinned) ones.
+struct StubEngine {
+    size_t input_sample_size;
+    size_t output_sample_size;
+    std::vector<size_t> buckets;
+    std::vector<float> input_buffer;
+    std::shared_ptr<std::vector<float>> output;
+
+    StubEngine(size_t input_size, size_t output_size, std::vector<size_t> bucket_sizes)
+        : input_sample_size(input_size), output_sample_size(output_size),
+          buckets(std::move(bucket_sizes)),
+          input_buffer(buckets.back() * input_size),
+          output(std::make_shared<std::vector<float>>(buckets.back() * output_size, 0.25f)) {}
+
+    size_t pack(const std::vector<InputSpan>& inputs, const ImageTransform& image = ImageTransform()) {
+        size_t rows = inputs.size();
+        int bucket = pickBucket(buckets, rows);
+        if (bucket >= 0) rows = buckets[bucket];
+        packRows(inputs, input_sample_size, rows, input_buffer.data(), image);
+        return rows;
+    }
+
+    std::vector<TensorView> unpack(size_t samples) {
+        return sliceRows(output, output->data(), samples, output_sample_size);
+    }
+};
+
+void benchPacking(Suite& suite) {
+    constexpr size_t kInput = 3 * 224 * 224;
+    constexpr size_t kOutput = 1000;
+    StubEngine engine(kInput, kOutput, {1, 2, 4, 8, 16, 32});
+    std::mt19937 rng(11);
+    std::vector<std::vector<float>> inputs;
+    for (size_t i = 0; i < 32; ++i) inputs.push_back(randomVector(kInput, rng));
+    // the same batches sent as uint8 HWC images, normalized while packed
+    std::vector<std::vector<uint8_t>> images;
+    std::uniform_int_distribution<int> pixel(0, 255);
+    for (size_t i = 0; i < 32; ++i) {
+        std::vector<uint8_t> image(kInput);
+        for (auto& value : image) value = static_cast<uint8_t>(pixel(rng));
+        images.push_back(std::move(image));
+    }
+    ImageTransform imagenet(3, true, {0.485f, 0.456f, 0.406f}, {0.229f, 0.224f, 0.225f});
+
+    for (size_t batch : {1, 7, 32}) {
+        std::vector<InputSpan> spans;
+        std::vector<InputSpan> image_spans;
+        for (size_t i = 0; i < batch; ++i) {
+            spans.push_back(InputSpan{inputs[i].data(), inputs[i].size()});
+            image_spans.push_back(InputSpan{images[i].data(), images[i].size(), InputEncoding::IMAGE_U8});
+        }
+        std::string suffix = "batch:" + std::to_string(batch);
+        // bytes written, padding rows included
+        size_t padded = engine.buckets[pickBucket(engine.buckets, batch)];
+        suite.add("pack/resnet50/" + suffix, [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) engine.pack(spans);
+        }, padded * kInput * sizeof(float));
+        suite.add("pack/resnet50_u8/" + suffix, [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) engine.pack(image_spans, imagenet);
+        }, padded * kInput * sizeof(float));
+        suite.add("unpack/resnet50/" + suffix, [&](size_t ops) {
+            size_t sink = 0;
+            for (size_t i = 0; i < ops; ++i) sink += engine.unpack(batch).size();
+            doNotOptimize(sink);
+        });
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string output;
+    std::chrono::milliseconds min_time{300};
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help") {
+            std::cerr << "Usage: " << argv[0] << " [options]" << std::endl;
+            std::cerr << "Options:" << std::endl;
+            std::cerr << "  --filter S        only cases whose name contains S" << std::endl;
+            std::cerr << "  --min-time-ms N   shortest timed run per case (default: 300)" << std::endl;
+            std::cerr << "  --output FILE     also write the results as JSON" << std::endl;
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: missing value for " << flag << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--filter") {
+            filter = value;
+        } else if (flag == "--min-time-ms") {
+            min_time = std::chrono::milliseconds(std::stol(value));
+        } else if (flag == "--output") {
+            output = value;
+        } else {
+            std::cerr << "Error: unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    Suite suite(filter, min_time);
+    benchBatchProcessor(suite);
+    benchCaches(suite);
+    benchConsistentHash(suite);
+    benchPacking(suite);
+
+    if (!output.empty()) {
+        json results = json::array();
+        for (const auto& result : suite.results()) {
+            json entry;
+            entry["name"] = result.name;
+            entry["ops_per_sec"] = result.ops_per_sec;
+            entry["ns_per_op"] = result.ns_per_op;
+            if (result.bytes_per_sec > 0) {
+                entry["bytes_per_sec"] = result.bytes_per_sec;
+            }
+            results.push_back(entry);
+        }
+        std::ofstream out(output);
+        out << results.dump(2) << std::endl;
+        if (!out) {
+            std::cerr << "Error: could not write " << output << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
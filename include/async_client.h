@@ -0,0 +1,84 @@
+#ifndef ASYNC_CLIENT_H
+#define ASYNC_CLIENT_H
+
+#include "event_loop.h"
+#include "http_text.h"
+#include <string>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <sys/socket.h>
+
+struct HttpResult {
+    bool ok = false;    // a whole response arrived, whatever its status
+    int status = 0;
+    std::string body;
+    std::string error;  // why not, when !ok
+};
+
+// Keep-alive HTTP/1.1 client for one host on one event loop. Up to
+// max_connections requests are in flight at once, one per connection;
+// the rest wait in FIFO order without holding a thread. A pooled
+// connection the server closed while idle is noticed on the loop and, if a
+// request raced it, that request is resent once on a fresh connection.
+// Responses must carry a Content-Length or end with the connection.
+class AsyncHttpClient {
+public:
+    using Clock = std::chrono::steady_clock;
+    // runs on the loop thread, never inside post()
+    using Callback = std::function<void(HttpResult& result)>;
+
+    AsyncHttpClient(EventLoop& loop, const std::string& host, int port, size_t max_connections);
+    // on the loop thread, or once it has stopped; pending callbacks are dropped
+    ~AsyncHttpClient();
+    AsyncHttpClient(const AsyncHttpClient&) = delete;
+    AsyncHttpClient& operator=(const AsyncHttpClient&) = delete;
+
+    // Any thread. A request not answered by deadline fails with "timeout"
+    // and its connection is closed. headers are sent as well as Host,
+    // Content-Type and Content-Length.
+    void post(const std::string& path, std::shared_ptr<const std::string> body,
+              const std::string& content_type, const HttpHeaders& headers,
+              Clock::time_point deadline, Callback done);
+    // the same for a GET, without a body
+    void get(const std::string& path, Clock::time_point deadline, Callback done);
+
+    EventLoop& loop() const { return loop_; }
+    size_t openConnections() const { return open_.load(std::memory_order_relaxed); }
+    size_t idleConnections() const { return idle_count_.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending;
+    struct Connection;
+
+    void start(std::shared_ptr<Pending> request);
+    void dispatchQueued();
+    void send(Connection* connection, std::shared_ptr<Pending> request);
+    void connect(std::shared_ptr<Pending> request);
+    void onEvents(Connection* connection, uint32_t events);
+    void onConnected(Connection* connection);
+    void readResponse(Connection* connection);
+    bool parseResponse(Connection* connection);
+    void writeRequest(Connection* connection);
+    // the connection broke; its request, if any, is retried or failed
+    void fail(Connection* connection, const std::string& error);
+    void finish(Connection* connection, HttpResult& result);
+    void complete(std::shared_ptr<Pending> request, HttpResult& result);
+    void closeConnection(Connection* connection);
+    bool resolve();
+
+    EventLoop& loop_;
+    std::string host_;
+    int port_;
+    size_t max_connections_;
+    std::string host_header_;
+    sockaddr_storage address_{};
+    socklen_t address_len_ = 0;
+    std::deque<std::shared_ptr<Pending>> queued_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+    std::atomic<size_t> open_{0};
+    std::atomic<size_t> idle_count_{0};
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef BATCH_PACKING_H
+#define BATCH_PACKING_H
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "tensor_view.h"
+#include "preprocess.h"
+#include "fp16.h"
+
+// The engine-independent halves of a batch Run: converting and flattening
+// the requests' inputs into one batch tensor, and fanning the batch output
+// back out.
+
+// how one request's input arrived; every encoding is packed as float32
+// rows, or as float16 rows for a model that takes float16
+enum class InputEncoding : uint8_t {
+    FLOAT32,
+    FLOAT16,   // IEEE binary16
+    IMAGE_U8,  // interleaved (HWC) pixels, converted by an ImageTransform
+};
+
+inline size_t encodingSize(InputEncoding encoding) {
+    switch (encoding) {
+        case InputEncoding::FLOAT32: return sizeof(float);
+        case InputEncoding::FLOAT16: return sizeof(uint16_t);
+        case InputEncoding::IMAGE_U8: return sizeof(uint8_t);
+    }
+    return 0;
+}
+
+// non-owning view of one request's input
+struct InputSpan {
+    const void* data;
+    size_t size;  // elements
+    InputEncoding encoding = InputEncoding::FLOAT32;
+};
+
+// index of the smallest bucket that holds rows, -1 if none does (the
+// batch then runs at its own size); buckets are sorted ascending
+inline int pickBucket(const std::vector<size_t>& buckets, size_t rows) {
+    auto bucket = std::lower_bound(buckets.begin(), buckets.end(), rows);
+    return bucket != buckets.end() ? static_cast<int>(bucket - buckets.begin()) : -1;
+}
+
+// Converts one input into its row of sample_size floats: long inputs are
+// cut and short ones zero padded. An image only ever contributes whole
+// pixels, and planar output pads each channel's plane on its own.
+inline void packRow(const InputSpan& input, size_t sample_size, const ImageTransform& image, float* row) {
+    size_t count = std::min(input.size, sample_size);
+    switch (input.encoding) {
+    case InputEncoding::FLOAT32:
+        std::copy_n(static_cast<const float*>(input.data), count, row);
+        break;
+    case InputEncoding::FLOAT16:
+        halvesToFloats(static_cast<const uint16_t*>(input.data), row, count);
+        break;
+    case InputEncoding::IMAGE_U8: {
+        const uint8_t* pixels = static_cast<const uint8_t*>(input.data);
+        size_t channels = image.channels();
+        if (image.planar()) {
+            size_t plane = sample_size / channels;
+            size_t pixel_count = std::min(input.size / channels, plane);
+            image.apply(pixels, pixel_count, plane, row);
+            for (size_t c = 0; c < channels; ++c) {
+                std::fill(row + c * plane + pixel_count, row + (c + 1) * plane, 0.0f);
+            }
+            count = channels * plane;
+        } else {
+            size_t pixel_count = count / channels;
+            image.apply(pixels, pixel_count, 0, row);
+            count = pixel_count * channels;
+        }
+        break;
+    }
+    }
+    std::fill(row + count, row + sample_size, 0.0f);
+}
+
+// Packs every input into its row of out (batch_rows rows of sample_size
+// floats) and zeroes the rows past the inputs, up to batch_rows.
+inline void packRows(const std::vector<InputSpan>& inputs, size_t sample_size,
+                     size_t batch_rows, float* out, const ImageTransform& image = ImageTransform()) {
+    float* slot = out;
+    for (const auto& input : inputs) {
+        packRow(input, sample_size, image, slot);
+        slot += sample_size;
+    }
+    std::fill(slot, out + batch_rows * sample_size, 0.0f);
+}
+
+// packRows for a float16 model: float16 inputs are copied as they are,
+// the others converted through one float row
+inline void packHalfRows(const std::vector<InputSpan>& inputs, size_t sample_size,
+                         size_t batch_rows, uint16_t* out, const ImageTransform& image = ImageTransform()) {
+    std::vector<float> row;
+    uint16_t* slot = out;
+    for (const auto& input : inputs) {
+        if (input.encoding == InputEncoding::FLOAT16) {
+            size_t count = std::min(input.size, sample_size);
+            std::copy_n(static_cast<const uint16_t*>(input.data), count, slot);
+            std::fill(slot + count, slot + sample_size, uint16_t(0));
+        } else {
+            row.resize(sample_size);
+            packRow(input, sample_size, image, row.data());
+            floatsToHalves(row.data(), slot, sample_size);
+        }
+        slot += sample_size;
+    }
+    std::fill(slot, out + batch_rows * sample_size, uint16_t(0));
+}
+
+// one view per real row of a batch output, all sharing owner
+template<typename Owner>
+std::vector<TensorView> sliceRows(const std::shared_ptr<Owner>& owner, const float* base,
+                                  size_t rows, size_t row_size) {
+    std::vector<TensorView> results;
+    results.reserve(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        results.push_back(TensorView::slice(owner, base, i * row_size, row_size));
+    }
+    return results;
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef BATCH_POLICY_H
+#define BATCH_POLICY_H
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+// Online batch size / wait time tuning for BatchProcessor.
+//
+// Keeps an EWMA of the measured run time for every batch size and of the
+// request arrival rate, and aims the p99 of (queue wait + run time) at a
+// target. A batch waits for more requests only while the expected time to
+// fill it plus its run time still fits in the latency budget, and an idle
+// engine is never kept waiting for requests that are unlikely to arrive.
+// The budget itself is scaled from the observed p99 of recent requests.
+class AdaptiveBatchPolicy {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Micros = std::chrono::microseconds;
+
+    struct Decision {
+        size_t target_batch_size;
+        Micros wait;  // how much longer to wait for more requests
+    };
+
+    struct Snapshot {
+        size_t target_batch_size;
+        int64_t wait_us;
+        double arrival_rate;        // requests per second
+        double observed_p99_us;
+        double budget_scale;
+        int64_t latency_target_us;
+        std::vector<double> run_time_us;  // EWMA per batch size, 0 = not measured
+    };
+
+    AdaptiveBatchPolicy(size_t max_batch_size, Micros max_wait, Micros latency_target)
+        : max_batch_size_(max_batch_size),
+          max_wait_(max_wait),
+          latency_target_(latency_target),
+          run_time_us_(max_batch_size + 1, 0.0) {}
+
+    // called by the collector with the processor's running request count
+    void observeArrivals(int64_t total_requests, Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (last_sample_count_ < 0) {
+            last_sample_count_ = total_requests;
+            last_sample_time_ = now;
+            return;
+        }
+        double elapsed_s = std::chrono::duration<double>(now - last_sample_time_).count();
+        if (elapsed_s < kRateSampleSeconds) return;
+        double rate = (total_requests - last_sample_count_) / elapsed_s;
+        arrival_rate_ = arrival_rate_ == 0.0 ? rate : kAlpha * rate + (1 - kAlpha) * arrival_rate_;
+        last_sample_count_ = total_requests;
+        last_sample_time_ = now;
+    }
+
+    // queued: requests already in the forming batch
+    // oldest_age: how long the oldest of them has been waiting
+    // in_flight: batches currently running
+    Decision decide(size_t queued, Micros oldest_age, size_t in_flight) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double budget_us = latency_target_.count() * budget_scale_;
+        double rate_per_us = arrival_rate_ / 1e6;
+
+        // largest batch whose fill time plus run time fits the budget
+        size_t target = std::max<size_t>(queued, 1);
+        for (size_t b = max_batch_size_; b > queued; --b) {
+            double fill_us = rate_per_us > 0 ? (b - queued) / rate_per_us : 1e18;
+            if (oldest_age.count() + fill_us + estimateRunUs(b) <= budget_us) {
+                target = b;
+                break;
+            }
+        }
+
+        double wait_us = 0.0;
+        if (target > queued) {
+            wait_us = budget_us - oldest_age.count() - estimateRunUs(target);
+            // an idle engine only waits if the next request should arrive
+            // sooner than it takes to run the batch we already have
+            if (in_flight == 0) {
+                double next_arrival_us = rate_per_us > 0 ? 1.0 / rate_per_us : 1e18;
+                if (next_arrival_us > estimateRunUs(queued)) {
+                    wait_us = 0.0;
+                }
+            }
+            wait_us = std::clamp(wait_us, 0.0, static_cast<double>(max_wait_.count()));
+        }
+        last_target_ = target;
+        last_wait_us_ = static_cast<int64_t>(wait_us);
+        return Decision{target, Micros(last_wait_us_)};
+    }
+
+    // latencies_us: queue wait + run time of every request in the batch
+    void recordBatch(size_t batch_size, Micros run_time, const std::vector<int64_t>& latencies_us) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (batch_size > 0 && batch_size <= max_batch_size_) {
+            double& ewma = run_time_us_[batch_size];
+            double sample = static_cast<double>(run_time.count());
+            ewma = ewma == 0.0 ? sample : kAlpha * sample + (1 - kAlpha) * ewma;
+        }
+        for (int64_t latency : latencies_us) {
+            if (latency_window_.size() < kLatencyWindow) {
+                latency_window_.push_back(latency);
+            } else {
+                latency_window_[window_pos_] = latency;
+            }
+            window_pos_ = (window_pos_ + 1) % kLatencyWindow;
+        }
+        if (++batches_since_adjust_ >= kAdjustEveryBatches) {
+            adjustBudget();
+            batches_since_adjust_ = 0;
+        }
+    }
+
+    Snapshot snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Snapshot{
+            last_target_,
+            last_wait_us_,
+            arrival_rate_,
+            observed_p99_us_,
+            budget_scale_,
+            latency_target_.count(),
+            run_time_us_
+        };
+    }
+
+private:
+    static constexpr double kAlpha = 0.2;
+    static constexpr double kRateSampleSeconds = 0.05;
+    static constexpr size_t kLatencyWindow = 1024;
+    static constexpr int kAdjustEveryBatches = 16;
+
+    // unmeasured sizes are scaled linearly from the nearest measured one
+    double estimateRunUs(size_t batch_size) const {
+        if (batch_size == 0) return 0.0;
+        if (run_time_us_[batch_size] > 0) return run_time_us_[batch_size];
+        for (size_t d = 1; d <= max_batch_size_; ++d) {
+            if (batch_size > d && run_time_us_[batch_size - d] > 0) {
+                return run_time_us_[batch_size - d] * batch_size / (batch_size - d);
+            }
+            if (batch_size + d <= max_batch_size_ && run_time_us_[batch_size + d] > 0) {
+                return run_time_us_[batch_size + d] * batch_size / (batch_size + d);
+            }
+        }
+        return 0.0;
+    }
+
+    // shrink the budget while the observed p99 is over target, grow it back
+    // slowly while there is headroom
+    void adjustBudget() {
+        if (latency_window_.empty()) return;
+        std::vector<int64_t> sorted = latency_window_;
+        size_t idx = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+        std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+        observed_p99_us_ = static_cast<double>(sorted[idx]);
+        double target = static_cast<double>(latency_target_.count());
+        if (observed_p99_us_ > target) {
+            budget_scale_ = std::max(0.1, budget_scale_ * 0.8);
+        } else if (observed_p99_us_ < 0.8 * target) {
+            budget_scale_ = std::min(1.0, budget_scale_ * 1.05);
+        }
+    }
+
+    size_t max_batch_size_;
+    Micros max_wait_;
+    Micros latency_target_;
+    mutable std::mutex mutex_;
+    std::vector<double> run_time_us_;
+    double arrival_rate_{0.0};
+    int64_t last_sample_count_{-1};
+    Clock::time_point last_sample_time_;
+    std::vector<int64_t> latency_window_;
+    size_t window_pos_{0};
+    int batches_since_adjust_{0};
+    double observed_p99_us_{0.0};
+    double budget_scale_{1.0};
+    size_t last_target_{1};
+    int64_t last_wait_us_{0};
+};
+
+#endif
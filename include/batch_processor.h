@@ -3,27 +3,132 @@
 
 #include <vector>
 #include <queue>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <functional>
 #include <chrono>
-#include <future>
 #include <atomic>
+#include <stdexcept>
+#include <memory>
+#include <optional>
+#include <array>
+#include <algorithm>
+#include "completion.h"
+#include "mpsc_ring.h"
+#include "batch_policy.h"
+#include "stage_metrics.h"
+
+// Queue lanes: batches are filled from INTERACTIVE first, so bulk traffic
+// only gets the room interactive requests leave
+enum class Priority {
+    INTERACTIVE = 0,
+    BATCH = 1
+};
+
+// how submit() queues a request
+struct SubmitOptions {
+    Priority priority = Priority::INTERACTIVE;
+    // a request still queued at its deadline is failed instead of run;
+    // max = none
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+};
+
+// The error a completion gets for a request the processor turned away
+// without running: its lane was full, it could not finish by its deadline,
+// or the deadline passed while it was queued.
+class RejectedError : public std::runtime_error {
+public:
+    enum class Reason {
+        QUEUE_FULL,
+        DEADLINE
+    };
+    RejectedError(Reason reason, const std::string& message)
+        : std::runtime_error(message), reason_(reason) {}
+    Reason reason() const { return reason_; }
+
+private:
+    Reason reason_;
+};
 
 template<typename Request, typename Response>
 class BatchProcessor {
 public:
     using BatchCallback = std::function<std::vector<Response>(const std::vector<Request>&)>;
+    // runs an already packed batch
+    using BatchRunner = std::function<std::vector<Response>()>;
+    // packs a batch (e.g. into its input tensor) and returns the closure that runs it
+    using PackCallback = std::function<BatchRunner(const std::vector<Request>&)>;
+    // Called once per request from a batch thread, with either the response
+    // (which it may move from) or the error that failed the batch
+    using Completion = std::function<void(Response* response, std::exception_ptr error)>;
     
+    // num_workers threads form and run batches concurrently; the callback
+    // must be safe to call from all of them at once
     BatchProcessor(
         size_t max_batch_size,
         std::chrono::milliseconds timeout,
-        BatchCallback callback
+        BatchCallback callback,
+        size_t num_workers = 1
     );
     
     ~BatchProcessor();
     Response process(const Request& request);
+    // moves the request through the queue into the batch without copying it
+    Response process(Request&& request);
+    // Enqueues a whole group at once (one lock or one wake-up for all of it)
+    // and waits for every response; responses are in request order
+    std::vector<Response> processAll(std::vector<Request>&& requests);
+    // Enqueues without waiting; done runs when the request's batch finishes,
+    // so callers can consume responses in completion order, and nothing
+    // holds a thread while the request waits. process() and processAll()
+    // are this plus a latch on the caller's stack. Completions should be
+    // short, they hold up the batch thread. A rejected request (see
+    // RejectedError) has done called before submit() returns.
+    void submit(Request&& request, Completion done, const SubmitOptions& options = SubmitOptions());
+    // submit() for a whole group, enqueued in one go. Admitted request by
+    // request from the front: those past the lane's free space, or that the
+    // queue ahead would make miss the deadline, are rejected.
+    void submitAll(std::vector<Request>&& requests, std::vector<Completion>&& done,
+                   const SubmitOptions& options = SubmitOptions());
+    // submitAll() for a bulk group of any size: at most window of its
+    // requests are queued or running at once, and each one that finishes
+    // lets the next in, so the group never fills the lane by itself. A
+    // request the lane turns away waits for the group's next completion and
+    // tries again; only when none of the group is left queued do it and the
+    // rest get the rejection. Requests are copied in when they are queued.
+    void submitWindowed(std::vector<Request>&& requests, std::vector<Completion>&& done,
+                        const SubmitOptions& options, size_t window);
+    
+    // Bounds each priority lane at limit queued requests (0 = unbounded).
+    // Requests for a full lane are rejected at once, and so are requests with
+    // a deadline the queue ahead of them would make them miss, judged from
+    // the recent batch run time. Must be called before start().
+    void setQueueLimit(size_t limit) { queue_limit_ = limit; }
+    
+    // Pipelined mode: a dedicated thread collects and packs batch k+1 while the
+    // worker threads are still running batch k. Up to pipeline_depth packed
+    // batches wait for a free worker. Without a pack callback the collector
+    // only forms batches and the workers call the batch callback.
+    // Must be called before start().
+    void enablePipeline(PackCallback pack, size_t pipeline_depth = 1);
+    
+    // Replaces the mutex-protected queue with a bounded lock-free ring.
+    // Producers never take a lock; the consumer spins briefly and then parks,
+    // and producers only signal it while it is parked. When the ring is full
+    // producers yield until a slot frees up. Must be called before start().
+    void useLockFreeQueue(size_t capacity);
+    
+    // Lets AdaptiveBatchPolicy pick the batch size and how long to wait for it,
+    // aiming the p99 of queue wait + run time at latency_target. The timeout
+    // passed to the constructor becomes the longest a batch is held back.
+    // Must be called before start().
+    void enableAdaptiveBatching(std::chrono::microseconds latency_target);
+    
+    // Runs first on every thread the processor starts, e.g. to pin it to a
+    // set of CPUs. Must be called before start().
+    void setThreadInit(std::function<void()> init) { thread_init_ = std::move(init); }
     
     void start();
     void stop();
@@ -33,23 +138,122 @@ public:
         int64_t timeout_batches;
         int64_t full_batches;
         double avg_batch_size;
+        int64_t batches_in_flight;
+        int64_t queue_depth;  // requests waiting to be batched
+        int64_t interactive_queued;
+        int64_t batch_queued;
+        int64_t rejected_queue_full;
+        int64_t rejected_deadline;  // turned away at submit, could not make their deadline
+        int64_t expired;            // deadline passed while queued
+        int64_t run_time_ewma_us;   // smoothed batch run time, behind the deadline estimate
+        // adaptive batching, zero when disabled
+        bool adaptive;
+        size_t target_batch_size;
+        int64_t batch_wait_us;
+        double arrival_rate;
+        double observed_p99_us;
+        double budget_scale;
+        int64_t latency_target_us;
+        std::vector<double> run_time_us_by_size;
     };
     
     Metrics getMetrics() const;
-    
+    // time from enqueue until the request's batch is formed
+    const LatencyHistogram& queueWaitHistogram() const { return queue_wait_; }
+
 private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t kLanes = 2;
+    struct QueueItem {
+        Request request;
+        Completion done;
+        Clock::time_point enqueued;
+        Clock::time_point deadline;
+    };
+    struct ReadyBatch {
+        std::vector<QueueItem> items;
+        BatchRunner run;
+        bool is_timeout;
+    };
+    
     void processingLoop();
+    void collectLoop();
+    void runLoop();
+    // false once the processor is stopping
+    bool collectBatch(std::vector<QueueItem>& batch, bool& is_timeout);
+    // false if nothing was queued by the deadline
+    bool waitForItems(Clock::time_point deadline);
+    // spin-then-park until the ring has items
+    bool waitForRing(Clock::time_point deadline);
+    void drainInto(std::vector<QueueItem>& batch);
+    // fails the requests whose deadline has passed, keeping the rest in order
+    void dropExpired(std::vector<QueueItem>& batch);
+    // How many of count requests due by deadline the lane takes, from the
+    // front; rejected is set to the error for the rest.
+    size_t admit(size_t lane, size_t count, Clock::time_point deadline, Clock::time_point now,
+                 std::exception_ptr& rejected);
+    struct Window;
+    void pumpWindow(const std::shared_ptr<Window>& window);
+    static void failWindow(Window& group, const std::vector<size_t>& indices, std::exception_ptr error);
+    static bool isRejection(const std::exception_ptr& error);
+    bool queuesEmpty() const;
+    void recordQueueWait(const std::vector<QueueItem>& batch);
+    void wakeConsumer();
+    // moves the requests out of the items; only the completions are used afterwards
+    std::vector<Request> takeRequests(std::vector<QueueItem>& batch) const;
     void processBatch(
-        std::vector<std::pair<Request, std::promise<Response>>>& batch,
+        std::vector<QueueItem>& batch,
+        bool is_timeout
+    );
+    void completeBatch(
+        std::vector<QueueItem>& batch,
+        const BatchRunner& run,
         bool is_timeout
     );
+    void failBatch(std::vector<QueueItem>& batch, std::exception_ptr error);
+    // runs and clears the item's completion; a throwing completion cannot
+    // fail the rest of the batch
+    static void finish(QueueItem& item, Response* response, std::exception_ptr error);
+    void enqueue(std::vector<QueueItem>&& items, const SubmitOptions& options);
+    static std::exception_ptr stoppedError() {
+        return std::make_exception_ptr(std::runtime_error("Batch processor stopped"));
+    }
     size_t max_batch_size_;
     std::chrono::milliseconds timeout_;
     BatchCallback callback_;
-    std::queue<std::pair<Request, std::promise<Response>>> request_queue_;
+    size_t num_workers_;
+    // one FIFO per Priority, drained in that order
+    std::array<std::queue<QueueItem>, kLanes> request_queues_;
     std::mutex queue_mutex_;
     std::condition_variable queue_cv_;
-    std::thread worker_thread_;
+    std::vector<std::thread> worker_threads_;
+    // lock-free queue backend, one ring per lane
+    std::array<std::unique_ptr<MpscRing<QueueItem>>, kLanes> rings_;
+    std::mutex consumer_mutex_;  // one consumer forms a batch at a time; producers never take it
+    std::mutex park_mutex_;
+    std::condition_variable park_cv_;
+    std::atomic<bool> consumer_parked_{false};
+    // pipelined mode
+    bool pipelined_{false};
+    PackCallback pack_;
+    size_t pipeline_depth_{1};
+    std::deque<ReadyBatch> ready_queue_;
+    std::mutex ready_mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable ready_space_cv_;
+    std::thread collector_thread_;
+    std::unique_ptr<AdaptiveBatchPolicy> policy_;
+    std::function<void()> thread_init_;
+    std::atomic<int64_t> batches_in_flight_{0};
+    std::atomic<int64_t> queued_{0};
+    // admission control
+    size_t queue_limit_ = 0;
+    std::array<std::atomic<int64_t>, kLanes> lane_queued_{};
+    std::atomic<int64_t> run_time_ewma_us_{0};
+    std::atomic<int64_t> rejected_queue_full_{0};
+    std::atomic<int64_t> rejected_deadline_{0};
+    std::atomic<int64_t> expired_{0};
+    LatencyHistogram queue_wait_;
     std::atomic<bool> running_{false};
     std::atomic<int64_t> total_requests_{0};
     std::atomic<int64_t> total_batches_{0};
@@ -63,92 +267,668 @@ template<typename Request, typename Response>
 BatchProcessor<Request, Response>::BatchProcessor(
     size_t max_batch_size,
     std::chrono::milliseconds timeout,
-    BatchCallback callback
+    BatchCallback callback,
+    size_t num_workers
 ) : max_batch_size_(max_batch_size),
     timeout_(timeout),
-    callback_(callback) {}
+    callback_(callback),
+    num_workers_(num_workers > 0 ? num_workers : 1) {}
 
 template<typename Request, typename Response>
 BatchProcessor<Request, Response>::~BatchProcessor() {
     stop();
 }
 
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::enablePipeline(PackCallback pack, size_t pipeline_depth) {
+    pipelined_ = true;
+    pack_ = std::move(pack);
+    pipeline_depth_ = pipeline_depth > 0 ? pipeline_depth : 1;
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::useLockFreeQueue(size_t capacity) {
+    for (auto& ring : rings_) {
+        ring = std::make_unique<MpscRing<QueueItem>>(capacity);
+    }
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::enableAdaptiveBatching(std::chrono::microseconds latency_target) {
+    policy_ = std::make_unique<AdaptiveBatchPolicy>(
+        max_batch_size_,
+        std::chrono::duration_cast<std::chrono::microseconds>(timeout_),
+        latency_target
+    );
+}
+
 template<typename Request, typename Response>
 void BatchProcessor<Request, Response>::start() {
     running_ = true;
-    worker_thread_ = std::thread(&BatchProcessor::processingLoop, this);
+    auto thread = [this](void (BatchProcessor::*loop)()) {
+        return std::thread([this, loop] {
+            if (thread_init_) thread_init_();
+            (this->*loop)();
+        });
+    };
+    if (pipelined_) {
+        collector_thread_ = thread(&BatchProcessor::collectLoop);
+    }
+    for (size_t i = 0; i < num_workers_; ++i) {
+        if (pipelined_) {
+            worker_threads_.push_back(thread(&BatchProcessor::runLoop));
+        } else {
+            worker_threads_.push_back(thread(&BatchProcessor::processingLoop));
+        }
+    }
 }
 
 template<typename Request, typename Response>
 void BatchProcessor<Request, Response>::stop() {
     running_ = false;
     queue_cv_.notify_all();
-    if (worker_thread_.joinable()) {
-        worker_thread_.join();
+    {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        park_cv_.notify_all();
+    }
+    ready_cv_.notify_all();
+    ready_space_cv_.notify_all();
+    if (collector_thread_.joinable()) {
+        collector_thread_.join();
+    }
+    for (auto& thread : worker_threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
+    worker_threads_.clear();
+    
+    // nothing will run what is still queued; fail it rather than leave its
+    // callers waiting
+    std::vector<QueueItem> leftover;
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        size_t before = leftover.size();
+        if (rings_[lane]) {
+            while (auto item = rings_[lane]->tryPop()) {
+                leftover.push_back(std::move(*item));
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            auto& queue = request_queues_[lane];
+            while (!queue.empty()) {
+                leftover.push_back(std::move(queue.front()));
+                queue.pop();
+            }
+        }
+        lane_queued_[lane] -= leftover.size() - before;
+    }
+    queued_ -= leftover.size();
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        for (auto& ready : ready_queue_) {
+            for (auto& item : ready.items) {
+                leftover.push_back(std::move(item));
+            }
+        }
+        ready_queue_.clear();
+    }
+    failBatch(leftover, stoppedError());
 }
 
 template<typename Request, typename Response>
 Response BatchProcessor<Request, Response>::process(const Request& request) {
-    std::promise<Response> promise;
-    std::future<Response> future = promise.get_future();
+    return process(Request(request));
+}
+
+template<typename Request, typename Response>
+Response BatchProcessor<Request, Response>::process(Request&& request) {
+    return awaitCompletion<Response>([&](Completion done) {
+        submit(std::move(request), std::move(done));
+    });
+}
+
+template<typename Request, typename Response>
+std::vector<Response> BatchProcessor<Request, Response>::processAll(std::vector<Request>&& requests) {
+    std::vector<std::optional<Response>> slots(requests.size());
+    CountdownLatch latch(requests.size());
+    std::vector<QueueItem> items;
+    items.reserve(requests.size());
+    auto now = Clock::now();
+    for (size_t i = 0; i < requests.size(); ++i) {
+        // two pointers, small enough for std::function to store inline
+        Completion done = [slot = &slots[i], &latch](Response* response, std::exception_ptr error) {
+            if (response) {
+                slot->emplace(std::move(*response));
+            }
+            latch.countDown(response ? nullptr : error);
+        };
+        items.push_back({std::move(requests[i]), std::move(done), now, Clock::time_point::max()});
+    }
+    enqueue(std::move(items), SubmitOptions());
     
+    // waits for all of them before rethrowing: the completions point at slots
+    latch.wait();
+    std::vector<Response> responses;
+    responses.reserve(slots.size());
+    for (auto& slot : slots) {
+        responses.push_back(std::move(*slot));
+    }
+    return responses;
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::submit(Request&& request, Completion done,
+                                               const SubmitOptions& options) {
+    std::vector<QueueItem> items;
+    items.push_back({std::move(request), std::move(done), Clock::now(), options.deadline});
+    enqueue(std::move(items), options);
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::submitAll(
+    std::vector<Request>&& requests,
+    std::vector<Completion>&& done,
+    const SubmitOptions& options
+) {
+    if (requests.size() != done.size()) {
+        throw std::invalid_argument("submitAll needs one completion per request");
+    }
+    std::vector<QueueItem> items;
+    items.reserve(requests.size());
+    auto now = Clock::now();
+    for (size_t i = 0; i < requests.size(); ++i) {
+        items.push_back({std::move(requests[i]), std::move(done[i]), now, options.deadline});
+    }
+    enqueue(std::move(items), options);
+}
+
+// a submitWindowed() group
+template<typename Request, typename Response>
+struct BatchProcessor<Request, Response>::Window {
+    std::vector<Request> requests;
+    std::vector<Completion> done;
+    SubmitOptions options;
+    size_t limit;
+    std::mutex mutex;
+    std::deque<size_t> pending;  // not queued yet, turned-away ones first
+    size_t outstanding = 0;      // queued or running
+};
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::submitWindowed(
+    std::vector<Request>&& requests,
+    std::vector<Completion>&& done,
+    const SubmitOptions& options,
+    size_t window
+) {
+    if (requests.size() != done.size()) {
+        throw std::invalid_argument("submitWindowed needs one completion per request");
+    }
+    auto group = std::make_shared<Window>();
+    group->requests = std::move(requests);
+    group->done = std::move(done);
+    group->options = options;
+    group->limit = std::max<size_t>(1, window);
+    for (size_t i = 0; i < group->requests.size(); ++i) {
+        group->pending.push_back(i);
+    }
+    pumpWindow(group);
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::pumpWindow(const std::shared_ptr<Window>& group) {
+    std::vector<size_t> next;
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        while (group->outstanding < group->limit && !group->pending.empty()) {
+            next.push_back(group->pending.front());
+            group->pending.pop_front();
+            group->outstanding++;
+        }
+    }
+    if (next.empty()) return;
+    std::vector<Request> requests;
+    std::vector<Completion> done;
+    requests.reserve(next.size());
+    done.reserve(next.size());
+    for (size_t i : next) {
+        requests.push_back(group->requests[i]);
+        done.push_back([this, group, i](Response* response, std::exception_ptr error) {
+            if (!response && isRejection(error)) {
+                std::vector<size_t> failed{i};
+                {
+                    std::lock_guard<std::mutex> lock(group->mutex);
+                    group->outstanding--;
+                    if (group->outstanding > 0 && group->options.deadline > Clock::now()) {
+                        // room frees up as the rest of the group finishes
+                        group->pending.push_front(i);
+                        return;
+                    }
+                    // nothing of the group left queued: the lane is full of
+                    // other work, or the deadline has passed
+                    failed.insert(failed.end(), group->pending.begin(), group->pending.end());
+                    group->pending.clear();
+                }
+                failWindow(*group, failed, error);
+                return;
+            }
+            Completion own = std::move(group->done[i]);
+            try {
+                own(response, error);
+            } catch (...) {
+                // the window moves on regardless
+            }
+            std::vector<size_t> stranded;
+            {
+                std::lock_guard<std::mutex> lock(group->mutex);
+                group->outstanding--;
+                if (!running_) {
+                    stranded.assign(group->pending.begin(), group->pending.end());
+                    group->pending.clear();
+                }
+            }
+            if (running_) {
+                pumpWindow(group);
+            } else {
+                failWindow(*group, stranded, stoppedError());
+            }
+        });
+    }
+    submitAll(std::move(requests), std::move(done), group->options);
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::failWindow(Window& group, const std::vector<size_t>& indices,
+                                                   std::exception_ptr error) {
+    for (size_t i : indices) {
+        Completion done = std::move(group.done[i]);
+        try {
+            done(nullptr, error);
+        } catch (...) {
+            // as in finish(): one owner failing must not strand the rest
+        }
+    }
+}
+
+template<typename Request, typename Response>
+bool BatchProcessor<Request, Response>::isRejection(const std::exception_ptr& error) {
+    if (!error) return false;
+    try {
+        std::rethrow_exception(error);
+    } catch (const RejectedError&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::enqueue(std::vector<QueueItem>&& items,
+                                                const SubmitOptions& options) {
+    if (items.empty()) return;
+    size_t lane = static_cast<size_t>(options.priority);
+    std::exception_ptr rejected;
+    size_t admitted = admit(lane, items.size(), options.deadline, items.front().enqueued, rejected);
+    if (admitted < items.size()) {
+        for (size_t i = admitted; i < items.size(); ++i) {
+            finish(items[i], nullptr, rejected);
+        }
+        items.resize(admitted);
+        if (items.empty()) return;
+    }
+    queued_ += items.size();
+    if (auto& ring = rings_[lane]) {
+        for (auto& item : items) {
+            while (!ring->tryPush(std::move(item))) {
+                wakeConsumer();
+                std::this_thread::yield();
+            }
+        }
+        total_requests_ += items.size();
+        wakeConsumer();
+        return;
+    }
     {
         std::lock_guard<std::mutex> lock(queue_mutex_);
-        request_queue_.push({request, std::move(promise)});
-        total_requests_++;
+        for (auto& item : items) {
+            request_queues_[lane].push(std::move(item));
+        }
+        total_requests_ += items.size();
+    }
+    if (items.size() == 1) {
+        queue_cv_.notify_one();
+    } else {
+        queue_cv_.notify_all();
+    }
+}
+
+template<typename Request, typename Response>
+size_t BatchProcessor<Request, Response>::admit(
+    size_t lane,
+    size_t count,
+    Clock::time_point deadline,
+    Clock::time_point now,
+    std::exception_ptr& rejected
+) {
+    // counted before the checks, so concurrent submits cannot all squeeze
+    // into the last free slot
+    int64_t ahead = lane_queued_[lane].fetch_add(static_cast<int64_t>(count));
+    int64_t admitted = static_cast<int64_t>(count);
+    if (queue_limit_ > 0 && ahead + admitted > static_cast<int64_t>(queue_limit_)) {
+        admitted = std::max<int64_t>(0, static_cast<int64_t>(queue_limit_) - ahead);
+        rejected_queue_full_ += static_cast<int64_t>(count) - admitted;
+        rejected = std::make_exception_ptr(RejectedError(RejectedError::Reason::QUEUE_FULL, "Queue full"));
+    }
+    int64_t run_us = run_time_ewma_us_.load(std::memory_order_relaxed);
+    if (admitted > 0 && deadline != Clock::time_point::max() && run_us > 0) {
+        // a bulk request also waits behind every interactive one
+        for (size_t higher = 0; higher < lane; ++higher) {
+            ahead += lane_queued_[higher].load(std::memory_order_relaxed);
+        }
+        auto batch_size = static_cast<int64_t>(max_batch_size_);
+        auto workers = static_cast<int64_t>(num_workers_);
+        int64_t in_flight = batches_in_flight_.load();
+        // request k of the group has ahead + k before it: whole rounds of
+        // batches before it gets a worker, then its own run
+        auto rounds_for = [&](int64_t k) {
+            return ((ahead + k) / batch_size + in_flight) / workers + 1;
+        };
+        int64_t budget_us = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+        int64_t rounds = budget_us / run_us;
+        if (rounds_for(admitted - 1) > rounds) {
+            // the last one that fits needs at most rounds_for(k) <= rounds
+            int64_t batches = rounds * workers - 1 - in_flight;
+            int64_t fits = batches < 0 ? 0 : std::clamp<int64_t>((batches + 1) * batch_size - ahead, 0, admitted);
+            rejected_deadline_ += admitted - fits;
+            admitted = fits;
+            rejected = std::make_exception_ptr(RejectedError(
+                RejectedError::Reason::DEADLINE, "Queue too long to meet the deadline"));
+        }
+    }
+    lane_queued_[lane] -= static_cast<int64_t>(count) - admitted;
+    return static_cast<size_t>(admitted);
+}
+
+template<typename Request, typename Response>
+bool BatchProcessor<Request, Response>::queuesEmpty() const {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        if (rings_[lane] ? !rings_[lane]->empty() : !request_queues_[lane].empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::dropExpired(std::vector<QueueItem>& batch) {
+    auto now = Clock::now();
+    size_t kept = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (batch[i].deadline <= now) {
+            expired_++;
+            finish(batch[i], nullptr, std::make_exception_ptr(RejectedError(
+                RejectedError::Reason::DEADLINE, "Deadline passed while queued")));
+            continue;
+        }
+        if (kept != i) {
+            batch[kept] = std::move(batch[i]);
+        }
+        kept++;
+    }
+    batch.resize(kept);
+}
+
+template<typename Request, typename Response>
+bool BatchProcessor<Request, Response>::collectBatch(
+    std::vector<QueueItem>& batch,
+    bool& is_timeout
+) {
+    std::lock_guard<std::mutex> consumer(consumer_mutex_);
+    is_timeout = !waitForItems(Clock::now() + timeout_);
+    if (!running_) return false;
+    batch.clear();
+    drainInto(batch);
+    if (!policy_ || batch.empty()) {
+        dropExpired(batch);
+        recordQueueWait(batch);
+        return true;
+    }
+    
+    // hold the batch back only while the policy expects it to pay off
+    policy_->observeArrivals(total_requests_.load(), Clock::now());
+    while (running_ && batch.size() < max_batch_size_) {
+        auto now = Clock::now();
+        auto decision = policy_->decide(
+            batch.size(),
+            std::chrono::duration_cast<std::chrono::microseconds>(now - batch.front().enqueued),
+            static_cast<size_t>(batches_in_flight_.load())
+        );
+        if (batch.size() >= decision.target_batch_size || decision.wait.count() <= 0) break;
+        if (!waitForItems(now + decision.wait)) {
+            is_timeout = true;
+            break;
+        }
+        drainInto(batch);
+    }
+    dropExpired(batch);
+    recordQueueWait(batch);
+    return running_;
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::recordQueueWait(const std::vector<QueueItem>& batch) {
+    auto formed = Clock::now();
+    for (const auto& item : batch) {
+        queue_wait_.record(formed - item.enqueued);
+    }
+}
+
+template<typename Request, typename Response>
+bool BatchProcessor<Request, Response>::waitForItems(Clock::time_point deadline) {
+    if (rings_[0]) {
+        return waitForRing(deadline);
+    }
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    return queue_cv_.wait_until(
+        lock,
+        deadline,
+        [this] { return !queuesEmpty() || !running_; }
+    );
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::drainInto(std::vector<QueueItem>& batch) {
+    size_t before = batch.size();
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        size_t lane_before = batch.size();
+        if (rings_[lane]) {
+            while (batch.size() < max_batch_size_) {
+                auto item = rings_[lane]->tryPop();
+                if (!item) break;
+                batch.push_back(std::move(*item));
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            auto& queue = request_queues_[lane];
+            while (!queue.empty() && batch.size() < max_batch_size_) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop();
+            }
+        }
+        lane_queued_[lane] -= batch.size() - lane_before;
+    }
+    queued_ -= batch.size() - before;
+}
+
+template<typename Request, typename Response>
+bool BatchProcessor<Request, Response>::waitForRing(Clock::time_point deadline) {
+    constexpr int kSpinIterations = 2000;
+    for (int i = 0; i < kSpinIterations; ++i) {
+        if (!queuesEmpty() || !running_) return true;
+        if ((i & 63) == 63 && Clock::now() >= deadline) return false;
+        cpuRelax();
+    }
+    
+    std::unique_lock<std::mutex> lock(park_mutex_);
+    consumer_parked_.store(true, std::memory_order_relaxed);
+    // pairs with the fence in wakeConsumer: either we see the push or the
+    // producer sees us parked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool ready = park_cv_.wait_until(
+        lock,
+        deadline,
+        [this] { return !queuesEmpty() || !running_; }
+    );
+    consumer_parked_.store(false, std::memory_order_relaxed);
+    return ready;
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::wakeConsumer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_parked_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        park_cv_.notify_one();
     }
-    queue_cv_.notify_one();
-    return future.get();
 }
 
 template<typename Request, typename Response>
 void BatchProcessor<Request, Response>::processingLoop() {
-    std::vector<std::pair<Request, std::promise<Response>>> batch;
+    std::vector<QueueItem> batch;
     batch.reserve(max_batch_size_);
     while (running_) {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        bool timeout = !queue_cv_.wait_for(
-            lock,
-            timeout_,
-            [this] { return !request_queue_.empty() || !running_; }
-        );
-        if (!running_) break;
-        batch.clear();
-        while (!request_queue_.empty() && batch.size() < max_batch_size_) {
-            batch.push_back(std::move(request_queue_.front()));
-            request_queue_.pop();
+        bool timeout = false;
+        if (!collectBatch(batch, timeout)) {
+            failBatch(batch, stoppedError());
+            break;
         }
-        
-        lock.unlock();
-        
         if (!batch.empty()) {
             processBatch(batch, timeout);
         }
     }
 }
 
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::collectLoop() {
+    while (running_) {
+        ReadyBatch ready;
+        ready.items.reserve(max_batch_size_);
+        if (!collectBatch(ready.items, ready.is_timeout)) {
+            failBatch(ready.items, stoppedError());
+            break;
+        }
+        if (ready.items.empty()) continue;
+        
+        // pack before waiting for a worker, so it overlaps the running batch
+        try {
+            std::vector<Request> requests = takeRequests(ready.items);
+            if (pack_) {
+                ready.run = pack_(requests);
+            } else {
+                ready.run = [this, requests = std::move(requests)] { return callback_(requests); };
+            }
+        } catch (const std::exception& e) {
+            failBatch(ready.items, std::current_exception());
+            continue;
+        }
+        
+        {
+            std::unique_lock<std::mutex> lock(ready_mutex_);
+            ready_space_cv_.wait(lock, [this] {
+                return ready_queue_.size() < pipeline_depth_ || !running_;
+            });
+            if (!running_) {
+                failBatch(ready.items, stoppedError());
+                break;
+            }
+            ready_queue_.push_back(std::move(ready));
+        }
+        ready_cv_.notify_one();
+    }
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::runLoop() {
+    while (running_) {
+        ReadyBatch ready;
+        {
+            std::unique_lock<std::mutex> lock(ready_mutex_);
+            ready_cv_.wait(lock, [this] { return !ready_queue_.empty() || !running_; });
+            if (!running_) break;
+            ready = std::move(ready_queue_.front());
+            ready_queue_.pop_front();
+        }
+        ready_space_cv_.notify_one();
+        completeBatch(ready.items, ready.run, ready.is_timeout);
+    }
+}
+
+template<typename Request, typename Response>
+std::vector<Request> BatchProcessor<Request, Response>::takeRequests(
+    std::vector<QueueItem>& batch
+) const {
+    std::vector<Request> requests;
+    requests.reserve(batch.size());
+    for (auto& item : batch) {
+        requests.push_back(std::move(item.request));
+    }
+    return requests;
+}
+
 template<typename Request, typename Response>
 void BatchProcessor<Request, Response>::processBatch(
-    std::vector<std::pair<Request, std::promise<Response>>>& batch,
+    std::vector<QueueItem>& batch,
+    bool is_timeout
+) {
+    if (batch.empty()) return;
+    
+    std::vector<Request> requests = takeRequests(batch);
+    completeBatch(batch, [this, &requests] { return callback_(requests); }, is_timeout);
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::completeBatch(
+    std::vector<QueueItem>& batch,
+    const BatchRunner& run,
     bool is_timeout
 ) {
     if (batch.empty()) return;
     
     try {
-        std::vector<Request> requests;
-        requests.reserve(batch.size());
-        for (auto& item : batch) {
-            requests.push_back(item.first);
+        auto dispatched = Clock::now();
+        batches_in_flight_++;
+        std::vector<Response> responses;
+        try {
+            responses = run();
+        } catch (...) {
+            batches_in_flight_--;
+            throw;
         }
-        auto responses = callback_(requests);
+        batches_in_flight_--;
+        auto run_time = std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - dispatched);
+        // racing updates only lose a sample, which an estimate can afford
+        int64_t ewma = run_time_ewma_us_.load(std::memory_order_relaxed);
+        run_time_ewma_us_.store(ewma == 0 ? run_time.count() : ewma + (run_time.count() - ewma) / 8,
+                                std::memory_order_relaxed);
+        if (policy_) {
+            std::vector<int64_t> latencies_us;
+            latencies_us.reserve(batch.size());
+            for (const auto& item : batch) {
+                auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                    dispatched - item.enqueued);
+                latencies_us.push_back((waited + run_time).count());
+            }
+            policy_->recordBatch(batch.size(), run_time, latencies_us);
+        }
+        
         for (size_t i = 0; i < batch.size(); ++i) {
             if (i < responses.size()) {
-                batch[i].second.set_value(responses[i]);
+                finish(batch[i], &responses[i], nullptr);
             } else {
                 // If callback returned fewer results, fail the remaining ones
                 // rather than letting them hang indefinitely
-                batch[i].second.set_exception(
+                finish(batch[i], nullptr,
                     std::make_exception_ptr(std::runtime_error("No response for batched request"))
                 );
             }
@@ -167,30 +947,71 @@ void BatchProcessor<Request, Response>::processBatch(
         std::lock_guard<std::mutex> lock(metrics_mutex_);
         int64_t batches = total_batches_.load();
         avg_batch_size_ = (avg_batch_size_ * (batches - 1) + batch.size()) / batches;
-        
+    
     } catch (const std::exception& e) {
-        // Set exception for all promises
-        for (auto& item : batch) {
-            try {
-                item.second.set_exception(std::current_exception());
-            } catch (...) {
-                // Promise already set or moved
-            }
-        }
+        failBatch(batch, std::current_exception());
+    }
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::failBatch(
+    std::vector<QueueItem>& batch,
+    std::exception_ptr error
+) {
+    // Fail every request that has not completed yet
+    for (auto& item : batch) {
+        finish(item, nullptr, error);
+    }
+}
+
+template<typename Request, typename Response>
+void BatchProcessor<Request, Response>::finish(
+    QueueItem& item,
+    Response* response,
+    std::exception_ptr error
+) {
+    Completion done = std::move(item.done);
+    item.done = nullptr;
+    if (!done) return;
+    try {
+        done(response, error);
+    } catch (...) {
+        // the request's owner failed to take its result; nothing to retry
     }
 }
 
 template<typename Request, typename Response>
-typename BatchProcessor<Request, Response>::Metrics 
+typename BatchProcessor<Request, Response>::Metrics
 BatchProcessor<Request, Response>::getMetrics() const {
-    std::lock_guard<std::mutex> lock(metrics_mutex_);
-    return Metrics{
-        total_requests_.load(),
-        total_batches_.load(),
-        timeout_batches_.load(),
-        full_batches_.load(),
-        avg_batch_size_
-    };
+    Metrics metrics{};
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        metrics.avg_batch_size = avg_batch_size_;
+    }
+    metrics.total_requests = total_requests_.load();
+    metrics.total_batches = total_batches_.load();
+    metrics.timeout_batches = timeout_batches_.load();
+    metrics.full_batches = full_batches_.load();
+    metrics.batches_in_flight = batches_in_flight_.load();
+    metrics.queue_depth = std::max<int64_t>(0, queued_.load());
+    metrics.interactive_queued = std::max<int64_t>(0, lane_queued_[0].load());
+    metrics.batch_queued = std::max<int64_t>(0, lane_queued_[1].load());
+    metrics.rejected_queue_full = rejected_queue_full_.load();
+    metrics.rejected_deadline = rejected_deadline_.load();
+    metrics.expired = expired_.load();
+    metrics.run_time_ewma_us = run_time_ewma_us_.load();
+    metrics.adaptive = policy_ != nullptr;
+    if (policy_) {
+        auto policy = policy_->snapshot();
+        metrics.target_batch_size = policy.target_batch_size;
+        metrics.batch_wait_us = policy.wait_us;
+        metrics.arrival_rate = policy.arrival_rate;
+        metrics.observed_p99_us = policy.observed_p99_us;
+        metrics.budget_scale = policy.budget_scale;
+        metrics.latency_target_us = policy.latency_target_us;
+        metrics.run_time_us_by_size = std::move(policy.run_time_us);
+    }
+    return metrics;
 }
 
-#endif 
\ No newline at end of file
+#endif
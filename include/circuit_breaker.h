@@ -3,7 +3,6 @@
 
 #include <string>
 #include <chrono>
-#include <mutex>
 #include <atomic>
 
 enum class CircuitState {
@@ -12,6 +11,9 @@ enum class CircuitState {
     HALF_OPEN   
 };
 
+// Lock-free: a request while CLOSED costs one atomic load, and every state
+// change is a single store or compare-and-swap, so request threads never
+// wait on each other here.
 class CircuitBreaker {
 public:
     CircuitBreaker(
@@ -22,24 +24,29 @@ public:
     bool allowRequest();
     void recordSuccess();
     void recordFailure();
+    // an out-of-band health check passed: an OPEN breaker goes HALF_OPEN now
+    // instead of after its timeout, and the next requests decide the rest
+    void recordProbeSuccess();
     CircuitState getState() const;
     std::string getStateString() const;
     int getFailureCount() const;
     int getSuccessCount() const;
     
 private:
+    using Clock = std::chrono::steady_clock;
+
     void transitionToOpen();
     void transitionToHalfOpen();
     void transitionToClosed();
-    bool shouldAttemptReset();
+    bool shouldAttemptReset() const;
     std::atomic<CircuitState> state_;
     std::atomic<int> failure_count_;
     std::atomic<int> success_count_;
     int failure_threshold_;
     int success_threshold_;
     std::chrono::seconds timeout_;
-    std::chrono::steady_clock::time_point last_failure_time_;
-    mutable std::mutex mutex_;
+    // steady clock ticks; written before the state it opens
+    std::atomic<Clock::rep> last_failure_ticks_;
 };
 
-#endif 
\ No newline at end of file
+#endif 
@@ -0,0 +1,78 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+// Blocks until count completions have come in, from any threads. Lives on
+// the waiting thread's stack, so a blocking call on top of a callback API
+// costs no promise or shared state.
+class CountdownLatch {
+public:
+    explicit CountdownLatch(size_t count) : remaining_(count) {}
+    CountdownLatch(const CountdownLatch&) = delete;
+    CountdownLatch& operator=(const CountdownLatch&) = delete;
+
+    // error, if set, is rethrown by wait() unless an earlier one was
+    void countDown(std::exception_ptr error = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error && !error_) {
+            error_ = error;
+        }
+        // notified under the lock: the waiter cannot return, and destroy the
+        // latch, before this call is done with it
+        if (--remaining_ == 0) {
+            cv_.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return remaining_ == 0; });
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t remaining_;
+    std::exception_ptr error_;
+};
+
+// Calls start with a completion taking (T* result, std::exception_ptr error)
+// and blocks until it runs, returning the result or rethrowing the error.
+template<typename T, typename Start>
+T awaitCompletion(Start&& start) {
+    std::optional<T> result;
+    CountdownLatch latch(1);
+    start([&result, &latch](T* value, std::exception_ptr error) {
+        if (value) {
+            result.emplace(std::move(*value));
+            latch.countDown();
+        } else {
+            latch.countDown(error ? error : std::make_exception_ptr(
+                std::runtime_error("Completed without a result")));
+        }
+    });
+    latch.wait();
+    return std::move(*result);
+}
+
+// what() of the exception in error, for logs and error bodies
+inline std::string errorMessage(std::exception_ptr error) {
+    try {
+        if (error) std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        return e.what();
+    } catch (...) {
+    }
+    return "Unknown error";
+}
+
+#endif
@@ -4,23 +4,71 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <memory>
 #include <mutex>
+#include <atomic>
 #include <cstdint>
 
+// Consistent hash ring with lock-free reads. Every membership change builds
+// a new immutable snapshot (sorted flat array of virtual node hashes, plus
+// the distinct successor list of every position) and publishes it with one
+// atomic store. Lookups are a binary search over the array and never lock
+// or allocate. A change hashes only the node added or removed and merges
+// its points into the previous snapshot's sorted ones, so it takes time
+// linear in the ring without rehashing or re-sorting the other nodes.
+// Superseded snapshots stay alive until the ring is destroyed, which keeps
+// returned node references valid and is cheap because membership changes
+// are rare.
 class ConsistentHash {
 public:
     explicit ConsistentHash(int virtual_nodes = 150);
+    ~ConsistentHash();
+    ConsistentHash(const ConsistentHash&) = delete;
+    ConsistentHash& operator=(const ConsistentHash&) = delete;
+
     void addNode(const std::string& node);
     void removeNode(const std::string& node);
-    std::string getNode(const std::string& key) const;
+    // owner of key, or an empty string if the ring is empty
+    const std::string& getNode(const std::string& key) const;
+    // the first n distinct nodes clockwise from key, owner first; fewer if
+    // the ring has fewer nodes
+    std::vector<std::string> getNodes(const std::string& key, size_t n) const;
+    // getNodes without copies: writes up to max node pointers (valid for the
+    // ring's lifetime) into out and returns how many
+    size_t getSuccessors(const std::string& key, const std::string** out, size_t max) const;
     std::vector<std::string> getAllNodes() const;
+    size_t nodeCount() const;
     std::map<std::string, int> getDistribution(const std::vector<std::string>& keys) const;
-    
+
+    // successors precomputed per position; longer lists walk the ring
+    static constexpr size_t kMaxSuccessors = 8;
+
 private:
+    // (hash, node index) of one virtual node
+    using Point = std::pair<uint32_t, uint32_t>;
+
+    struct Snapshot {
+        std::vector<std::string> nodes;
+        std::vector<Point> points;         // every virtual node, sorted, collisions included
+        std::vector<uint32_t> hashes;      // sorted virtual node hashes
+        std::vector<uint32_t> owners;      // node index per hash
+        size_t owning_nodes = 0;           // nodes with at least one point
+        size_t successor_width = 0;        // min(owning_nodes, kMaxSuccessors)
+        std::vector<uint32_t> successors;  // successor_width node indices per hash
+    };
+
     uint32_t hash(const std::string& key) const;
+    // position of the first virtual node at or after key's hash
+    size_t position(const Snapshot& ring, const std::string& key) const;
+    // the node's virtual nodes, sorted
+    std::vector<Point> nodePoints(const std::string& node, uint32_t index) const;
+    // caller holds write_mutex_; points sorted
+    void publish(std::vector<std::string> nodes, std::vector<Point> points);
+
     int virtual_nodes_;
-    std::map<uint32_t, std::string> ring_;
-    mutable std::mutex mutex_;
+    std::atomic<const Snapshot*> current_;
+    std::vector<std::unique_ptr<const Snapshot>> snapshots_;  // current and retired
+    std::mutex write_mutex_;
 };
 
-#endif
\ No newline at end of file
+#endif
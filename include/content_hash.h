@@ -0,0 +1,138 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+
+// 128-bit digest of a whole buffer, used as the cache key instead of the
+// buffer itself. Two digests are only equal for equal contents (up to a
+// ~2^-128 collision chance), so lookups never compare the tensors.
+struct ContentDigest {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    bool operator==(const ContentDigest& other) const {
+        return lo == other.lo && hi == other.hi;
+    }
+    bool operator!=(const ContentDigest& other) const { return !(*this == other); }
+};
+
+struct DigestHash {
+    size_t operator()(const ContentDigest& digest) const {
+        return static_cast<size_t>(digest.lo);
+    }
+};
+
+namespace content_hash_detail {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t mixRound(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t lane) {
+    acc ^= mixRound(0, lane);
+    return acc * kPrime1 + kPrime4;
+}
+
+inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+}  // namespace content_hash_detail
+
+// XXH64-style: four independent lanes over 32-byte stripes, so the
+// multiplies of a stripe overlap, then two different merges of the lanes
+// give the two halves of the digest. Near memory bandwidth on large tensors.
+inline ContentDigest digestBytes(const void* data, size_t len, uint64_t seed = 0) {
+    using namespace content_hash_detail;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + len;
+    uint64_t lo;
+    uint64_t hi;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = mixRound(v1, read64(p));
+            v2 = mixRound(v2, read64(p + 8));
+            v3 = mixRound(v3, read64(p + 16));
+            v4 = mixRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        lo = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        lo = mergeRound(lo, v1);
+        lo = mergeRound(lo, v2);
+        lo = mergeRound(lo, v3);
+        lo = mergeRound(lo, v4);
+        // same lanes, other order and rotations, so hi is not a function of lo
+        hi = rotl(v4, 3) + rotl(v3, 11) + rotl(v2, 23) + rotl(v1, 29);
+        hi = mergeRound(hi, v4);
+        hi = mergeRound(hi, v2);
+        hi = mergeRound(hi, v3);
+        hi = mergeRound(hi, v1);
+    } else {
+        lo = seed + kPrime5;
+        hi = seed + kPrime3;
+    }
+    lo += static_cast<uint64_t>(len);
+    hi ^= static_cast<uint64_t>(len) * kPrime4;
+
+    // tail, 8 / 4 / 1 bytes at a time
+    for (; p + 8 <= end; p += 8) {
+        uint64_t k = mixRound(0, read64(p));
+        lo = rotl(lo ^ k, 27) * kPrime1 + kPrime4;
+        hi = rotl(hi ^ k, 31) * kPrime2 + kPrime3;
+    }
+    if (p + 4 <= end) {
+        uint64_t k = static_cast<uint64_t>(read32(p)) * kPrime1;
+        lo = rotl(lo ^ k, 23) * kPrime2 + kPrime3;
+        hi = rotl(hi ^ k, 19) * kPrime1 + kPrime5;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        uint64_t k = static_cast<uint64_t>(*p) * kPrime5;
+        lo = rotl(lo ^ k, 11) * kPrime1;
+        hi = rotl(hi ^ k, 13) * kPrime2;
+    }
+    return ContentDigest{avalanche(lo), avalanche(hi ^ lo)};
+}
+
+inline ContentDigest digestFloats(const float* data, size_t count) {
+    return digestBytes(data, count * sizeof(float));
+}
+
+#endif
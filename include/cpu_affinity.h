@@ -0,0 +1,70 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <pthread.h>
+#include <sched.h>
+
+// Logical CPU ids, for pinning ORT and batcher threads.
+using CpuList = std::vector<int>;
+
+// Linux list syntax, as in /sys and taskset: "0-3,8,10-11"
+inline CpuList parseCpuList(const std::string& text) {
+    CpuList cpus;
+    std::stringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        try {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            if (first < 0 || last < first) throw std::invalid_argument(range);
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::logic_error&) {
+            throw std::invalid_argument("Bad CPU list: " + text);
+        }
+    }
+    return cpus;
+}
+
+// the CPUs of a NUMA node; throws if the node does not exist
+inline CpuList numaNodeCpus(int node) {
+    std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    std::ifstream file(path);
+    std::string text;
+    if (!file || !std::getline(file, text)) {
+        throw std::runtime_error("No NUMA node " + std::to_string(node));
+    }
+    return parseCpuList(text);
+}
+
+// The index-th of parts contiguous, near-equal slices, so sessions or
+// devices sharing a list do not share cores; the whole list when it has
+// fewer CPUs than parts.
+inline CpuList cpuSlice(const CpuList& cpus, size_t parts, size_t index) {
+    if (parts <= 1 || cpus.size() < parts) {
+        return cpus;
+    }
+    size_t begin = cpus.size() * index / parts;
+    size_t end = cpus.size() * (index + 1) / parts;
+    return CpuList(cpus.begin() + begin, cpus.begin() + end);
+}
+
+// pins the calling thread to cpus; false if the kernel refuses
+inline bool pinCurrentThread(const CpuList& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#endif
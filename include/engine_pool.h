@@ -0,0 +1,75 @@
+#ifndef ENGINE_POOL_H
+#define ENGINE_POOL_H
+
+#include "inference_engine.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// N independent sessions over the same model. Each call runs on whichever
+// session is idle, so N batches can be inside ORT Run at the same time.
+// With options.optimized_model_dir set, only the first session to see a
+// model file optimizes its graph; it saves the result there and every later
+// session over that file, in this pool or another, loads it as is. With
+// options.cpus set, each session pins its ORT threads to its own slice.
+class EnginePool {
+public:
+    EnginePool(const std::string& model_path, size_t num_sessions, int shard_id = 0,
+               const EngineOptions& options = EngineOptions());
+
+    std::vector<float> predict(const std::vector<float>& input);
+    std::vector<std::vector<float>> batchPredict(
+        const std::vector<std::vector<float>>& inputs
+    );
+    // packing only needs the model shape, so it does not take a session
+    PackedInput packBatch(const std::vector<InputSpan>& inputs) const {
+        return engines_.front()->packBatch(inputs);
+    }
+    std::vector<TensorView> runBatch(PackedInput& input);
+    // warms every session, in parallel
+    void warmup();
+
+    size_t size() const { return engines_.size(); }
+    size_t busyCount() const { return busy_.load(); }
+    const std::string& getModelPath() const { return engines_.front()->getModelPath(); }
+    std::vector<int64_t> getInputShape() const { return engines_.front()->getInputShape(); }
+    std::vector<int64_t> getOutputShape() const { return engines_.front()->getOutputShape(); }
+    const std::vector<size_t>& getBatchBuckets() const { return engines_.front()->getBatchBuckets(); }
+    bool isCudaGraphEnabled() const { return engines_.front()->isCudaGraphEnabled(); }
+    bool isCudaEnabled() const { return engines_.front()->isCudaEnabled(); }
+    bool isFloat16Model() const { return engines_.front()->isFloat16Model(); }
+    size_t getInputSampleSize() const { return engines_.front()->getInputSampleSize(); }
+    int deviceId() const { return device_id_; }
+
+private:
+    // one session, loading or saving the optimized graph at optimized (which
+    // is cleared when it turns out unusable)
+    static std::unique_ptr<InferenceEngine> createEngine(const std::string& model_path, int shard_id,
+                                                         const EngineOptions& options,
+                                                         std::string& optimized);
+
+    // returns the engine to the idle list when destroyed
+    class Lease {
+    public:
+        explicit Lease(EnginePool& pool);
+        ~Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        InferenceEngine* operator->() const { return engine_; }
+    private:
+        EnginePool& pool_;
+        InferenceEngine* engine_;
+    };
+
+    int device_id_;
+    std::vector<std::unique_ptr<InferenceEngine>> engines_;
+    std::vector<InferenceEngine*> idle_;
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<size_t> busy_{0};
+};
+
+#endif
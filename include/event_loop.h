@@ -0,0 +1,100 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <functional>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// One epoll thread running fd readiness callbacks, timers and tasks posted
+// from other threads. Everything except post() and stop() must be called on
+// the loop thread.
+class EventLoop {
+public:
+    using Task = std::function<void()>;
+    // gets the epoll event mask
+    using IoCallback = std::function<void(uint32_t events)>;
+    using TimerId = uint64_t;
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // runs on the calling thread until stop()
+    void run();
+    // any thread
+    void stop();
+    // any thread; tasks run on the loop thread in the order posted
+    void post(Task task);
+    // the loop running on the calling thread, or null
+    static EventLoop* current();
+    bool inLoopThread() const { return current() == this; }
+
+    // callbacks may watch, modify or unwatch any fd, their own included
+    void watch(int fd, uint32_t events, IoCallback callback);
+    void modify(int fd, uint32_t events);
+    void unwatch(int fd);
+
+    TimerId runAfter(std::chrono::microseconds delay, Task task);
+    // no-op for a timer that already ran
+    void cancel(TimerId id);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Watcher {
+        uint32_t generation;
+        std::shared_ptr<IoCallback> callback;
+    };
+
+    int nextTimeoutMs() const;
+    void runTimers();
+    void runPosted();
+
+    int epoll_fd_;
+    int wake_fd_;
+    std::atomic<bool> stopped_{false};
+    // the generation in each epoll event drops events for an fd that was
+    // closed, and perhaps reused, earlier in the same batch
+    std::unordered_map<int, Watcher> watchers_;
+    uint32_t next_generation_ = 0;
+    std::map<std::pair<Clock::time_point, TimerId>, Task> timers_;
+    std::unordered_map<TimerId, Clock::time_point> timer_due_;
+    TimerId next_timer_ = 1;
+    std::mutex posted_mutex_;
+    std::vector<Task> posted_;
+    bool wake_pending_ = false;  // guarded by posted_mutex_
+};
+
+// A fixed set of loops, one thread each.
+class EventLoopGroup {
+public:
+    explicit EventLoopGroup(size_t threads);
+    // stops and joins
+    ~EventLoopGroup();
+    EventLoopGroup(const EventLoopGroup&) = delete;
+    EventLoopGroup& operator=(const EventLoopGroup&) = delete;
+
+    void start();
+    void stop();
+    // blocks until every loop has stopped
+    void join();
+
+    std::vector<EventLoop*> loops() const;
+    size_t size() const { return loops_.size(); }
+    // round robin, for work that does not already run on a loop
+    EventLoop& next();
+
+private:
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_{0};
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef EVENT_SERVER_H
+#define EVENT_SERVER_H
+
+#include "event_loop.h"
+#include "http_text.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+
+struct HttpRequest {
+    std::string method;
+    std::string path;   // without the query string
+    std::string query;
+    HttpHeaders headers;
+    std::string body;
+
+    // case-insensitive; empty when absent
+    std::string header(const std::string& name) const;
+};
+
+class HttpConnection;
+
+// Answers one request. Copyable and usable from any thread, so a handler can
+// return at once and reply from whichever thread finishes the work; the
+// write happens on the connection's loop. Calls for a connection the client
+// has closed are dropped.
+class HttpReply {
+public:
+    HttpReply() = default;
+
+    // the whole response, once
+    void send(int status, const std::string& content_type, std::string body,
+              const HttpHeaders& headers = {}) const;
+    // Chunked response: start once, write any number of chunks, then end.
+    // Chunks go out in the order of the calls.
+    void startStream(int status, const std::string& content_type) const;
+    void write(std::string chunk) const;
+    void end() const;
+
+private:
+    friend class HttpConnection;
+    HttpReply(std::shared_ptr<HttpConnection> connection, uint64_t request)
+        : connection_(std::move(connection)), request_(request) {}
+
+    std::shared_ptr<HttpConnection> connection_;
+    uint64_t request_ = 0;  // which request on the connection this answers
+};
+
+// HTTP/1.1 server on a set of event loops (epoll): keep-alive connections,
+// Content-Length request bodies. Each loop accepts on its own SO_REUSEPORT
+// socket and serves its connections itself. A handler runs on the loop and
+// must not block it: long work goes elsewhere and replies when done, so an
+// in-flight request costs a connection, not a thread.
+class EventServer {
+public:
+    using Handler = std::function<void(HttpRequest& request, HttpReply reply)>;
+
+    explicit EventServer(std::vector<EventLoop*> loops);
+    ~EventServer();
+    EventServer(const EventServer&) = delete;
+    EventServer& operator=(const EventServer&) = delete;
+
+    // call before listen()
+    void handle(const std::string& method, const std::string& path, Handler handler);
+    void setMaxBodyBytes(size_t bytes) { max_body_bytes_ = bytes; }
+    void setKeepAliveTimeout(std::chrono::seconds timeout) { keep_alive_timeout_ = timeout; }
+
+    // Binds and starts accepting on every loop; the loops must be running.
+    // False if the address cannot be bound.
+    bool listen(const std::string& host, int port);
+
+private:
+    friend class HttpConnection;
+    void accept(int listen_fd, EventLoop& loop);
+    // the handler for a parsed request, or a 404 reply
+    void dispatch(HttpRequest& request, const HttpReply& reply) const;
+
+    std::vector<EventLoop*> loops_;
+    std::map<std::pair<std::string, std::string>, Handler> routes_;
+    std::vector<int> listen_fds_;
+    size_t max_body_bytes_ = size_t(1) << 30;
+    std::chrono::seconds keep_alive_timeout_{60};
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef FP16_H
+#define FP16_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// IEEE binary16 <-> float conversion. Uses the F16C instructions when the
+// build targets them, otherwise a bit-exact software path (round to nearest
+// even, subnormals, inf and NaN preserved).
+
+inline uint16_t floatToHalf(float value) {
+    uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t abs = x & 0x7FFFFFFFu;
+    if (abs >= 0x7F800000u) {
+        // inf stays inf, NaN stays a quiet NaN
+        return static_cast<uint16_t>(sign | 0x7C00u | (abs > 0x7F800000u ? 0x200u : 0));
+    }
+    if (abs >= 0x477FF000u) {
+        return static_cast<uint16_t>(sign | 0x7C00u);  // overflow to inf
+    }
+    if (abs < 0x38800000u) {
+        // subnormal half (or zero): shift the implicit-one mantissa into place
+        if (abs < 0x33000000u) return static_cast<uint16_t>(sign);
+        uint32_t exp = abs >> 23;
+        uint32_t mant = (abs & 0x7FFFFFu) | 0x800000u;
+        uint32_t shift = 126 - exp;
+        uint32_t half = mant >> shift;
+        uint32_t rest = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u))) half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = ((abs - 0x38000000u) >> 13);
+    uint32_t rest = abs & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) half++;
+    return static_cast<uint16_t>(sign | half);
+}
+
+inline float halfToFloat(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    uint32_t exp = (value >> 10) & 0x1Fu;
+    uint32_t mant = value & 0x3FFu;
+    uint32_t x;
+    if (exp == 0x1Fu) {
+        x = sign | 0x7F800000u | (mant << 13);
+    } else if (exp != 0) {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    } else if (mant == 0) {
+        x = sign;
+    } else {
+        // subnormal half: normalize
+        exp = 113;
+        while (!(mant & 0x400u)) {
+            mant <<= 1;
+            exp--;
+        }
+        x = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+    }
+    float out;
+    std::memcpy(&out, &x, sizeof(out));
+    return out;
+}
+
+inline void floatsToHalves(const float* in, uint16_t* out, size_t count) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(in + i);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                         _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = floatToHalf(in[i]);
+    }
+}
+
+inline void halvesToFloats(const uint16_t* in, float* out, size_t count) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(v));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = halfToFloat(in[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Hands encoded response frames from the threads that finish them to the
+// HTTP thread streaming them out as chunks, in the order they were pushed.
+// The stream ends once the expected number of frames has been taken.
+// Either a reader pulls with next(), or forwardTo() has frames pushed
+// straight on to a sink.
+class FrameStream {
+public:
+    // gets each burst of frames; last is set on the final call
+    using Sink = std::function<void(std::string chunk, bool last)>;
+
+    explicit FrameStream(size_t expected_frames) : remaining_(expected_frames) {}
+
+    // appends count finished frames, encoded back to back in frames
+    void push(std::string frames, size_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_) return;
+            pending_.append(frames);
+            pending_frames_ += count;
+            if (sink_) {
+                flushToSink();
+                return;
+            }
+        }
+        cv_.notify_one();
+    }
+
+    // Push mode: what has arrived goes to sink now, later frames as they
+    // are pushed. Called under the stream's lock, so sink must only hand the
+    // chunk on (e.g. to an event loop), never call back into the stream.
+    void forwardTo(Sink sink) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) return;
+        sink_ = std::move(sink);
+        if (remaining_ == 0) {
+            sink_(std::string(), true);
+            return;
+        }
+        if (pending_frames_ > 0) {
+            flushToSink();
+        }
+    }
+
+    // Waits for frames and moves everything pushed so far into out, so a
+    // burst of completions goes out as one chunk. False once all expected
+    // frames have been taken, or the reader closed the stream.
+    bool next(std::string& out) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return pending_frames_ > 0 || remaining_ == 0 || closed_; });
+        if (closed_ || (pending_frames_ == 0 && remaining_ == 0)) {
+            return false;
+        }
+        out.swap(pending_);
+        pending_.clear();
+        remaining_ -= pending_frames_ < remaining_ ? pending_frames_ : remaining_;
+        pending_frames_ = 0;
+        return true;
+    }
+
+    // the client went away: later frames are dropped instead of buffered
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            pending_.clear();
+        }
+        cv_.notify_all();
+    }
+
+private:
+    void flushToSink() {
+        std::string chunk;
+        chunk.swap(pending_);
+        remaining_ -= pending_frames_ < remaining_ ? pending_frames_ : remaining_;
+        pending_frames_ = 0;
+        sink_(std::move(chunk), remaining_ == 0);
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string pending_;
+    size_t pending_frames_ = 0;
+    size_t remaining_;
+    bool closed_ = false;
+    Sink sink_;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef HTTP_TEXT_H
+#define HTTP_TEXT_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cctype>
+
+// Header types and parsing helpers shared by EventServer and AsyncHttpClient.
+
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+inline bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// s[begin, end) without surrounding spaces and tabs
+inline std::string trimmed(const std::string& s, size_t begin, size_t end) {
+    while (begin < end && (s[begin] == ' ' || s[begin] == '\t')) ++begin;
+    while (end > begin && (s[end - 1] == ' ' || s[end - 1] == '\t')) --end;
+    return s.substr(begin, end - begin);
+}
+
+#endif
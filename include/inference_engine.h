@@ -5,36 +5,171 @@
 #include <string>
 #include <memory>
 #include <mutex>
+#include <functional>
 #include <onnxruntime_cxx_api.h>
+#include "tensor_view.h"
+#include "batch_packing.h"
+
+enum class ExecutionProvider { TENSORRT, CUDA, OPENVINO, CPU };
+
+// "tensorrt", "cuda", "openvino" or "cpu"; throws std::invalid_argument
+ExecutionProvider parseExecutionProvider(const std::string& name);
+const char* executionProviderName(ExecutionProvider provider);
+
+struct EngineOptions {
+    // sizes the reusable batch input/output buffers
+    size_t max_batch_size = 32;
+    int device_id = 0;  // for the CUDA and TensorRT providers
+    // Tried in order; ones that fail to load (not built into ORT, no device)
+    // are skipped. Without CPU in the list, failing to load every one of
+    // them is an error instead of a fall back to CPU.
+    std::vector<ExecutionProvider> providers = {ExecutionProvider::CUDA, ExecutionProvider::CPU};
+    // 0 = ORT's default (one per physical core), or one per CPU in cpus
+    int intra_op_threads = 4;
+    // > 1 runs independent branches of the graph in parallel
+    int inter_op_threads = 0;
+    // pin the intra-op threads to these CPUs in turn; empty = unpinned.
+    // EnginePool hands each of its sessions its own slice.
+    std::vector<int> cpus;
+    // Run through an IoBinding over preallocated buffers (device-resident when
+    // CUDA is active) instead of letting ORT allocate and copy per Run
+    bool io_binding = true;
+    // pad every batch up to the next of these sizes so ORT only ever sees a
+    // few fixed shapes; empty = run every batch at its own size
+    std::vector<size_t> batch_buckets;
+    // capture one CUDA graph per bucket (needs buckets, CUDA and IoBinding)
+    bool cuda_graphs = false;
+    // ORT's optimized-graph serialization: save_optimized_path makes the
+    // session write the graph it optimized there; load_optimized_path loads
+    // such a graph instead of model_path, with optimization off (model_path
+    // is still what the engine reports)
+    std::string save_optimized_path;
+    std::string load_optimized_path;
+    // EnginePool only: keep the optimized graph of each model file here, so
+    // the rest of the pool, a reload and a restart skip graph optimization;
+    // empty = off
+    std::string optimized_model_dir;
+    // IMAGE_U8 inputs: per-channel mean and std applied after scaling pixels
+    // to [0, 1] (one value for all channels, or empty = 0 and 1); written
+    // planar for NCHW models, or interleaved with image_nhwc
+    std::vector<float> image_mean;
+    std::vector<float> image_std;
+    bool image_nhwc = false;
+};
+
+// Reusable fixed-size float buffers for batch inputs and outputs. Released buffers go
+// back to the pool instead of the allocator; requests larger than the
+// buffer size get a one-off allocation. Buffers must be released before the
+// engine that created the pool is destroyed.
+class HostBufferPool : public std::enable_shared_from_this<HostBufferPool> {
+public:
+    using AllocFn = std::function<float*(size_t count)>;
+    using FreeFn = std::function<void(float*)>;
+
+    HostBufferPool(size_t buffer_floats, AllocFn alloc, FreeFn free);
+    ~HostBufferPool();
+    std::shared_ptr<float> acquire(size_t count);
+    size_t bufferFloats() const { return buffer_floats_; }
+
+private:
+    size_t buffer_floats_;
+    AllocFn alloc_;
+    FreeFn free_;
+    std::mutex mutex_;
+    std::vector<float*> idle_;
+};
+
+// flattened, zero-padded batch ready for a single Run
+struct PackedInput {
+    std::shared_ptr<float> data;  // pooled, pinned when CUDA is active
+    size_t size = 0;              // floats in use
+    size_t batch_size = 0;        // rows run, including padding
+    size_t num_samples = 0;       // real rows; results are returned for these only
+    int bucket = -1;              // index into the engine's buckets, -1 = none
+};
 
 class InferenceEngine {
 public:
-    explicit InferenceEngine(const std::string& model_path, int shard_id = 0);
+    explicit InferenceEngine(const std::string& model_path, int shard_id = 0,
+                             const EngineOptions& options = EngineOptions());
     ~InferenceEngine();
     std::vector<float> predict(const std::vector<float>& input);
     std::vector<std::vector<float>> batchPredict(
         const std::vector<std::vector<float>>& inputs
     );
+    // batchPredict in two steps, so packing can happen off the Run thread.
+    // Each input is converted exactly once, straight into its slot of a
+    // pooled buffer: float16 widened, images normalized and laid out, all
+    // narrowed to float16 for a model that takes it.
+    PackedInput packBatch(const std::vector<InputSpan>& inputs) const;
+    // one view per sample, all sharing the single output tensor of the Run
+    std::vector<TensorView> runBatch(PackedInput& input);
     const std::string& getModelPath() const { return model_path_; }
     int getShardId() const { return shard_id_; }
     std::vector<int64_t> getInputShape() const;
     std::vector<int64_t> getOutputShape() const;
-    
+    size_t getInputSampleSize() const { return input_sample_size_; }
+    const std::vector<size_t>& getBatchBuckets() const { return options_.batch_buckets; }
+    bool isCudaGraphEnabled() const { return cuda_graphs_enabled_; }
+    // Runs zero batches at every bucket size (powers of two up to
+    // max_batch_size without buckets), so arena growth, kernel selection and
+    // graph capture happen now rather than on the first real requests
+    void warmup();
+    bool isCudaEnabled() const { return cuda_enabled_; }
+    // the model's input or output is float16; callers still see floats
+    bool isFloat16Model() const { return input_fp16_ || output_fp16_; }
+
+    // one Env per process, shared by every session
+    static std::shared_ptr<Ort::Env> sharedEnv();
+
 private:
     void initializeSession();
-    
+    void appendProvider(ExecutionProvider provider);
+    // ours for the CUDA and TensorRT providers to compute on, created on
+    // first use; null without CUDA or IoBinding
+    void* userComputeStream();
+    void initializeBuffers();
+    std::vector<TensorView> runBound(PackedInput& input);
+    size_t inputElementSize() const { return input_fp16_ ? sizeof(uint16_t) : sizeof(float); }
+    size_t outputElementSize() const { return output_fp16_ ? sizeof(uint16_t) : sizeof(float); }
+    ONNXTensorElementDataType inputElementType() const {
+        return input_fp16_ ? ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 : ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    }
+    ONNXTensorElementDataType outputElementType() const {
+        return output_fp16_ ? ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 : ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    }
+
     std::string model_path_;
     int shard_id_;
-    std::unique_ptr<Ort::Env> env_;
+    EngineOptions options_;
+    bool cuda_enabled_ = false;
+    bool cuda_graphs_enabled_ = false;
+    std::shared_ptr<Ort::Env> env_;
     std::unique_ptr<Ort::Session> session_;
     std::unique_ptr<Ort::SessionOptions> session_options_;
+    std::unique_ptr<Ort::Allocator> pinned_allocator_;
+    std::shared_ptr<HostBufferPool> input_buffers_;
+    std::shared_ptr<HostBufferPool> output_buffers_;
+    // IoBinding path; the device buffers hold max_batch_size samples and every
+    // batch size binds a prefix of them
+    bool use_io_binding_ = false;
+    std::unique_ptr<Ort::IoBinding> io_binding_;
+    void* cuda_stream_ = nullptr;  // cudaStream_t, shared with the CUDA EP
+    float* device_input_ = nullptr;
+    float* device_output_ = nullptr;
     std::vector<std::string> input_name_strings_;
     std::vector<std::string> output_name_strings_;
     std::vector<const char*> input_names_;
     std::vector<const char*> output_names_;
     std::vector<int64_t> input_shape_;
     std::vector<int64_t> output_shape_;
+    size_t input_sample_size_ = 0;
+    size_t output_sample_size_ = 0;
+    bool output_shape_dynamic_ = false;  // non-batch output dims unknown until Run
+    bool input_fp16_ = false;
+    bool output_fp16_ = false;
+    ImageTransform image_transform_;
     std::mutex mutex_;
 };
 
-#endif
\ No newline at end of file
+#endif
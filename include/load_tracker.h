@@ -0,0 +1,137 @@
+#ifndef LOAD_TRACKER_H
+#define LOAD_TRACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+// Approximate latency quantiles over recent requests, lock-free. Samples go
+// into log-spaced buckets (4 per power of two, so a quantile is within 25%);
+// every kDecayEvery samples all counts are halved, so old samples fade out.
+class LatencyQuantiles {
+public:
+    void record(int64_t us) {
+        buckets_[bucketFor(us)].fetch_add(1, std::memory_order_relaxed);
+        if (samples_.fetch_add(1, std::memory_order_relaxed) % kDecayEvery == kDecayEvery - 1) {
+            // racing records may land between the halvings; fine for an estimate
+            for (auto& bucket : buckets_) {
+                bucket.store(bucket.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // upper edge of the bucket holding quantile q (0..1), or -1 while there
+    // are too few samples to say
+    int64_t quantileUs(double q) const {
+        int64_t counts[kBuckets];
+        int64_t total = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            counts[i] = buckets_[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total < kMinSamples) {
+            return -1;
+        }
+        int64_t rank = static_cast<int64_t>(q * total);
+        int64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts[i];
+            if (seen > rank) {
+                return upperEdge(i);
+            }
+        }
+        return upperEdge(kBuckets - 1);
+    }
+
+private:
+    static constexpr size_t kBuckets = 64 * 4;
+    static constexpr int64_t kDecayEvery = 1024;
+    static constexpr int64_t kMinSamples = 32;
+
+    static size_t bucketFor(int64_t us) {
+        if (us < 1) return 0;
+        int log2 = 63 - __builtin_clzll(static_cast<uint64_t>(us));
+        size_t sub = log2 >= 2 ? (us >> (log2 - 2)) & 3 : 0;
+        return std::min(kBuckets - 1, static_cast<size_t>(log2) * 4 + sub);
+    }
+
+    static int64_t upperEdge(size_t bucket) {
+        int log2 = static_cast<int>(bucket / 4);
+        int64_t sub = bucket % 4;
+        if (log2 < 2) return int64_t(1) << (log2 + 1);
+        return (5 + sub) << (log2 - 2);
+    }
+
+    std::atomic<int64_t> buckets_[kBuckets] = {};
+    std::atomic<int64_t> samples_{0};
+};
+
+// Live load of one worker as seen by the gateway: requests currently in
+// flight to it, an EWMA of its response latency and, from its last health
+// check, what the worker itself has in flight from every client. Updated
+// lock-free from every request thread.
+class NodeLoad {
+public:
+    // counts a request in flight for its lifetime and records its latency
+    class Scope {
+    public:
+        explicit Scope(NodeLoad& load)
+            : load_(load), start_(std::chrono::steady_clock::now()) {
+            load_.in_flight_.fetch_add(1, std::memory_order_relaxed);
+        }
+        ~Scope() {
+            if (record_) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_);
+                load_.recordLatency(elapsed);
+            }
+            load_.in_flight_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        // the reply says nothing about how fast the node serves (e.g. it
+        // rejected the request outright), so keep it out of the EWMA
+        void skipLatency() { record_ = false; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        NodeLoad& load_;
+        std::chrono::steady_clock::time_point start_;
+        bool record_ = true;
+    };
+
+    int64_t inFlight() const { return in_flight_.load(std::memory_order_relaxed); }
+    int64_t reportedInFlight() const { return reported_.load(std::memory_order_relaxed); }
+    void setReportedInFlight(int64_t requests) { reported_.store(requests, std::memory_order_relaxed); }
+    // ours, or the worker's own count when other clients load it more; the
+    // report is up to a health interval old, ours is live
+    int64_t backlog() const { return std::max(inFlight(), reportedInFlight()); }
+    double ewmaLatencyUs() const { return ewma_us_.load(std::memory_order_relaxed); }
+    int64_t latencyQuantileUs(double q) const { return quantiles_.quantileUs(q); }
+
+    // expected time until one more request would complete; unmeasured
+    // nodes count as 1us per request so backlogs still order them
+    double cost() const {
+        double latency = ewmaLatencyUs();
+        return (backlog() + 1) * (latency > 0.0 ? latency : 1.0);
+    }
+
+    void recordLatency(std::chrono::microseconds latency) {
+        double sample = static_cast<double>(latency.count());
+        double current = ewma_us_.load(std::memory_order_relaxed);
+        double next;
+        do {
+            next = current == 0.0 ? sample : kAlpha * sample + (1 - kAlpha) * current;
+        } while (!ewma_us_.compare_exchange_weak(current, next, std::memory_order_relaxed));
+        quantiles_.record(latency.count());
+    }
+
+private:
+    static constexpr double kAlpha = 0.2;
+
+    alignas(64) std::atomic<int64_t> in_flight_{0};
+    std::atomic<double> ewma_us_{0.0};
+    std::atomic<int64_t> reported_{0};
+    LatencyQuantiles quantiles_;
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include <vector>
 #include <functional>
 #include <atomic>
+#include "content_hash.h"
 
 template<typename Key, typename Value, typename Hash = std::hash<Key>>
 class LRUCache {
@@ -80,18 +81,11 @@ private:
     std::atomic<size_t> misses_;
 };
 
-// hash for vector<float> to use as cache key
+// hash for vector<float> to use as cache key; hashes every element, so
+// inputs that differ anywhere land in different buckets
 struct VectorHash {
     size_t operator()(const std::vector<float>& vec) const {
-        size_t hash = 0;
-        std::hash<float> hasher;
-        if (!vec.empty()) {
-            hash ^= hasher(vec[0]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-            hash ^= hasher(vec[vec.size()/2]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-            hash ^= hasher(vec.back()) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-        }
-        
-        return hash;
+        return static_cast<size_t>(digestFloats(vec.data(), vec.size()).lo);
     }
 };
 
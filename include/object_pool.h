@@ -0,0 +1,89 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Up to max_size objects created on demand and reused. acquire() hands out
+// an idle object, creates one while under the limit, and otherwise waits for
+// one to be returned. Objects are returned when their lease is destroyed.
+template<typename T>
+class ObjectPool {
+public:
+    using Factory = std::function<std::unique_ptr<T>()>;
+
+    class Lease {
+    public:
+        Lease(ObjectPool& pool, std::unique_ptr<T> object)
+            : pool_(&pool), object_(std::move(object)) {}
+        Lease(Lease&& other) noexcept = default;
+        Lease& operator=(Lease&&) = delete;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() {
+            if (object_) {
+                pool_->release(std::move(object_));
+            }
+        }
+        T* operator->() const { return object_.get(); }
+        T& operator*() const { return *object_; }
+    private:
+        ObjectPool* pool_;
+        std::unique_ptr<T> object_;
+    };
+
+    ObjectPool(size_t max_size, Factory factory)
+        : max_size_(max_size > 0 ? max_size : 1), factory_(std::move(factory)) {}
+
+    Lease acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        available_cv_.wait(lock, [this] { return !idle_.empty() || created_ < max_size_; });
+        if (!idle_.empty()) {
+            std::unique_ptr<T> object = std::move(idle_.back());
+            idle_.pop_back();
+            return Lease(*this, std::move(object));
+        }
+        created_++;
+        lock.unlock();
+        try {
+            return Lease(*this, factory_());
+        } catch (...) {
+            lock.lock();
+            created_--;
+            lock.unlock();
+            available_cv_.notify_one();
+            throw;
+        }
+    }
+
+    size_t created() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return created_;
+    }
+    size_t idle() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return idle_.size();
+    }
+    size_t maxSize() const { return max_size_; }
+
+private:
+    void release(std::unique_ptr<T> object) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_.push_back(std::move(object));
+        }
+        available_cv_.notify_one();
+    }
+
+    size_t max_size_;
+    Factory factory_;
+    std::vector<std::unique_ptr<T>> idle_;
+    size_t created_ = 0;
+    mutable std::mutex mutex_;
+    std::condition_variable available_cv_;
+};
+
+#endif
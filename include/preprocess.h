@@ -0,0 +1,162 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// uint8 images to float model input in one pass: each pixel value is
+// scaled to [0, 1], has the channel mean subtracted and is divided by the
+// channel std, and the interleaved (HWC) pixels are written planar (CHW) for
+// NCHW models or kept interleaved for NHWC ones. Uses AVX2 when the build
+// targets it, otherwise plain loops.
+
+class ImageTransform {
+public:
+    // mean and std hold one value per channel, or one for all; empty = 0 and 1.
+    // Throws std::invalid_argument if their sizes fit neither.
+    explicit ImageTransform(size_t channels = 3, bool planar = true,
+                            const std::vector<float>& mean = {}, const std::vector<float>& std = {})
+        : channels_(channels), planar_(planar) {
+        if (channels == 0) {
+            throw std::invalid_argument("Image needs at least one channel");
+        }
+        auto perChannel = [channels](const std::vector<float>& values, float fallback, const char* what) {
+            if (values.empty()) return std::vector<float>(channels, fallback);
+            if (values.size() == 1) return std::vector<float>(channels, values[0]);
+            if (values.size() != channels) {
+                throw std::invalid_argument(std::string("Image ") + what + " needs 1 or " +
+                                            std::to_string(channels) + " values");
+            }
+            return values;
+        };
+        std::vector<float> means = perChannel(mean, 0.0f, "mean");
+        std::vector<float> stds = perChannel(std, 1.0f, "std");
+        // (v / 255 - mean) / std as one multiply-add
+        for (size_t c = 0; c < channels; ++c) {
+            scale_.push_back(1.0f / (255.0f * stds[c]));
+            offset_.push_back(-means[c] / stds[c]);
+        }
+        // the channel of element i of 8 interleaved pixels is i % channels
+        for (size_t i = 0; i < 8 * channels; ++i) {
+            scale_pattern_.push_back(scale_[i % channels]);
+            offset_pattern_.push_back(offset_[i % channels]);
+        }
+    }
+
+    size_t channels() const { return channels_; }
+    bool planar() const { return planar_; }
+
+    // Converts pixel_count interleaved pixels. Planar output puts channel c
+    // at out + c * plane_size; interleaved output is pixel_count * channels
+    // floats and ignores plane_size.
+    void apply(const uint8_t* pixels, size_t pixel_count, size_t plane_size, float* out) const {
+        if (planar_) {
+            applyPlanar(pixels, pixel_count, plane_size, out);
+        } else {
+            applyInterleaved(pixels, pixel_count * channels_, out);
+        }
+    }
+
+private:
+    void applyPlanar(const uint8_t* pixels, size_t pixel_count, size_t plane_size, float* out) const {
+        size_t i = 0;
+#if defined(__AVX2__)
+        if (channels_ == 3) {
+            i = planarRgb(pixels, pixel_count, plane_size, out);
+        }
+#endif
+        for (; i < pixel_count; ++i) {
+            for (size_t c = 0; c < channels_; ++c) {
+                out[c * plane_size + i] = pixels[i * channels_ + c] * scale_[c] + offset_[c];
+            }
+        }
+    }
+
+    void applyInterleaved(const uint8_t* values, size_t count, float* out) const {
+        size_t i = 0;
+#if defined(__AVX2__)
+        // blocks of 8 pixels start on a pixel, so one fixed pattern of
+        // per-lane scales serves every block
+        size_t block = 8 * channels_;
+        for (; i + block <= count; i += block) {
+            for (size_t k = 0; k < channels_; ++k) {
+                __m256 v = widen8(values + i + 8 * k);
+                __m256 scale = _mm256_loadu_ps(scale_pattern_.data() + 8 * k);
+                __m256 offset = _mm256_loadu_ps(offset_pattern_.data() + 8 * k);
+                _mm256_storeu_ps(out + i + 8 * k, multiplyAdd(v, scale, offset));
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            size_t c = i % channels_;
+            out[i] = values[i] * scale_[c] + offset_[c];
+        }
+    }
+
+#if defined(__AVX2__)
+    static __m256 widen8(const uint8_t* in) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+        return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    }
+
+    static __m256 multiplyAdd(__m256 v, __m256 scale, __m256 offset) {
+#if defined(__FMA__)
+        return _mm256_fmadd_ps(v, scale, offset);
+#else
+        return _mm256_add_ps(_mm256_mul_ps(v, scale), offset);
+#endif
+    }
+
+    // 16 RGB pixels at a time: three byte shuffles per channel pull its 16
+    // values out of the 48 interleaved bytes, which are then widened to
+    // floats and stored contiguously in the channel's plane. Returns the
+    // pixels done; the caller finishes the rest.
+    size_t planarRgb(const uint8_t* pixels, size_t pixel_count, size_t plane_size, float* out) const {
+        // masks[c][chunk]: where channel c's bytes sit in 16-byte chunk of the 48
+        __m128i masks[3][3];
+        for (int c = 0; c < 3; ++c) {
+            for (int chunk = 0; chunk < 3; ++chunk) {
+                alignas(16) int8_t lanes[16];
+                for (int i = 0; i < 16; ++i) {
+                    int position = 3 * i + c;
+                    lanes[i] = position / 16 == chunk ? static_cast<int8_t>(position % 16) : int8_t(-128);
+                }
+                masks[c][chunk] = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes));
+            }
+        }
+        size_t i = 0;
+        for (; i + 16 <= pixel_count; i += 16) {
+            const __m128i* in = reinterpret_cast<const __m128i*>(pixels + 3 * i);
+            __m128i chunks[3] = {_mm_loadu_si128(in), _mm_loadu_si128(in + 1), _mm_loadu_si128(in + 2)};
+            for (int c = 0; c < 3; ++c) {
+                __m128i channel = _mm_or_si128(
+                    _mm_or_si128(_mm_shuffle_epi8(chunks[0], masks[c][0]), _mm_shuffle_epi8(chunks[1], masks[c][1])),
+                    _mm_shuffle_epi8(chunks[2], masks[c][2]));
+                __m256 scale = _mm256_set1_ps(scale_[c]);
+                __m256 offset = _mm256_set1_ps(offset_[c]);
+                __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(channel));
+                __m256 high = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(channel, 8)));
+                float* plane = out + c * plane_size + i;
+                _mm256_storeu_ps(plane, multiplyAdd(low, scale, offset));
+                _mm256_storeu_ps(plane + 8, multiplyAdd(high, scale, offset));
+            }
+        }
+        return i;
+    }
+#endif
+
+    size_t channels_;
+    bool planar_;
+    std::vector<float> scale_;
+    std::vector<float> offset_;
+    // scale_ and offset_ repeated over 8 pixels' worth of interleaved values
+    std::vector<float> scale_pattern_;
+    std::vector<float> offset_pattern_;
+};
+
+#endif
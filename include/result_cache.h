@@ -0,0 +1,42 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "sharded_cache.h"
+#include "tensor_view.h"
+#include <optional>
+#include <string>
+
+// What the worker needs from its result cache, so the entry-count cache and
+// the byte-budgeted slab cache are interchangeable.
+class ResultCache {
+public:
+    virtual ~ResultCache() = default;
+    virtual std::optional<TensorView> get(const ContentDigest& key) = 0;
+    virtual void put(const ContentDigest& key, const TensorView& value) = 0;
+    virtual size_t size() const = 0;
+    virtual double getHitRate() const = 0;
+    // bytes held by cached values and their bookkeeping, 0 if not tracked
+    virtual size_t bytesUsed() const { return 0; }
+    virtual size_t capacityBytes() const { return 0; }
+    virtual std::string describe() const = 0;
+};
+
+// Entry-count LRU over shards; values share the batch output buffers, so an
+// entry pins its whole batch output until evicted.
+class ShardedResultCache : public ResultCache {
+public:
+    ShardedResultCache(size_t capacity, size_t num_shards) : cache_(capacity, num_shards) {}
+
+    std::optional<TensorView> get(const ContentDigest& key) override { return cache_.get(key); }
+    void put(const ContentDigest& key, const TensorView& value) override { cache_.put(key, value); }
+    size_t size() const override { return cache_.size(); }
+    double getHitRate() const override { return cache_.getHitRate(); }
+    std::string describe() const override {
+        return std::to_string(cache_.capacity()) + " entries";
+    }
+
+private:
+    ShardedCache<TensorView> cache_;
+};
+
+#endif
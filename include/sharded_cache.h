@@ -0,0 +1,91 @@
+#ifndef SHARDED_CACHE_H
+#define SHARDED_CACHE_H
+
+#include "lru_cache.h"
+#include "content_hash.h"
+#include <vector>
+#include <memory>
+#include <optional>
+
+// LRUCache split into independently locked shards keyed by content digest.
+// A request only locks the shard its digest falls in, so lookups and
+// inserts for different inputs do not contend, and the digest is computed
+// once per request by the caller rather than on every probe.
+template<typename Value>
+class ShardedCache {
+public:
+    // capacity is the total over all shards; num_shards is rounded up to a
+    // power of two
+    explicit ShardedCache(size_t capacity, size_t num_shards = 16) {
+        size_t shards = 1;
+        while (shards < num_shards) {
+            shards <<= 1;
+        }
+        mask_ = shards - 1;
+        size_t per_shard = (capacity + shards - 1) / shards;
+        shards_.reserve(shards);
+        for (size_t i = 0; i < shards; ++i) {
+            shards_.push_back(std::make_unique<Shard>(per_shard));
+        }
+    }
+
+    std::optional<Value> get(const ContentDigest& key) {
+        return shardFor(key).get(key);
+    }
+    void put(const ContentDigest& key, const Value& value) {
+        shardFor(key).put(key, value);
+    }
+
+    void clear() {
+        for (auto& shard : shards_) {
+            shard->cache.clear();
+        }
+    }
+
+    // stats; sizes take each shard lock briefly, hit counters are atomics
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard->cache.size();
+        }
+        return total;
+    }
+    size_t capacity() const { return shards_.front()->cache.capacity() * shards_.size(); }
+    size_t shardCount() const { return shards_.size(); }
+    size_t getHits() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard->cache.getHits();
+        }
+        return total;
+    }
+    size_t getMisses() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard->cache.getMisses();
+        }
+        return total;
+    }
+    double getHitRate() const {
+        size_t hits = getHits();
+        size_t total = hits + getMisses();
+        return total > 0 ? (double)hits / total : 0.0;
+    }
+
+private:
+    // own cache line per shard so neighbouring locks do not false-share
+    struct alignas(64) Shard {
+        explicit Shard(size_t capacity) : cache(capacity) {}
+        LRUCache<ContentDigest, Value, DigestHash> cache;
+    };
+
+    // the table inside a shard hashes on lo, so pick the shard from hi
+    LRUCache<ContentDigest, Value, DigestHash>& shardFor(const ContentDigest& key) {
+        return shards_[key.hi & mask_]->cache;
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t mask_;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <unordered_map>
+#include <vector>
+#include <optional>
+#include <mutex>
+#include <functional>
+#include <tuple>
+#include "completion.h"
+
+// Collapses concurrent calls for the same key into one. The first caller
+// runs the computation; callers arriving while it is in flight get its
+// result (or exception) instead of computing it again. A computation can
+// carry Terms (e.g. the deadline it was started under), and a caller only
+// joins one whose terms suit it.
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename Terms = std::tuple<>>
+class SingleFlight {
+public:
+    // gets the result, or the error that failed the computation
+    using Callback = std::function<void(const Value* value, std::exception_ptr error)>;
+    // handed to the computation; call it exactly once, from any thread
+    using Finish = std::function<void(const Value* value, std::exception_ptr error)>;
+
+    // Asynchronous form: done runs once the key's computation finishes. If
+    // none is in flight, start(finish) is called to begin one, outside the
+    // lock. Returns true when done joined a computation already in flight.
+    template<typename Start>
+    bool join(const Key& key, Callback done, Start&& start) {
+        return join(key, Terms(), [](const Terms&) { return true; }, std::move(done), std::forward<Start>(start));
+    }
+
+    // As above, but done joins the computation in flight only if
+    // suits(its terms); if not, start runs a computation of done's own that
+    // nobody else joins. A new computation is started under terms.
+    template<typename Suits, typename Start>
+    bool join(const Key& key, const Terms& terms, Suits&& suits, Callback done, Start&& start) {
+        bool shared = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = in_flight_.find(key);
+            if (it == in_flight_.end()) {
+                in_flight_.emplace(key, Flight{terms, {std::move(done)}});
+                shared = false;
+            } else if (suits(static_cast<const Terms&>(it->second.terms))) {
+                it->second.waiting.push_back(std::move(done));
+                return true;
+            }
+        }
+        if (shared) {
+            // the one in flight does not suit; compute alone
+            try {
+                start(Finish(done));
+            } catch (...) {
+                done(nullptr, std::current_exception());
+            }
+            return false;
+        }
+        Finish finish = [this, key](const Value* value, std::exception_ptr error) {
+            complete(key, value, error);
+        };
+        try {
+            start(std::move(finish));
+        } catch (...) {
+            complete(key, nullptr, std::current_exception());
+        }
+        return false;
+    }
+
+    // Blocking form; shared is set when the result came from another
+    // caller's computation
+    template<typename Fn>
+    Value run(const Key& key, Fn&& compute, bool& shared) {
+        std::optional<Value> result;
+        CountdownLatch latch(1);
+        shared = join(key, [&result, &latch](const Value* value, std::exception_ptr error) {
+            if (value) {
+                result.emplace(*value);
+            }
+            latch.countDown(value ? nullptr : error);
+        }, [&compute](Finish finish) {
+            Value value = compute();
+            finish(&value, nullptr);
+        });
+        latch.wait();
+        return std::move(*result);
+    }
+
+    size_t inFlight() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_flight_.size();
+    }
+
+private:
+    void complete(const Key& key, const Value* value, std::exception_ptr error) {
+        std::vector<Callback> waiting;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = in_flight_.find(key);
+            if (it == in_flight_.end()) return;
+            waiting = std::move(it->second.waiting);
+            in_flight_.erase(it);
+        }
+        for (auto& done : waiting) {
+            try {
+                done(value, error);
+            } catch (...) {
+                // one waiter failing to take the result must not starve the rest
+            }
+        }
+    }
+
+    struct Flight {
+        Terms terms;  // what the computation was started under
+        std::vector<Callback> waiting;  // everyone waiting on it
+    };
+
+    std::unordered_map<Key, Flight, Hash> in_flight_;
+    mutable std::mutex mutex_;
+};
+
+#endif
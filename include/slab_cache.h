@@ -0,0 +1,273 @@
+#ifndef SLAB_CACHE_H
+#define SLAB_CACHE_H
+
+#include "result_cache.h"
+#include "fp16.h"
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+enum class CacheValueType {
+    FLOAT32,
+    FLOAT16,
+    INT8    // symmetric, one scale per entry
+};
+
+inline const char* cacheValueTypeName(CacheValueType type) {
+    switch (type) {
+        case CacheValueType::FLOAT16: return "f16";
+        case CacheValueType::INT8: return "int8";
+        default: return "f32";
+    }
+}
+
+inline size_t cacheValueTypeSize(CacheValueType type) {
+    switch (type) {
+        case CacheValueType::FLOAT16: return 2;
+        case CacheValueType::INT8: return 1;
+        default: return 4;
+    }
+}
+
+// Result cache sized in bytes. Keys are digests only; values are packed
+// into one preallocated arena of fixed-size blocks per shard, optionally as
+// fp16 or int8, and the LRU list is threaded through an index array instead
+// of separately allocated list nodes. Each shard sizes its blocks from the
+// first value it sees (all outputs of a model have the same size); larger
+// values are not cached. Hits are decoded into a fresh buffer, since a block
+// can be reused as soon as it is evicted.
+class SlabCache : public ResultCache {
+public:
+    SlabCache(size_t byte_budget, CacheValueType type, size_t num_shards = 16)
+        : byte_budget_(byte_budget), type_(type) {
+        size_t shards = 1;
+        while (shards < num_shards) {
+            shards <<= 1;
+        }
+        mask_ = shards - 1;
+        shards_.reserve(shards);
+        for (size_t i = 0; i < shards; ++i) {
+            shards_.push_back(std::make_unique<Shard>(byte_budget / shards, type));
+        }
+    }
+
+    std::optional<TensorView> get(const ContentDigest& key) override {
+        return shardFor(key).get(key);
+    }
+    void put(const ContentDigest& key, const TensorView& value) override {
+        shardFor(key).put(key, value);
+    }
+    size_t size() const override {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard->size();
+        }
+        return total;
+    }
+    double getHitRate() const override {
+        size_t hits = 0;
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            size_t shard_hits = shard->hits.load(std::memory_order_relaxed);
+            hits += shard_hits;
+            total += shard_hits + shard->misses.load(std::memory_order_relaxed);
+        }
+        return total > 0 ? (double)hits / total : 0.0;
+    }
+    size_t bytesUsed() const override {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard->bytesUsed();
+        }
+        return total;
+    }
+    size_t capacityBytes() const override { return byte_budget_; }
+    std::string describe() const override {
+        return std::to_string(byte_budget_ >> 20) + " MB of " + cacheValueTypeName(type_) + " values";
+    }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Entry {
+        ContentDigest key;
+        uint32_t prev = kNone;
+        uint32_t next = kNone;
+        uint32_t length = 0;   // floats stored
+        float scale = 1.0f;    // int8 only
+    };
+
+    class alignas(64) Shard {
+    public:
+        Shard(size_t byte_budget, CacheValueType type) : byte_budget_(byte_budget), type_(type) {}
+
+        std::optional<TensorView> get(const ContentDigest& key) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(key);
+            if (it == index_.end()) {
+                misses.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            hits.fetch_add(1, std::memory_order_relaxed);
+            uint32_t slot = it->second;
+            unlink(slot);
+            pushFront(slot);
+            const Entry& entry = entries_[slot];
+            std::vector<float> values(entry.length);
+            decode(slot, entry, values.data());
+            return TensorView::fromVector(std::move(values));
+        }
+
+        void put(const ContentDigest& key, const TensorView& value) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!arena_) {
+                allocate(value.size);
+            }
+            if (value.size > block_floats_ || entries_.empty()) {
+                return;
+            }
+            uint32_t slot;
+            auto it = index_.find(key);
+            if (it != index_.end()) {
+                slot = it->second;
+                unlink(slot);
+            } else if (!free_.empty()) {
+                slot = free_.back();
+                free_.pop_back();
+                index_.emplace(key, slot);
+            } else {
+                // reuse the least recently used block
+                slot = tail_;
+                unlink(slot);
+                index_.erase(entries_[slot].key);
+                index_.emplace(key, slot);
+            }
+            Entry& entry = entries_[slot];
+            entry.key = key;
+            entry.length = static_cast<uint32_t>(value.size);
+            encode(slot, entry, value.begin());
+            pushFront(slot);
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return index_.size();
+        }
+
+        size_t bytesUsed() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return index_.size() * entryBytes();
+        }
+
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+
+    private:
+        // hash table node + index entry + value block
+        size_t entryBytes() const {
+            return block_bytes_ + sizeof(Entry) + kIndexOverhead;
+        }
+
+        void allocate(size_t floats) {
+            block_floats_ = std::max<size_t>(floats, 1);
+            block_bytes_ = (block_floats_ * cacheValueTypeSize(type_) + 7) & ~size_t(7);
+            size_t blocks = byte_budget_ / entryBytes();
+            blocks = std::min<size_t>(blocks, kNone - 1);
+            arena_ = std::make_unique<uint8_t[]>(std::max<size_t>(blocks, 1) * block_bytes_);
+            entries_.resize(blocks);
+            free_.reserve(blocks);
+            for (size_t i = blocks; i > 0; --i) {
+                free_.push_back(static_cast<uint32_t>(i - 1));
+            }
+            index_.reserve(blocks);
+        }
+
+        uint8_t* block(uint32_t slot) { return arena_.get() + size_t(slot) * block_bytes_; }
+
+        void encode(uint32_t slot, Entry& entry, const float* values) {
+            uint8_t* out = block(slot);
+            switch (type_) {
+                case CacheValueType::FLOAT16:
+                    floatsToHalves(values, reinterpret_cast<uint16_t*>(out), entry.length);
+                    break;
+                case CacheValueType::INT8: {
+                    float max_abs = 0.0f;
+                    for (uint32_t i = 0; i < entry.length; ++i) {
+                        max_abs = std::max(max_abs, std::fabs(values[i]));
+                    }
+                    entry.scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+                    float inv = 1.0f / entry.scale;
+                    int8_t* q = reinterpret_cast<int8_t*>(out);
+                    for (uint32_t i = 0; i < entry.length; ++i) {
+                        q[i] = static_cast<int8_t>(std::lrint(values[i] * inv));
+                    }
+                    break;
+                }
+                default:
+                    std::memcpy(out, values, entry.length * sizeof(float));
+            }
+        }
+
+        void decode(uint32_t slot, const Entry& entry, float* values) {
+            const uint8_t* in = block(slot);
+            switch (type_) {
+                case CacheValueType::FLOAT16:
+                    halvesToFloats(reinterpret_cast<const uint16_t*>(in), values, entry.length);
+                    break;
+                case CacheValueType::INT8: {
+                    const int8_t* q = reinterpret_cast<const int8_t*>(in);
+                    for (uint32_t i = 0; i < entry.length; ++i) {
+                        values[i] = q[i] * entry.scale;
+                    }
+                    break;
+                }
+                default:
+                    std::memcpy(values, in, entry.length * sizeof(float));
+            }
+        }
+
+        void unlink(uint32_t slot) {
+            Entry& entry = entries_[slot];
+            if (entry.prev != kNone) entries_[entry.prev].next = entry.next; else head_ = entry.next;
+            if (entry.next != kNone) entries_[entry.next].prev = entry.prev; else tail_ = entry.prev;
+            entry.prev = entry.next = kNone;
+        }
+
+        void pushFront(uint32_t slot) {
+            Entry& entry = entries_[slot];
+            entry.prev = kNone;
+            entry.next = head_;
+            if (head_ != kNone) entries_[head_].prev = slot; else tail_ = slot;
+            head_ = slot;
+        }
+
+        static constexpr size_t kIndexOverhead = 48;  // approx. unordered_map node
+
+        size_t byte_budget_;
+        CacheValueType type_;
+        size_t block_floats_ = 0;
+        size_t block_bytes_ = 0;
+        std::unique_ptr<uint8_t[]> arena_;
+        std::vector<Entry> entries_;
+        std::vector<uint32_t> free_;
+        std::unordered_map<ContentDigest, uint32_t, DigestHash> index_;
+        uint32_t head_ = kNone;  // most recently used
+        uint32_t tail_ = kNone;
+        mutable std::mutex mutex_;
+    };
+
+    Shard& shardFor(const ContentDigest& key) { return *shards_[key.hi & mask_]; }
+
+    size_t byte_budget_;
+    CacheValueType type_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t mask_;
+};
+
+#endif
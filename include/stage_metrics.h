@@ -0,0 +1,211 @@
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Cumulative latency histogram, HDR-style: exact below 16us, then 16
+// linear sub-buckets per power of two, so any quantile is within ~6% of
+// the true value up to ~12 days. Each recording thread writes to its own
+// cache-line-aligned shard with relaxed atomics, so recording never takes a
+// lock or bounces a line between cores; readers sum the shards.
+class LatencyHistogram {
+public:
+    struct Snapshot {
+        std::vector<uint64_t> counts;
+        uint64_t count = 0;
+        uint64_t sum_us = 0;
+
+        // midpoint of the bucket holding quantile q (0..1), 0 when empty
+        double quantileUs(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(q * (count - 1));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); ++i) {
+                seen += counts[i];
+                if (seen > rank) {
+                    return (lowerEdge(i) + upperEdge(i)) / 2.0;
+                }
+            }
+            return static_cast<double>(lowerEdge(counts.size() - 1));
+        }
+    };
+
+    LatencyHistogram() : shards_(new Shard[kShards]) {}
+
+    void record(int64_t us) {
+        Shard& shard = shards_[threadSlot() & (kShards - 1)];
+        uint64_t value = us > 0 ? static_cast<uint64_t>(us) : 0;
+        shard.counts[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        shard.sum_us.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    template<typename Duration>
+    void record(Duration duration) {
+        record(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    }
+
+    Snapshot snapshot() const {
+        Snapshot snap;
+        snap.counts.assign(kBuckets, 0);
+        for (size_t s = 0; s < kShards; ++s) {
+            const Shard& shard = shards_[s];
+            for (size_t i = 0; i < kBuckets; ++i) {
+                snap.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+            }
+            snap.count += shard.count.load(std::memory_order_relaxed);
+            snap.sum_us += shard.sum_us.load(std::memory_order_relaxed);
+        }
+        return snap;
+    }
+
+private:
+    static constexpr size_t kSubBits = 4;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBits;
+    static constexpr size_t kBuckets = 41 * kSubBuckets;  // up to 2^44us
+    static constexpr size_t kShards = 16;
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[kBuckets] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_us{0};
+    };
+
+    // threads take slots in turn; with more threads than shards a few share
+    static size_t threadSlot() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+        return slot;
+    }
+
+    static size_t bucketFor(uint64_t us) {
+        if (us < kSubBuckets) return static_cast<size_t>(us);
+        int msb = 63 - __builtin_clzll(us);
+        size_t shift = static_cast<size_t>(msb) - kSubBits;
+        size_t bucket = (shift + 1) * kSubBuckets + static_cast<size_t>((us >> shift) - kSubBuckets);
+        return bucket < kBuckets ? bucket : kBuckets - 1;
+    }
+
+    static uint64_t lowerEdge(size_t bucket) {
+        if (bucket < kSubBuckets) return bucket;
+        size_t shift = bucket / kSubBuckets - 1;
+        return static_cast<uint64_t>(bucket % kSubBuckets + kSubBuckets) << shift;
+    }
+
+    static uint64_t upperEdge(size_t bucket) {
+        if (bucket < kSubBuckets) return bucket + 1;
+        size_t shift = bucket / kSubBuckets - 1;
+        return lowerEdge(bucket) + (uint64_t(1) << shift);
+    }
+
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// Records the time from construction to destruction (or stop()) into a
+// histogram.
+class StageTimer {
+public:
+    explicit StageTimer(LatencyHistogram& histogram)
+        : histogram_(&histogram), start_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { stop(); }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    // records now and returns the elapsed microseconds; later calls are no-ops
+    int64_t stop() {
+        if (!histogram_) return 0;
+        int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        histogram_->record(us);
+        histogram_ = nullptr;
+        return us;
+    }
+
+private:
+    LatencyHistogram* histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Adds count to a gauge for its lifetime, e.g. requests in flight.
+class GaugeScope {
+public:
+    explicit GaugeScope(std::atomic<int64_t>& gauge, int64_t count = 1)
+        : gauge_(gauge), count_(count) {
+        gauge_.fetch_add(count_, std::memory_order_relaxed);
+    }
+    ~GaugeScope() { gauge_.fetch_sub(count_, std::memory_order_relaxed); }
+    GaugeScope(const GaugeScope&) = delete;
+    GaugeScope& operator=(const GaugeScope&) = delete;
+
+private:
+    std::atomic<int64_t>& gauge_;
+    int64_t count_;
+};
+
+// Prometheus text exposition format (version 0.0.4). HELP and TYPE are
+// written once per metric name, before its first sample.
+class PrometheusWriter {
+public:
+    static constexpr const char* kContentType = "text/plain; version=0.0.4";
+
+    void counter(const std::string& name, const std::string& help, double value,
+                 const std::string& labels = "") {
+        header(name, help, "counter");
+        sample(name, labels, value);
+    }
+
+    void gauge(const std::string& name, const std::string& help, double value,
+               const std::string& labels = "") {
+        header(name, help, "gauge");
+        sample(name, labels, value);
+    }
+
+    // p50 / p99 / p999 plus _sum and _count, in seconds
+    void summary(const std::string& name, const std::string& help,
+                 const LatencyHistogram& histogram, const std::string& labels = "") {
+        header(name, help, "summary");
+        auto snap = histogram.snapshot();
+        static const char* const kQuantiles[] = {"0.5", "0.99", "0.999"};
+        static const double kValues[] = {0.5, 0.99, 0.999};
+        for (size_t i = 0; i < 3; ++i) {
+            std::string quantile = std::string("quantile=\"") + kQuantiles[i] + "\"";
+            sample(name, labels.empty() ? quantile : labels + "," + quantile,
+                   snap.quantileUs(kValues[i]) / 1e6);
+        }
+        sample(name + "_sum", labels, snap.sum_us / 1e6);
+        sample(name + "_count", labels, static_cast<double>(snap.count));
+    }
+
+    const std::string& str() const { return out_; }
+
+private:
+    void header(const std::string& name, const std::string& help, const char* type) {
+        if (!described_.insert(name).second) return;
+        out_ += "# HELP " + name + " " + help + "\n";
+        out_ += "# TYPE " + name + " " + type + "\n";
+    }
+
+    void sample(const std::string& name, const std::string& labels, double value) {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%.9g", value);
+        out_ += name;
+        if (!labels.empty()) {
+            out_ += "{" + labels + "}";
+        }
+        out_ += " ";
+        out_ += number;
+        out_ += "\n";
+    }
+
+    std::string out_;
+    std::set<std::string> described_;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef TENSOR_PROTOCOL_H
+#define TENSOR_PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Binary alternative to the JSON body on /infer.
+//
+// Frame layout (all fields little-endian):
+//   magic     u32   "TNSR"
+//   version   u8
+//   kind      u8    0 = request, 1 = response
+//   dtype     u8
+//   ndim      u8
+//   flags     u8    response: bit 0 = cached, bit 1 = failed (empty payload)
+//                   request: bit 2 = batch priority (bulk, not interactive)
+//   reserved  u8
+//   id_len    u16
+//   node_len  u16   response: node id; request: model name, 0 = the default
+//   reserved  u16
+//   time_us   i64   inference time, 0 for requests
+//   shape     ndim x i64
+//   request_id, node_id (model for a request)
+//   payload   prod(shape) elements of dtype
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "tensor protocol assumes a little-endian host"
+#endif
+
+constexpr const char* kTensorContentType = "application/x-tensor";
+constexpr const char* kJsonContentType = "application/json";
+// Request header with the caller's remaining time budget in milliseconds;
+// relative, so the two hosts' clocks need not agree
+constexpr const char* kDeadlineHeader = "X-Deadline-Ms";
+
+enum class TensorDType : uint8_t {
+    FLOAT32 = 1,
+    UINT8 = 2,    // requests only: an interleaved (HWC) image the worker normalizes
+    FLOAT16 = 3   // requests only: IEEE binary16
+};
+
+enum class FrameKind : uint8_t {
+    REQUEST = 0,
+    RESPONSE = 1
+};
+
+constexpr uint8_t kFrameFlagCached = 0x01;
+constexpr uint8_t kFrameFlagError = 0x02;
+constexpr uint8_t kFrameFlagBatchPriority = 0x04;
+
+struct TensorFrame {
+    FrameKind kind = FrameKind::REQUEST;
+    TensorDType dtype = TensorDType::FLOAT32;
+    uint8_t flags = 0;
+    int64_t inference_time_us = 0;
+    std::vector<int64_t> shape;
+    std::string request_id;
+    std::string node_id;  // responses only
+    std::string model;    // requests only; empty = the worker's default model
+    // points into the buffer the frame was decoded from
+    const char* payload = nullptr;
+    size_t payload_bytes = 0;
+
+    size_t elementCount() const;
+};
+
+bool isTensorContentType(const std::string& content_type);
+// throws std::runtime_error for a dtype the protocol does not know
+size_t dtypeSize(TensorDType dtype);
+
+// Seed for digesting a payload: 0 for float32, so a binary input and the
+// same input sent as JSON share cache entries, and a seed of its own for
+// every other dtype, so equal bytes of different dtypes never do.
+inline uint64_t payloadDigestSeed(TensorDType dtype) {
+    return dtype == TensorDType::FLOAT32 ? 0 : static_cast<uint64_t>(dtype);
+}
+
+// Parses one frame starting at data; returns the number of bytes consumed.
+// Throws std::runtime_error on a malformed or truncated frame.
+size_t decodeTensorFrame(const char* data, size_t size, TensorFrame& frame);
+
+// Length of the frame starting at data, or 0 if fewer than that many bytes
+// are available yet; used to cut frames out of a streamed body. Throws
+// std::runtime_error if the header is malformed.
+size_t tensorFrameSize(const char* data, size_t size);
+
+// Appends an encoded frame with the given float32 payload to out.
+void appendTensorFrame(std::string& out, const TensorFrame& frame,
+                       const float* data, size_t count);
+// Same, with count elements of frame.dtype at data.
+void appendTensorFrameRaw(std::string& out, const TensorFrame& frame,
+                          const void* data, size_t count);
+std::string encodeTensorFrame(const TensorFrame& frame,
+                              const float* data, size_t count);
+// Appends a response frame flagged kFrameFlagError, with an empty payload.
+void appendErrorFrame(std::string& out, const std::string& request_id,
+                      const std::string& node_id);
+
+// Copies the payload of a float32 frame into a vector.
+std::vector<float> tensorFrameToFloats(const TensorFrame& frame);
+
+#endif
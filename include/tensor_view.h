@@ -0,0 +1,37 @@
+#ifndef TENSOR_VIEW_H
+#define TENSOR_VIEW_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+// Read-only float span that shares ownership of the buffer it points into.
+// One batch output buffer is fanned out as a view per request, so copying a
+// view never copies data and the buffer lives until the last view is gone.
+struct TensorView {
+    std::shared_ptr<const float> data;  // aliasing pointer into the owner
+    size_t size = 0;
+
+    const float* begin() const { return data.get(); }
+    const float* end() const { return data.get() + size; }
+    bool empty() const { return size == 0; }
+
+    std::vector<float> toVector() const {
+        return std::vector<float>(begin(), end());
+    }
+
+    // view [offset, offset + count) of a buffer kept alive by owner
+    template<typename Owner>
+    static TensorView slice(const std::shared_ptr<Owner>& owner, const float* base,
+                            size_t offset, size_t count) {
+        return TensorView{std::shared_ptr<const float>(owner, base + offset), count};
+    }
+
+    // takes ownership of values, for results that do not come from a batch
+    static TensorView fromVector(std::vector<float> values) {
+        auto owner = std::make_shared<std::vector<float>>(std::move(values));
+        return slice(owner, owner->data(), 0, owner->size());
+    }
+};
+
+#endif
@@ -0,0 +1,483 @@
+#include "async_client.h"
+#include "http_text.h"
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+constexpr size_t kReadChunk = 64 * 1024;
+
+}  // namespace
+
+struct AsyncHttpClient::Pending {
+    std::string head;  // request line and headers
+    std::shared_ptr<const std::string> body;
+    Clock::time_point deadline;
+    Callback done;
+    EventLoop::TimerId timer = 0;
+    Connection* connection = nullptr;  // while sent or answered
+    bool finished = false;
+    bool retried = false;
+};
+
+struct AsyncHttpClient::Connection {
+    enum class State { CONNECTING, IDLE, BUSY };
+    int fd = -1;
+    State state = State::CONNECTING;
+    bool reused = false;   // served a request before the current one
+    bool writing = false;  // waiting for EPOLLOUT
+    std::shared_ptr<Pending> request;
+    size_t head_sent = 0;
+    size_t body_sent = 0;
+    // response being read
+    std::string in;
+    bool have_head = false;
+    int status = 0;
+    size_t body_start = 0;
+    int64_t content_length = -1;  // -1 = until the connection closes
+    bool keep_alive = true;
+
+    void resetResponse() {
+        in.clear();
+        have_head = false;
+        status = 0;
+        body_start = 0;
+        content_length = -1;
+        keep_alive = true;
+    }
+};
+
+AsyncHttpClient::AsyncHttpClient(EventLoop& loop, const std::string& host, int port, size_t max_connections)
+    : loop_(loop),
+      host_(host),
+      port_(port),
+      max_connections_(max_connections > 0 ? max_connections : 1),
+      host_header_(host + ":" + std::to_string(port)) {
+    // resolved up front, so the loop never waits on DNS; retried on connect if this fails
+    resolve();
+}
+
+AsyncHttpClient::~AsyncHttpClient() {
+    for (auto& connection : connections_) {
+        loop_.unwatch(connection->fd);
+        ::close(connection->fd);
+        if (connection->request) {
+            loop_.cancel(connection->request->timer);
+        }
+    }
+    for (auto& request : queued_) {
+        loop_.cancel(request->timer);
+    }
+}
+
+bool AsyncHttpClient::resolve() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    std::string service = std::to_string(port_);
+    if (getaddrinfo(host_.c_str(), service.c_str(), &hints, &result) != 0 || !result) {
+        return false;
+    }
+    std::memcpy(&address_, result->ai_addr, result->ai_addrlen);
+    address_len_ = static_cast<socklen_t>(result->ai_addrlen);
+    freeaddrinfo(result);
+    return true;
+}
+
+void AsyncHttpClient::post(const std::string& path, std::shared_ptr<const std::string> body,
+                           const std::string& content_type, const HttpHeaders& headers,
+                           Clock::time_point deadline, Callback done) {
+    auto request = std::make_shared<Pending>();
+    request->head = "POST " + path + " HTTP/1.1\r\nHost: " + host_header_ +
+                    "\r\nContent-Type: " + content_type +
+                    "\r\nContent-Length: " + std::to_string(body->size());
+    for (const auto& [name, value] : headers) {
+        request->head += "\r\n" + name + ": " + value;
+    }
+    request->head += "\r\nConnection: keep-alive\r\n\r\n";
+    request->body = std::move(body);
+    request->deadline = deadline;
+    request->done = std::move(done);
+    // always via the loop's queue, so the callback never runs inside post()
+    loop_.post([this, request] { start(request); });
+}
+
+void AsyncHttpClient::get(const std::string& path, Clock::time_point deadline, Callback done) {
+    static const auto kNoBody = std::make_shared<const std::string>();
+    auto request = std::make_shared<Pending>();
+    request->head = "GET " + path + " HTTP/1.1\r\nHost: " + host_header_ +
+                    "\r\nConnection: keep-alive\r\n\r\n";
+    request->body = kNoBody;
+    request->deadline = deadline;
+    request->done = std::move(done);
+    loop_.post([this, request] { start(request); });
+}
+
+void AsyncHttpClient::start(std::shared_ptr<Pending> request) {
+    auto wait = std::chrono::duration_cast<std::chrono::microseconds>(request->deadline - Clock::now());
+    std::weak_ptr<Pending> weak = request;
+    request->timer = loop_.runAfter(std::max(wait, std::chrono::microseconds(0)), [this, weak] {
+        auto timed_out = weak.lock();
+        if (!timed_out || timed_out->finished) return;
+        if (Connection* connection = timed_out->connection) {
+            // the response may still come, so the connection cannot be reused
+            connection->request = nullptr;
+            closeConnection(connection);
+        }
+        HttpResult result;
+        result.error = "timeout";
+        complete(timed_out, result);
+        dispatchQueued();
+    });
+    queued_.push_back(std::move(request));
+    dispatchQueued();
+}
+
+void AsyncHttpClient::dispatchQueued() {
+    while (!queued_.empty()) {
+        if (queued_.front()->finished) {
+            queued_.pop_front();
+            continue;
+        }
+        // most recently used first: it is the least likely to have gone stale
+        Connection* idle = nullptr;
+        for (auto it = connections_.rbegin(); it != connections_.rend(); ++it) {
+            if ((*it)->state == Connection::State::IDLE) {
+                idle = it->get();
+                break;
+            }
+        }
+        if (!idle && connections_.size() >= max_connections_) {
+            return;
+        }
+        std::shared_ptr<Pending> request = std::move(queued_.front());
+        queued_.pop_front();
+        if (idle) {
+            send(idle, std::move(request));
+        } else {
+            connect(std::move(request));
+        }
+    }
+}
+
+void AsyncHttpClient::send(Connection* connection, std::shared_ptr<Pending> request) {
+    if (connection->state == Connection::State::IDLE) {
+        idle_count_--;
+    }
+    connection->state = Connection::State::BUSY;
+    connection->head_sent = 0;
+    connection->body_sent = 0;
+    connection->resetResponse();
+    request->connection = connection;
+    connection->request = std::move(request);
+    writeRequest(connection);
+}
+
+void AsyncHttpClient::connect(std::shared_ptr<Pending> request) {
+    HttpResult result;
+    if (address_len_ == 0 && !resolve()) {
+        result.error = "cannot resolve " + host_;
+        complete(request, result);
+        return;
+    }
+    int fd = ::socket(address_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        result.error = std::string("socket: ") + std::strerror(errno);
+        complete(request, result);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address_), address_len_) < 0 && errno != EINPROGRESS) {
+        result.error = std::string("connect: ") + std::strerror(errno);
+        ::close(fd);
+        complete(request, result);
+        return;
+    }
+    auto owned = std::make_unique<Connection>();
+    Connection* connection = owned.get();
+    connection->fd = fd;
+    connection->state = Connection::State::CONNECTING;
+    request->connection = connection;
+    connection->request = std::move(request);
+    connections_.push_back(std::move(owned));
+    open_.store(connections_.size(), std::memory_order_relaxed);
+    loop_.watch(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP,
+                [this, connection](uint32_t events) { onEvents(connection, events); });
+}
+
+void AsyncHttpClient::onEvents(Connection* connection, uint32_t events) {
+    if (connection->state == Connection::State::CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0 || (events & EPOLLERR)) {
+            fail(connection, std::string("connect: ") + std::strerror(error ? error : ECONNREFUSED));
+            return;
+        }
+        if (!(events & EPOLLOUT)) {
+            return;
+        }
+        onConnected(connection);
+        return;
+    }
+    if ((events & EPOLLOUT) && connection->writing) {
+        writeRequest(connection);
+        // a write error closes the connection; it is gone if so
+        if (std::none_of(connections_.begin(), connections_.end(),
+                         [connection](const auto& c) { return c.get() == connection; })) {
+            return;
+        }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
+        readResponse(connection);
+    }
+}
+
+void AsyncHttpClient::onConnected(Connection* connection) {
+    connection->state = Connection::State::BUSY;
+    connection->writing = true;  // registered for EPOLLOUT while connecting
+    writeRequest(connection);
+}
+
+void AsyncHttpClient::writeRequest(Connection* connection) {
+    Pending& request = *connection->request;
+    while (true) {
+        iovec iov[2];
+        int count = 0;
+        if (connection->head_sent < request.head.size()) {
+            iov[count].iov_base = const_cast<char*>(request.head.data()) + connection->head_sent;
+            iov[count].iov_len = request.head.size() - connection->head_sent;
+            count++;
+        }
+        if (connection->body_sent < request.body->size()) {
+            iov[count].iov_base = const_cast<char*>(request.body->data()) + connection->body_sent;
+            iov[count].iov_len = request.body->size() - connection->body_sent;
+            count++;
+        }
+        if (count == 0) break;
+        msghdr message{};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t written = ::sendmsg(connection->fd, &message, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!connection->writing) {
+                    connection->writing = true;
+                    loop_.modify(connection->fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+                }
+                return;
+            }
+            fail(connection, std::string("send: ") + std::strerror(errno));
+            return;
+        }
+        size_t left = static_cast<size_t>(written);
+        size_t head_left = request.head.size() - connection->head_sent;
+        size_t from_head = std::min(left, head_left);
+        connection->head_sent += from_head;
+        connection->body_sent += left - from_head;
+    }
+    if (connection->writing) {
+        connection->writing = false;
+        loop_.modify(connection->fd, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+void AsyncHttpClient::readResponse(Connection* connection) {
+    char buffer[kReadChunk];
+    while (true) {
+        ssize_t count = ::read(connection->fd, buffer, sizeof(buffer));
+        if (count > 0) {
+            if (connection->state != Connection::State::BUSY) {
+                // nothing was asked on this connection
+                closeConnection(connection);
+                return;
+            }
+            connection->in.append(buffer, static_cast<size_t>(count));
+            continue;
+        }
+        if (count == 0) {
+            if (connection->state == Connection::State::IDLE) {
+                // the server dropped an idle keep-alive connection
+                closeConnection(connection);
+                return;
+            }
+            if (parseResponse(connection) || connection->request == nullptr) {
+                return;
+            }
+            if (connection->have_head && connection->content_length < 0) {
+                // body delimited by the end of the connection
+                HttpResult result;
+                result.ok = true;
+                result.status = connection->status;
+                result.body = connection->in.substr(connection->body_start);
+                connection->keep_alive = false;
+                finish(connection, result);
+                return;
+            }
+            fail(connection, "connection closed");
+            return;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        fail(connection, std::string("read: ") + std::strerror(errno));
+        return;
+    }
+    if (connection->state == Connection::State::BUSY) {
+        parseResponse(connection);
+    }
+}
+
+// true once the response was handled (finished or failed)
+bool AsyncHttpClient::parseResponse(Connection* connection) {
+    while (!connection->have_head) {
+        size_t head_end = connection->in.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            return false;
+        }
+        const std::string& in = connection->in;
+        size_t line_end = in.find("\r\n");
+        size_t space = in.find(' ');
+        if (in.compare(0, 5, "HTTP/") != 0 || space == std::string::npos || space > line_end) {
+            fail(connection, "malformed status line");
+            return true;
+        }
+        int status = std::atoi(in.c_str() + space + 1);
+        bool http10 = in.compare(0, 8, "HTTP/1.0") == 0;
+        int64_t content_length = -1;
+        bool keep_alive = !http10;
+        bool chunked = false;
+        for (size_t pos = line_end + 2; pos < head_end;) {
+            size_t end = in.find("\r\n", pos);
+            size_t colon = in.find(':', pos);
+            if (colon != std::string::npos && colon < end) {
+                std::string name = trimmed(in, pos, colon);
+                std::string value = trimmed(in, colon + 1, end);
+                if (equalsIgnoreCase(name, "Content-Length")) {
+                    content_length = std::strtoll(value.c_str(), nullptr, 10);
+                } else if (equalsIgnoreCase(name, "Connection")) {
+                    keep_alive = http10 ? equalsIgnoreCase(value, "keep-alive")
+                                        : !equalsIgnoreCase(value, "close");
+                } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+                    chunked = !equalsIgnoreCase(value, "identity");
+                }
+            }
+            pos = end + 2;
+        }
+        if (status >= 100 && status < 200) {
+            // interim response (100 Continue): the real one follows
+            connection->in.erase(0, head_end + 4);
+            continue;
+        }
+        if (chunked) {
+            fail(connection, "chunked responses are not supported");
+            return true;
+        }
+        if (status == 204 || status == 304) {
+            content_length = 0;
+        }
+        connection->have_head = true;
+        connection->status = status;
+        connection->body_start = head_end + 4;
+        connection->content_length = content_length;
+        connection->keep_alive = keep_alive && content_length >= 0;
+        if (content_length >= 0) {
+            connection->in.reserve(connection->body_start + static_cast<size_t>(content_length));
+        }
+    }
+    if (connection->content_length < 0) {
+        return false;
+    }
+    size_t total = connection->body_start + static_cast<size_t>(connection->content_length);
+    if (connection->in.size() < total) {
+        return false;
+    }
+    HttpResult result;
+    result.ok = true;
+    result.status = connection->status;
+    result.body = connection->in.substr(connection->body_start, static_cast<size_t>(connection->content_length));
+    if (connection->in.size() > total) {
+        // bytes past the response: nothing pipelined, so the stream is off
+        connection->keep_alive = false;
+    }
+    finish(connection, result);
+    return true;
+}
+
+void AsyncHttpClient::finish(Connection* connection, HttpResult& result) {
+    std::shared_ptr<Pending> request = std::move(connection->request);
+    connection->request = nullptr;
+    if (request) {
+        request->connection = nullptr;
+    }
+    if (connection->keep_alive) {
+        connection->state = Connection::State::IDLE;
+        connection->reused = true;
+        connection->resetResponse();
+        idle_count_++;
+    } else {
+        closeConnection(connection);
+    }
+    // queued requests get the connection before the callback can add more
+    dispatchQueued();
+    if (request) {
+        complete(request, result);
+    }
+}
+
+void AsyncHttpClient::fail(Connection* connection, const std::string& error) {
+    std::shared_ptr<Pending> request = std::move(connection->request);
+    connection->request = nullptr;
+    // a reused connection that broke before any reply most likely went stale
+    // while idle, so the request never reached the server: worth one retry
+    bool retry = request && connection->reused && connection->in.empty() &&
+                 !request->retried && Clock::now() < request->deadline;
+    closeConnection(connection);
+    if (request) {
+        request->connection = nullptr;
+        if (retry) {
+            request->retried = true;
+            connect(std::move(request));
+        } else {
+            HttpResult result;
+            result.error = error;
+            complete(request, result);
+        }
+    }
+    dispatchQueued();
+}
+
+void AsyncHttpClient::complete(std::shared_ptr<Pending> request, HttpResult& result) {
+    if (request->finished) return;
+    request->finished = true;
+    request->connection = nullptr;
+    loop_.cancel(request->timer);
+    Callback done = std::move(request->done);
+    request->done = nullptr;
+    if (done) {
+        done(result);
+    }
+}
+
+void AsyncHttpClient::closeConnection(Connection* connection) {
+    if (connection->state == Connection::State::IDLE) {
+        idle_count_--;
+    }
+    loop_.unwatch(connection->fd);
+    ::close(connection->fd);
+    connections_.erase(std::remove_if(connections_.begin(), connections_.end(),
+                                      [connection](const auto& c) { return c.get() == connection; }),
+                       connections_.end());
+    open_.store(connections_.size(), std::memory_order_relaxed);
+}
@@ -7,45 +7,71 @@ CircuitBreaker::CircuitBreaker(int failure_threshold, int success_threshold, std
       failure_threshold_(failure_threshold),
       success_threshold_(success_threshold),
       timeout_(timeout),
-      last_failure_time_(std::chrono::steady_clock::now()) {}
+      last_failure_ticks_(Clock::now().time_since_epoch().count()) {}
 
 bool CircuitBreaker::allowRequest() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (state_ == CircuitState::OPEN) {
-        auto now = std::chrono::steady_clock::now();
-        if (now - last_failure_time_ >= timeout_) {
-            state_ = CircuitState::HALF_OPEN;
-            success_count_ = 0;
-            return true;
-        }
+    if (state_.load(std::memory_order_acquire) != CircuitState::OPEN) {
+        return true;
+    }
+    if (!shouldAttemptReset()) {
         return false;
     }
+    // this caller or a concurrent one moves it to HALF_OPEN; both go ahead
+    transitionToHalfOpen();
     return true;
 }
 
 void CircuitBreaker::recordSuccess() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (state_ == CircuitState::HALF_OPEN) {
-        success_count_++;
-        if (success_count_ >= success_threshold_) {
-            state_ = CircuitState::CLOSED;
-            failure_count_ = 0;
+    if (state_.load(std::memory_order_acquire) == CircuitState::HALF_OPEN) {
+        if (success_count_.fetch_add(1, std::memory_order_acq_rel) + 1 >= success_threshold_) {
+            transitionToClosed();
         }
-    } else {
-        failure_count_ = 0;
+    } else if (failure_count_.load(std::memory_order_relaxed) != 0) {
+        // written only when there is something to clear, so successes on a
+        // healthy node do not all contend for the line
+        failure_count_.store(0, std::memory_order_relaxed);
     }
 }
 
 void CircuitBreaker::recordFailure() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    failure_count_++;
-    last_failure_time_ = std::chrono::steady_clock::now();
-    
-    if (failure_count_ >= failure_threshold_ || state_ == CircuitState::HALF_OPEN) {
-        state_ = CircuitState::OPEN;
+    last_failure_ticks_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    int failures = failure_count_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (failures >= failure_threshold_ ||
+        state_.load(std::memory_order_acquire) == CircuitState::HALF_OPEN) {
+        transitionToOpen();
+    }
+}
+
+void CircuitBreaker::recordProbeSuccess() {
+    if (state_.load(std::memory_order_acquire) == CircuitState::OPEN) {
+        transitionToHalfOpen();
+    }
+}
+
+void CircuitBreaker::transitionToOpen() {
+    // release: a caller that sees OPEN sees the failure time too
+    state_.store(CircuitState::OPEN, std::memory_order_release);
+}
+
+void CircuitBreaker::transitionToHalfOpen() {
+    CircuitState expected = CircuitState::OPEN;
+    if (state_.compare_exchange_strong(expected, CircuitState::HALF_OPEN, std::memory_order_acq_rel)) {
+        success_count_.store(0, std::memory_order_relaxed);
+    }
+}
+
+void CircuitBreaker::transitionToClosed() {
+    CircuitState expected = CircuitState::HALF_OPEN;
+    if (state_.compare_exchange_strong(expected, CircuitState::CLOSED, std::memory_order_acq_rel)) {
+        failure_count_.store(0, std::memory_order_relaxed);
     }
 }
 
+bool CircuitBreaker::shouldAttemptReset() const {
+    Clock::time_point last_failure{Clock::duration(last_failure_ticks_.load(std::memory_order_relaxed))};
+    return Clock::now() - last_failure >= timeout_;
+}
+
 CircuitState CircuitBreaker::getState() const {
     return state_.load();
 }
@@ -65,6 +91,5 @@ int CircuitBreaker::getSuccessCount() const {
 }
 
 int CircuitBreaker::getFailureCount() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return failure_count_;
-}
\ No newline at end of file
+    return failure_count_.load();
+}
@@ -1,7 +1,14 @@
 #include "consistent_hash.h"
 #include <sstream>
+#include <algorithm>
+#include <iterator>
 
-ConsistentHash::ConsistentHash(int virtual_nodes) : virtual_nodes_(virtual_nodes) {}
+ConsistentHash::ConsistentHash(int virtual_nodes) : virtual_nodes_(virtual_nodes) {
+    snapshots_.push_back(std::make_unique<const Snapshot>());
+    current_.store(snapshots_.back().get(), std::memory_order_release);
+}
+
+ConsistentHash::~ConsistentHash() = default;
 
 uint32_t ConsistentHash::hash(const std::string& key) const {
     // FNV-1a hash
@@ -14,50 +21,153 @@ uint32_t ConsistentHash::hash(const std::string& key) const {
 }
 
 void ConsistentHash::addNode(const std::string& node) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (int i = 0; i < virtual_nodes_; ++i) {
-        std::string vnode = node + "#" + std::to_string(i);
-        uint32_t h = hash(vnode);
-        ring_[h] = node;
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    const Snapshot* ring = current_.load(std::memory_order_acquire);
+    std::vector<std::string> nodes = ring->nodes;
+    if (std::find(nodes.begin(), nodes.end(), node) != nodes.end()) {
+        return;
     }
+    nodes.push_back(node);
+    std::vector<Point> added = nodePoints(node, static_cast<uint32_t>(nodes.size() - 1));
+    std::vector<Point> points;
+    points.reserve(ring->points.size() + added.size());
+    std::merge(ring->points.begin(), ring->points.end(), added.begin(), added.end(),
+               std::back_inserter(points));
+    publish(std::move(nodes), std::move(points));
 }
 
 void ConsistentHash::removeNode(const std::string& node) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    const Snapshot* ring = current_.load(std::memory_order_acquire);
+    std::vector<std::string> nodes = ring->nodes;
+    auto it = std::find(nodes.begin(), nodes.end(), node);
+    if (it == nodes.end()) {
+        return;
+    }
+    uint32_t index = static_cast<uint32_t>(it - nodes.begin());
+    nodes.erase(it);
+    // the later nodes move down one index, which keeps the points in order
+    std::vector<Point> points;
+    points.reserve(ring->points.size());
+    for (const auto& [h, owner] : ring->points) {
+        if (owner != index) {
+            points.emplace_back(h, owner > index ? owner - 1 : owner);
+        }
+    }
+    publish(std::move(nodes), std::move(points));
+}
+
+std::vector<ConsistentHash::Point> ConsistentHash::nodePoints(const std::string& node, uint32_t index) const {
+    std::vector<Point> points;
+    points.reserve(virtual_nodes_);
     for (int i = 0; i < virtual_nodes_; ++i) {
         std::string vnode = node + "#" + std::to_string(i);
-        uint32_t h = hash(vnode);
-        ring_.erase(h);
+        points.emplace_back(hash(vnode), index);
     }
+    std::sort(points.begin(), points.end());
+    return points;
 }
 
-std::string ConsistentHash::getNode(const std::string& key) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (ring_.empty()) {
-        return "";
+void ConsistentHash::publish(std::vector<std::string> nodes, std::vector<Point> points) {
+    auto ring = std::make_unique<Snapshot>();
+    // on a hash collision the first node keeps the point; the others keep
+    // theirs in points, for when it leaves
+    ring->hashes.reserve(points.size());
+    ring->owners.reserve(points.size());
+    for (const auto& [h, owner] : points) {
+        if (ring->hashes.empty() || ring->hashes.back() != h) {
+            ring->hashes.push_back(h);
+            ring->owners.push_back(owner);
+        }
+    }
+    // distinct successors of every position, stamped so each walk can
+    // tell the nodes it already took without clearing a set
+    std::vector<bool> owns(nodes.size(), false);
+    for (uint32_t owner : ring->owners) {
+        owns[owner] = true;
     }
-    uint32_t h = hash(key);
-    auto it = ring_.lower_bound(h);
-    if (it == ring_.end()) {
-        it = ring_.begin();
+    ring->owning_nodes = std::count(owns.begin(), owns.end(), true);
+    ring->successor_width = std::min(ring->owning_nodes, kMaxSuccessors);
+    size_t positions = ring->hashes.size();
+    ring->successors.resize(positions * ring->successor_width);
+    std::vector<size_t> seen(nodes.size(), SIZE_MAX);
+    for (size_t p = 0; p < positions; ++p) {
+        uint32_t* out = &ring->successors[p * ring->successor_width];
+        size_t found = 0;
+        for (size_t step = 0; found < ring->successor_width; ++step) {
+            uint32_t owner = ring->owners[(p + step) % positions];
+            if (seen[owner] != p) {
+                seen[owner] = p;
+                out[found++] = owner;
+            }
+        }
     }
-    return it->second;
+    ring->nodes = std::move(nodes);
+    ring->points = std::move(points);
+
+    snapshots_.push_back(std::move(ring));
+    current_.store(snapshots_.back().get(), std::memory_order_release);
 }
 
-std::vector<std::string> ConsistentHash::getAllNodes() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<std::string> nodes;
-    std::map<std::string, bool> seen;
-    
-    for (const auto& pair : ring_) {
-        if (!seen[pair.second]) {
-            nodes.push_back(pair.second);
-            seen[pair.second] = true;
+size_t ConsistentHash::position(const Snapshot& ring, const std::string& key) const {
+    auto it = std::lower_bound(ring.hashes.begin(), ring.hashes.end(), hash(key));
+    return it == ring.hashes.end() ? 0 : static_cast<size_t>(it - ring.hashes.begin());
+}
+
+const std::string& ConsistentHash::getNode(const std::string& key) const {
+    static const std::string kNoNode;
+    const Snapshot* ring = current_.load(std::memory_order_acquire);
+    if (ring->hashes.empty()) {
+        return kNoNode;
+    }
+    return ring->nodes[ring->owners[position(*ring, key)]];
+}
+
+size_t ConsistentHash::getSuccessors(const std::string& key, const std::string** out,
+                                     size_t max) const {
+    const Snapshot* ring = current_.load(std::memory_order_acquire);
+    if (ring->hashes.empty() || max == 0) {
+        return 0;
+    }
+    size_t pos = position(*ring, key);
+    size_t count = std::min(max, ring->owning_nodes);
+    if (count <= ring->successor_width) {
+        const uint32_t* successors = &ring->successors[pos * ring->successor_width];
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = &ring->nodes[successors[i]];
+        }
+        return count;
+    }
+    // more than precomputed: walk the ring
+    size_t found = 0;
+    for (size_t step = 0; found < count; ++step) {
+        const std::string* node = &ring->nodes[ring->owners[(pos + step) % ring->hashes.size()]];
+        if (std::find(out, out + found, node) == out + found) {
+            out[found++] = node;
         }
     }
+    return found;
+}
+
+std::vector<std::string> ConsistentHash::getNodes(const std::string& key, size_t n) const {
+    std::vector<const std::string*> refs(std::min(n, nodeCount()));
+    refs.resize(getSuccessors(key, refs.data(), refs.size()));
+    std::vector<std::string> nodes;
+    nodes.reserve(refs.size());
+    for (const std::string* node : refs) {
+        nodes.push_back(*node);
+    }
     return nodes;
 }
 
+std::vector<std::string> ConsistentHash::getAllNodes() const {
+    return current_.load(std::memory_order_acquire)->nodes;
+}
+
+size_t ConsistentHash::nodeCount() const {
+    return current_.load(std::memory_order_acquire)->nodes.size();
+}
+
 std::map<std::string, int> ConsistentHash::getDistribution(
     const std::vector<std::string>& keys) const {
     std::map<std::string, int> dist;
@@ -0,0 +1,135 @@
+#include "engine_pool.h"
+#include "cpu_affinity.h"
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <cstdio>
+#include <functional>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Where the optimized graph of model_path lives in options.optimized_model_dir:
+// named after the model file and a hash of its path, size, mtime and device,
+// so a changed file or another GPU never picks up a stale graph. Empty when
+// the model file cannot be stat'ed.
+std::string optimizedModelPath(const std::string& model_path, const EngineOptions& options) {
+    struct stat st;
+    if (::stat(model_path.c_str(), &st) != 0) return "";
+    std::string key = model_path + '\0' + std::to_string(st.st_size) + '\0' +
+                      std::to_string(st.st_mtim.tv_sec) + '.' + std::to_string(st.st_mtim.tv_nsec) +
+                      '\0' + std::to_string(options.device_id);
+    size_t slash = model_path.find_last_of('/');
+    std::string name = slash == std::string::npos ? model_path : model_path.substr(slash + 1);
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016zx", std::hash<std::string>{}(key));
+    return options.optimized_model_dir + "/" + name + "." + hash + ".opt.onnx";
+}
+
+bool fileExists(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0;
+}
+
+}  // namespace
+
+EnginePool::EnginePool(const std::string& model_path, size_t num_sessions, int shard_id,
+                       const EngineOptions& options)
+    : device_id_(options.device_id) {
+    if (num_sessions == 0) {
+        throw std::invalid_argument("EnginePool needs at least one session");
+    }
+    std::string optimized;
+    if (!options.optimized_model_dir.empty()) {
+        optimized = optimizedModelPath(model_path, options);
+    }
+    engines_.reserve(num_sessions);
+    for (size_t i = 0; i < num_sessions; ++i) {
+        EngineOptions session_options = options;
+        session_options.cpus = cpuSlice(options.cpus, num_sessions, i);
+        engines_.push_back(createEngine(model_path, shard_id, session_options, optimized));
+        idle_.push_back(engines_.back().get());
+    }
+    std::cout << "Engine pool ready: " << num_sessions << " session(s)" << std::endl;
+}
+
+std::unique_ptr<InferenceEngine> EnginePool::createEngine(const std::string& model_path, int shard_id,
+                                                          const EngineOptions& options,
+                                                          std::string& optimized) {
+    if (optimized.empty()) {
+        return std::make_unique<InferenceEngine>(model_path, shard_id, options);
+    }
+    EngineOptions session_options = options;
+    if (fileExists(optimized)) {
+        session_options.load_optimized_path = optimized;
+        try {
+            return std::make_unique<InferenceEngine>(model_path, shard_id, session_options);
+        } catch (const Ort::Exception& e) {
+            // unreadable (another ORT build, a truncated copy): optimize from
+            // the model itself and leave the file alone
+            std::cerr << "Cannot load optimized graph " << optimized << ": " << e.what() << std::endl;
+            optimized.clear();
+            return std::make_unique<InferenceEngine>(model_path, shard_id, options);
+        }
+    }
+    // written under a name of its own and renamed into place, so a pool
+    // starting elsewhere never loads a partly written graph
+    static std::atomic<uint64_t> next_temp{0};
+    std::string temp = optimized + ".tmp." + std::to_string(::getpid()) + "." +
+                       std::to_string(next_temp.fetch_add(1));
+    session_options.save_optimized_path = temp;
+    auto engine = std::make_unique<InferenceEngine>(model_path, shard_id, session_options);
+    if (std::rename(temp.c_str(), optimized.c_str()) != 0) {
+        std::remove(temp.c_str());
+        std::cerr << "Cannot save optimized graph to " << optimized << std::endl;
+        optimized.clear();
+    } else {
+        std::cout << "Optimized graph saved to " << optimized << std::endl;
+    }
+    return engine;
+}
+
+EnginePool::Lease::Lease(EnginePool& pool) : pool_(pool) {
+    std::unique_lock<std::mutex> lock(pool_.mutex_);
+    pool_.idle_cv_.wait(lock, [this] { return !pool_.idle_.empty(); });
+    engine_ = pool_.idle_.back();
+    pool_.idle_.pop_back();
+    pool_.busy_++;
+}
+
+EnginePool::Lease::~Lease() {
+    {
+        std::lock_guard<std::mutex> lock(pool_.mutex_);
+        pool_.idle_.push_back(engine_);
+        pool_.busy_--;
+    }
+    pool_.idle_cv_.notify_one();
+}
+
+std::vector<float> EnginePool::predict(const std::vector<float>& input) {
+    Lease engine(*this);
+    return engine->predict(input);
+}
+
+std::vector<std::vector<float>> EnginePool::batchPredict(
+    const std::vector<std::vector<float>>& inputs) {
+    Lease engine(*this);
+    return engine->batchPredict(inputs);
+}
+
+std::vector<TensorView> EnginePool::runBatch(PackedInput& input) {
+    Lease engine(*this);
+    return engine->runBatch(input);
+}
+
+void EnginePool::warmup() {
+    std::vector<std::thread> threads;
+    threads.reserve(engines_.size());
+    for (auto& engine : engines_) {
+        threads.emplace_back([&engine] { engine->warmup(); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
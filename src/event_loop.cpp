@@ -0,0 +1,228 @@
+#include "event_loop.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+
+namespace {
+
+thread_local EventLoop* t_current_loop = nullptr;
+
+constexpr int kMaxEvents = 128;
+
+uint64_t eventData(int fd, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+}  // namespace
+
+EventLoop::EventLoop() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        throw std::runtime_error(std::string("epoll_create1 failed: ") + std::strerror(errno));
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        ::close(epoll_fd_);
+        throw std::runtime_error(std::string("eventfd failed: ") + std::strerror(errno));
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = eventData(wake_fd_, 0);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+}
+
+EventLoop::~EventLoop() {
+    ::close(wake_fd_);
+    ::close(epoll_fd_);
+}
+
+EventLoop* EventLoop::current() {
+    return t_current_loop;
+}
+
+void EventLoop::run() {
+    t_current_loop = this;
+    epoll_event events[kMaxEvents];
+    while (!stopped_.load()) {
+        int count = epoll_wait(epoll_fd_, events, kMaxEvents, nextTimeoutMs());
+        if (count < 0 && errno != EINTR) {
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            int fd = static_cast<int>(events[i].data.u64 & 0xffffffffu);
+            uint32_t generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+            if (fd == wake_fd_) {
+                uint64_t drained;
+                while (::read(wake_fd_, &drained, sizeof(drained)) > 0) {}
+                continue;
+            }
+            auto it = watchers_.find(fd);
+            if (it == watchers_.end() || it->second.generation != generation) {
+                continue;
+            }
+            // held here in case the callback unwatches its own fd
+            std::shared_ptr<IoCallback> callback = it->second.callback;
+            (*callback)(events[i].events);
+        }
+        runTimers();
+        runPosted();
+    }
+    t_current_loop = nullptr;
+}
+
+void EventLoop::stop() {
+    stopped_.store(true);
+    uint64_t one = 1;
+    if (::write(wake_fd_, &one, sizeof(one)) < 0) {
+        // the counter is already non-zero, so the loop wakes anyway
+    }
+}
+
+void EventLoop::post(Task task) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        posted_.push_back(std::move(task));
+        if (!wake_pending_) {
+            wake_pending_ = true;
+            wake = true;
+        }
+    }
+    // one wake-up per burst of posts
+    if (wake) {
+        uint64_t one = 1;
+        if (::write(wake_fd_, &one, sizeof(one)) < 0) {
+            // as in stop()
+        }
+    }
+}
+
+void EventLoop::watch(int fd, uint32_t events, IoCallback callback) {
+    uint32_t generation = ++next_generation_;
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = eventData(fd, generation);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw std::runtime_error(std::string("epoll_ctl add failed: ") + std::strerror(errno));
+    }
+    watchers_[fd] = Watcher{generation, std::make_shared<IoCallback>(std::move(callback))};
+}
+
+void EventLoop::modify(int fd, uint32_t events) {
+    auto it = watchers_.find(fd);
+    if (it == watchers_.end()) return;
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = eventData(fd, it->second.generation);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+}
+
+void EventLoop::unwatch(int fd) {
+    if (watchers_.erase(fd) > 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+EventLoop::TimerId EventLoop::runAfter(std::chrono::microseconds delay, Task task) {
+    TimerId id = next_timer_++;
+    auto due = Clock::now() + delay;
+    timers_.emplace(std::make_pair(due, id), std::move(task));
+    timer_due_.emplace(id, due);
+    return id;
+}
+
+void EventLoop::cancel(TimerId id) {
+    auto it = timer_due_.find(id);
+    if (it == timer_due_.end()) return;
+    timers_.erase(std::make_pair(it->second, id));
+    timer_due_.erase(it);
+}
+
+int EventLoop::nextTimeoutMs() const {
+    if (timers_.empty()) {
+        return -1;
+    }
+    auto wait = timers_.begin()->first.first - Clock::now();
+    if (wait <= Clock::duration::zero()) {
+        return 0;
+    }
+    // rounded up: waking early would only spin until the timer is due
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait + std::chrono::microseconds(999));
+    return static_cast<int>(std::min<int64_t>(ms.count(), 60000));
+}
+
+void EventLoop::runTimers() {
+    auto now = Clock::now();
+    while (!timers_.empty() && timers_.begin()->first.first <= now) {
+        auto it = timers_.begin();
+        Task task = std::move(it->second);
+        timer_due_.erase(it->first.second);
+        timers_.erase(it);
+        task();
+    }
+}
+
+void EventLoop::runPosted() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        tasks.swap(posted_);
+        wake_pending_ = false;
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+EventLoopGroup::EventLoopGroup(size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        loops_.push_back(std::make_unique<EventLoop>());
+    }
+}
+
+EventLoopGroup::~EventLoopGroup() {
+    stop();
+    join();
+}
+
+void EventLoopGroup::start() {
+    if (!threads_.empty()) return;
+    for (auto& loop : loops_) {
+        threads_.emplace_back([loop = loop.get()] { loop->run(); });
+    }
+}
+
+void EventLoopGroup::stop() {
+    for (auto& loop : loops_) {
+        loop->stop();
+    }
+}
+
+void EventLoopGroup::join() {
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+std::vector<EventLoop*> EventLoopGroup::loops() const {
+    std::vector<EventLoop*> loops;
+    for (const auto& loop : loops_) {
+        loops.push_back(loop.get());
+    }
+    return loops;
+}
+
+EventLoop& EventLoopGroup::next() {
+    return *loops_[next_.fetch_add(1, std::memory_order_relaxed) % loops_.size()];
+}
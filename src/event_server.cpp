@@ -0,0 +1,498 @@
+#include "event_server.h"
+#include <nlohmann/json.hpp>
+#include "http_text.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <algorithm>
+
+namespace {
+
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+constexpr size_t kReadChunk = 64 * 1024;
+constexpr int kMaxIov = 16;
+
+const char* reasonPhrase(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 408: return "Request Timeout";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Unknown";
+    }
+}
+
+// status line and headers; the connection adds its own and the blank line
+std::string responseHead(int status, const std::string& content_type, const HttpHeaders& headers) {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + reasonPhrase(status) + "\r\n";
+    head += "Content-Type: " + content_type + "\r\n";
+    for (const auto& [name, value] : headers) {
+        head += name + ": " + value + "\r\n";
+    }
+    return head;
+}
+
+std::string errorBody(const std::string& message) {
+    nlohmann::json error;
+    error["error"] = message;
+    return error.dump();
+}
+
+}  // namespace
+
+std::string HttpRequest::header(const std::string& name) const {
+    for (const auto& [key, value] : headers) {
+        if (equalsIgnoreCase(key, name)) {
+            return value;
+        }
+    }
+    return "";
+}
+
+// One client connection, owned by its loop's watcher and by outstanding
+// replies. Requests are served one at a time, in order: a pipelined request
+// is only parsed once the one before it has been answered.
+class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
+public:
+    enum class Part { FULL, STREAM_START, CHUNK, STREAM_END };
+
+    HttpConnection(EventServer& server, EventLoop& loop, int fd)
+        : server_(server), loop_(loop), fd_(fd) {}
+
+    void start() {
+        auto self = shared_from_this();
+        loop_.watch(fd_, EPOLLIN | EPOLLRDHUP, [self](uint32_t events) { self->onEvents(events); });
+        armIdleTimer();
+    }
+
+    // any thread: the write is done on the loop
+    void deliver(uint64_t request, Part part, std::string head, std::string body) {
+        if (loop_.inLoopThread()) {
+            reply(request, part, std::move(head), std::move(body));
+            return;
+        }
+        loop_.post([self = shared_from_this(), request, part,
+                    head = std::move(head), body = std::move(body)]() mutable {
+            self->reply(request, part, std::move(head), std::move(body));
+        });
+    }
+
+private:
+    void onEvents(uint32_t events) {
+        if (events & EPOLLERR) {
+            close();
+            return;
+        }
+        if (events & EPOLLOUT) {
+            flush();
+        }
+        if (!closed_ && (events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))) {
+            readAvailable();
+        }
+    }
+
+    void readAvailable() {
+        char buffer[kReadChunk];
+        while (true) {
+            ssize_t count = ::read(fd_, buffer, sizeof(buffer));
+            if (count > 0) {
+                in_.append(buffer, static_cast<size_t>(count));
+                if (in_.size() > server_.max_body_bytes_ + kMaxHeaderBytes) {
+                    // more pipelined than any one request may hold
+                    close();
+                    return;
+                }
+                continue;
+            }
+            if (count == 0) {
+                close();
+                return;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close();
+            return;
+        }
+        parseRequests();
+    }
+
+    void parseRequests() {
+        if (parsing_) return;  // a handler replied synchronously; the outer call continues
+        parsing_ = true;
+        while (!closed_ && !busy_ && parseOne()) {}
+        parsing_ = false;
+    }
+
+    // false when the buffer holds no whole request yet
+    bool parseOne() {
+        if (!have_head_ && !parseHead()) {
+            return false;
+        }
+        if (in_.size() < request_size_) {
+            if (expect_continue_) {
+                expect_continue_ = false;
+                queue("HTTP/1.1 100 Continue\r\n\r\n");
+                flush();
+            }
+            in_.reserve(request_size_);
+            return false;
+        }
+        HttpRequest request = std::move(pending_);
+        pending_ = HttpRequest();
+        have_head_ = false;
+        request.body = in_.substr(body_offset_, request_size_ - body_offset_);
+        in_.erase(0, request_size_);
+
+        busy_ = true;
+        request_++;
+        loop_.cancel(idle_timer_);
+        HttpReply reply(shared_from_this(), request_);
+        try {
+            server_.dispatch(request, reply);
+        } catch (const std::exception& e) {
+            reply.send(500, "application/json", errorBody(e.what()));
+        }
+        return true;
+    }
+
+    bool parseHead() {
+        size_t head_end = in_.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            if (in_.size() > kMaxHeaderBytes) {
+                reject(431, "Request headers too large");
+            }
+            return false;
+        }
+        size_t line_end = in_.find("\r\n");
+        size_t method_end = in_.find(' ');
+        size_t target_end = method_end == std::string::npos ? std::string::npos : in_.find(' ', method_end + 1);
+        if (method_end == std::string::npos || target_end == std::string::npos || target_end > line_end) {
+            reject(400, "Malformed request line");
+            return false;
+        }
+        pending_.method = in_.substr(0, method_end);
+        std::string target = in_.substr(method_end + 1, target_end - method_end - 1);
+        std::string version = in_.substr(target_end + 1, line_end - target_end - 1);
+        size_t query = target.find('?');
+        pending_.path = target.substr(0, query);
+        pending_.query = query == std::string::npos ? "" : target.substr(query + 1);
+
+        for (size_t pos = line_end + 2; pos < head_end;) {
+            size_t end = in_.find("\r\n", pos);
+            size_t colon = in_.find(':', pos);
+            if (colon == std::string::npos || colon > end) {
+                reject(400, "Malformed header");
+                return false;
+            }
+            pending_.headers.emplace_back(trimmed(in_, pos, colon), trimmed(in_, colon + 1, end));
+            pos = end + 2;
+        }
+
+        std::string connection = pending_.header("Connection");
+        keep_alive_ = version == "HTTP/1.1" ? !equalsIgnoreCase(connection, "close")
+                                            : equalsIgnoreCase(connection, "keep-alive");
+        if (!pending_.header("Transfer-Encoding").empty()) {
+            reject(501, "Chunked request bodies are not supported");
+            return false;
+        }
+        size_t length = 0;
+        std::string length_header = pending_.header("Content-Length");
+        if (!length_header.empty()) {
+            char* end = nullptr;
+            unsigned long long parsed = std::strtoull(length_header.c_str(), &end, 10);
+            if (*end != '\0' || length_header[0] == '-') {
+                reject(400, "Bad Content-Length");
+                return false;
+            }
+            if (parsed > server_.max_body_bytes_) {
+                reject(413, "Request body too large");
+                return false;
+            }
+            length = static_cast<size_t>(parsed);
+        }
+        body_offset_ = head_end + 4;
+        request_size_ = body_offset_ + length;
+        expect_continue_ = equalsIgnoreCase(pending_.header("Expect"), "100-continue");
+        have_head_ = true;
+        return true;
+    }
+
+    void reply(uint64_t request, Part part, std::string head, std::string body) {
+        if (closed_ || !busy_ || request != request_) {
+            return;
+        }
+        std::string connection = keep_alive_ ? "" : "Connection: close\r\n";
+        switch (part) {
+            case Part::FULL:
+                if (replied_) return;
+                queue(head + connection + "\r\n");
+                queue(std::move(body));
+                finishRequest();
+                break;
+            case Part::STREAM_START:
+                if (replied_) return;
+                replied_ = true;
+                streaming_ = true;
+                queue(head + connection + "Transfer-Encoding: chunked\r\n\r\n");
+                break;
+            case Part::CHUNK: {
+                // an empty chunk would end the stream
+                if (!streaming_ || body.empty()) return;
+                char size[24];
+                std::snprintf(size, sizeof(size), "%zx\r\n", body.size());
+                queue(size);
+                queue(std::move(body));
+                queue("\r\n");
+                break;
+            }
+            case Part::STREAM_END:
+                if (!streaming_) return;
+                streaming_ = false;
+                queue("0\r\n\r\n");
+                finishRequest();
+                break;
+        }
+        flush();
+    }
+
+    void finishRequest() {
+        busy_ = false;
+        replied_ = false;
+        if (!keep_alive_) {
+            close_after_flush_ = true;
+            return;
+        }
+        armIdleTimer();
+        parseRequests();
+    }
+
+    // answers an unparseable request and drops the connection
+    void reject(int status, const std::string& message) {
+        std::string body = errorBody(message);
+        queue(responseHead(status, "application/json", {}) +
+              "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n");
+        queue(std::move(body));
+        busy_ = true;  // nothing more is parsed
+        close_after_flush_ = true;
+        flush();
+    }
+
+    void queue(std::string data) {
+        out_.push_back(std::move(data));
+    }
+
+    void flush() {
+        while (!closed_ && !out_.empty()) {
+            iovec iov[kMaxIov];
+            int count = 0;
+            size_t offset = out_offset_;
+            for (auto it = out_.begin(); it != out_.end() && count < kMaxIov; ++it) {
+                iov[count].iov_base = const_cast<char*>(it->data()) + offset;
+                iov[count].iov_len = it->size() - offset;
+                offset = 0;
+                count++;
+            }
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            ssize_t written = ::sendmsg(fd_, &message, MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                close();
+                return;
+            }
+            size_t left = static_cast<size_t>(written);
+            while (!out_.empty() && left >= out_.front().size() - out_offset_) {
+                left -= out_.front().size() - out_offset_;
+                out_.pop_front();
+                out_offset_ = 0;
+            }
+            out_offset_ += left;
+        }
+        if (closed_) return;
+        if (out_.empty()) {
+            if (writing_) {
+                writing_ = false;
+                loop_.modify(fd_, EPOLLIN | EPOLLRDHUP);
+            }
+            if (close_after_flush_) {
+                close();
+            }
+        } else if (!writing_) {
+            writing_ = true;
+            loop_.modify(fd_, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+        }
+    }
+
+    void armIdleTimer() {
+        loop_.cancel(idle_timer_);
+        std::weak_ptr<HttpConnection> weak = shared_from_this();
+        idle_timer_ = loop_.runAfter(server_.keep_alive_timeout_, [weak] {
+            if (auto self = weak.lock()) {
+                if (!self->busy_) self->close();
+            }
+        });
+    }
+
+    void close() {
+        if (closed_) return;
+        closed_ = true;
+        loop_.cancel(idle_timer_);
+        out_.clear();
+        in_.clear();
+        // whoever called this holds a reference, so the watcher can go first
+        loop_.unwatch(fd_);
+        ::close(fd_);
+    }
+
+    EventServer& server_;
+    EventLoop& loop_;
+    int fd_;
+    std::string in_;
+    std::deque<std::string> out_;
+    size_t out_offset_ = 0;  // bytes of out_.front() already sent
+    HttpRequest pending_;    // head of the request being received
+    bool have_head_ = false;
+    size_t body_offset_ = 0;
+    size_t request_size_ = 0;
+    bool expect_continue_ = false;
+    uint64_t request_ = 0;   // sequence number of the request being served
+    bool busy_ = false;      // a request is waiting for its reply
+    bool replied_ = false;   // a stream has started for it
+    bool streaming_ = false;
+    bool keep_alive_ = true;
+    bool parsing_ = false;
+    bool writing_ = false;   // waiting for EPOLLOUT
+    bool close_after_flush_ = false;
+    bool closed_ = false;
+    EventLoop::TimerId idle_timer_ = 0;
+};
+
+void HttpReply::send(int status, const std::string& content_type, std::string body,
+                     const HttpHeaders& headers) const {
+    if (!connection_) return;
+    std::string head = responseHead(status, content_type, headers);
+    head += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    connection_->deliver(request_, HttpConnection::Part::FULL, std::move(head), std::move(body));
+}
+
+void HttpReply::startStream(int status, const std::string& content_type) const {
+    if (!connection_) return;
+    connection_->deliver(request_, HttpConnection::Part::STREAM_START,
+                         responseHead(status, content_type, {}), "");
+}
+
+void HttpReply::write(std::string chunk) const {
+    if (!connection_) return;
+    connection_->deliver(request_, HttpConnection::Part::CHUNK, "", std::move(chunk));
+}
+
+void HttpReply::end() const {
+    if (!connection_) return;
+    connection_->deliver(request_, HttpConnection::Part::STREAM_END, "", "");
+}
+
+EventServer::EventServer(std::vector<EventLoop*> loops) : loops_(std::move(loops)) {
+    if (loops_.empty()) {
+        throw std::invalid_argument("EventServer needs at least one loop");
+    }
+}
+
+EventServer::~EventServer() {
+    for (int fd : listen_fds_) {
+        ::close(fd);
+    }
+}
+
+void EventServer::handle(const std::string& method, const std::string& path, Handler handler) {
+    routes_[{method, path}] = std::move(handler);
+}
+
+bool EventServer::listen(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* address = nullptr;
+    std::string service = std::to_string(port);
+    int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &address);
+    if (rc != 0 || !address) {
+        std::cerr << "Cannot resolve " << host << ": " << gai_strerror(rc) << std::endl;
+        return false;
+    }
+
+    // one socket per loop; the kernel spreads new connections across them
+    std::vector<int> fds;
+    for (size_t i = 0; i < loops_.size(); ++i) {
+        int fd = ::socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        bool ok = fd >= 0 &&
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == 0 &&
+            ::bind(fd, address->ai_addr, address->ai_addrlen) == 0 &&
+            ::listen(fd, SOMAXCONN) == 0;
+        if (!ok) {
+            std::cerr << "Cannot listen on " << host << ":" << port << ": " << std::strerror(errno) << std::endl;
+            if (fd >= 0) ::close(fd);
+            for (int open_fd : fds) ::close(open_fd);
+            freeaddrinfo(address);
+            return false;
+        }
+        fds.push_back(fd);
+    }
+    freeaddrinfo(address);
+
+    for (size_t i = 0; i < loops_.size(); ++i) {
+        EventLoop* loop = loops_[i];
+        int fd = fds[i];
+        loop->post([this, loop, fd] {
+            loop->watch(fd, EPOLLIN, [this, loop, fd](uint32_t) { accept(fd, *loop); });
+        });
+    }
+    listen_fds_.insert(listen_fds_.end(), fds.begin(), fds.end());
+    return true;
+}
+
+void EventServer::accept(int listen_fd, EventLoop& loop) {
+    while (true) {
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::make_shared<HttpConnection>(*this, loop, fd)->start();
+    }
+}
+
+void EventServer::dispatch(HttpRequest& request, const HttpReply& reply) const {
+    auto route = routes_.find({request.method, request.path});
+    if (route == routes_.end()) {
+        reply.send(404, "application/json", errorBody("Not found"));
+        return;
+    }
+    route->second(request, reply);
+}
@@ -1,132 +1,1274 @@
 #include "consistent_hash.h"
 #include "circuit_breaker.h"
+#include "tensor_protocol.h"
+#include "sharded_cache.h"
+#include "load_tracker.h"
+#include "object_pool.h"
+#include "batch_processor.h"
+#include "frame_stream.h"
+#include "stage_metrics.h"
+#include "completion.h"
+#include "event_server.h"
+#include "async_client.h"
 #include <iostream>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <thread>
 #include <optional>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 #include <httplib.h>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
 
+enum class RouteBy {
+    REQUEST_ID,  // spreads load evenly; repeats of an input scatter
+    CONTENT      // input digest: repeats of an input reach the same worker cache
+};
+
+enum class Balance {
+    NONE,     // always the ring owner
+    P2C,      // cheaper of the owner and its ring successor
+    BOUNDED   // first successor under load_factor x the average in-flight
+};
+
+struct GatewayOptions {
+    RouteBy route_by = RouteBy::REQUEST_ID;
+    Balance balance = Balance::NONE;
+    double load_factor = 1.25;  // bounded-load cap over the mean
+    size_t pool_size = 32;      // keep-alive connections per worker
+    size_t io_threads = 4;      // event loops driving the worker connections
+    size_t stream_threads = 8;  // /infer_stream relays to workers running at once
+    // total time for a request across all attempts; 0 = try nodes one after
+    // another, each with a fixed 5s timeout
+    std::chrono::milliseconds deadline{0};
+    double hedge_percentile = 0;  // with a deadline: duplicate to the next node after
+                                  // this percentile of the owner's latency, 0 = off
+    size_t failover_fanout = 2;   // with a deadline: nodes retried at once per failover
+    // binary requests bound for one worker are sent together to its
+    // /infer_batch, up to this many; 0 = every request on its own
+    size_t batch_size = 0;
+    std::chrono::milliseconds batch_timeout{1};
+    size_t batch_workers = 4;     // batches in flight per worker
+    size_t cache_entries = 0;  // gateway response cache, 0 = off
+    // model -> the workers serving it, which get its requests on a ring of
+    // their own; a model not listed may go to any worker
+    std::map<std::string, std::vector<std::string>> model_workers;
+    // GET /health on every worker this often, 0 = off; a worker that fails
+    // health_failures probes in a row, or reports not ready, is tried only
+    // after the ready ones
+    std::chrono::milliseconds health_interval{1000};
+    int health_failures = 2;
+};
+
+// where a gateway request's time goes
+struct GatewayStages {
+    LatencyHistogram decode;        // frame header or JSON parse, plus the digest
+    LatencyHistogram cache_lookup;
+    LatencyHistogram forward;       // one worker attempt, send to last byte
+    LatencyHistogram serialize;     // re-encoding cache hits
+    LatencyHistogram request;       // whole /infer call
+};
+
+// A request the gateway turned away or could not serve, with the status to
+// answer it with: 400 malformed, 404 no worker serves its model, 429 or
+// 503 every worker shed it (sent with Retry-After), 500 otherwise.
+class RouteError : public std::runtime_error {
+public:
+    RouteError(int status, const std::string& message)
+        : std::runtime_error(message), status_(status) {}
+    int status() const { return status_; }
+
+private:
+    int status_;
+};
+
+// worker result kept by the gateway cache, re-encoded for every hit
+struct CachedResult {
+    std::vector<float> output;
+    std::string node_id;
+};
+
 class Gateway {
 public:
-    explicit Gateway(const std::vector<std::string>& workers) {
-        // consistent hash initialization
-        for (const auto& worker : workers) {
-            hash_ring_.addNode(worker);
-            // circuit breaker for each worker
-            circuit_breakers_[worker] = std::make_unique<CircuitBreaker>(
-                5,   // failure_threshold
-                2,   // success_threshold
-                std::chrono::seconds(30)
-            );
-            // HTTP client for each worker
-            auto url_parts = parseUrl(worker);
-            std::cout << "Parsed URL: " << worker << " -> host=" << url_parts.first 
-                      << " port=" << url_parts.second << std::endl;
-            
-            clients_[worker] = std::make_unique<httplib::Client>(
-                url_parts.first, url_parts.second
-            );
-            clients_[worker]->set_connection_timeout(5, 0);  
-            clients_[worker]->set_read_timeout(5, 0);
-            std::cout << "Connected to worker: " << worker << std::endl;
+    // gets the worker's response body, or the error that failed the request
+    using ResponseCallback = std::function<void(std::string* body, std::exception_ptr error)>;
+    
+    // workers named only in the model table are added to the pool as well
+    explicit Gateway(const std::vector<std::string>& workers,
+                     const GatewayOptions& options = GatewayOptions())
+        : options_(options), io_(options.io_threads), loops_(io_.loops()),
+          relays_(std::max<size_t>(1, options.stream_threads)), membership_thread_(1) {
+        if (options_.cache_entries > 0) {
+            cache_ = std::make_unique<ShardedCache<std::shared_ptr<const CachedResult>>>(
+                options_.cache_entries, 16);
+        }
+        tables_.push_back(std::make_unique<const WorkerTable>());
+        workers_.store(tables_.back().get(), std::memory_order_release);
+        std::vector<std::string> all_workers = workers;
+        for (const auto& [model, hosts] : options_.model_workers) {
+            model_rings_[model] = std::make_unique<ConsistentHash>();
+            for (const auto& host : hosts) {
+                if (std::find(all_workers.begin(), all_workers.end(), host) == all_workers.end()) {
+                    all_workers.push_back(host);
+                }
+            }
+        }
+        // the starting workers take requests before their first probe
+        for (const auto& worker : all_workers) {
+            std::vector<std::string> models;
+            for (const auto& [model, hosts] : options_.model_workers) {
+                if (std::find(hosts.begin(), hosts.end(), worker) != hosts.end()) {
+                    models.push_back(model);
+                }
+            }
+            std::lock_guard<std::mutex> lock(membership_mutex_);
+            enroll(worker, models, true);
+        }
+        io_.start();
+        if (options_.health_interval.count() > 0) {
+            health_thread_ = std::thread([this] { healthLoop(); });
+        }
+    }
+    
+    ~Gateway() {
+        {
+            std::lock_guard<std::mutex> lock(health_mutex_);
+            stopping_ = true;
+        }
+        health_cv_.notify_all();
+        if (health_thread_.joinable()) {
+            health_thread_.join();
+        }
+        // relays and membership changes use the workers and the loops;
+        // queued ones still run
+        membership_thread_.shutdown();
+        relays_.shutdown();
+        // batch threads wait on the loops, so they stop first
+        for (auto& [name, worker] : worker_states_) {
+            worker->batcher.reset();
+        }
+        io_.stop();
+        io_.join();
+    }
+    
+    // Adds a worker without a restart: to every worker's ring, and to the
+    // rings of the listed models, which must have a --model list. With
+    // health checks on, it is tried after the ready workers until a probe
+    // (sent at once) finds it ready. False if it already was a member; it
+    // still joins the models' rings.
+    bool addWorker(const std::string& worker, const std::vector<std::string>& models) {
+        for (const auto& model : models) {
+            if (!model_rings_.count(model)) {
+                throw std::invalid_argument("Model " + model + " has no worker list; give it one with --model");
+            }
+        }
+        bool added;
+        {
+            std::lock_guard<std::mutex> lock(membership_mutex_);
+            added = enroll(worker, models, options_.health_interval.count() == 0);
+        }
+        if (added) {
+            std::cout << "Worker added: " << worker << std::endl;
+            wakeHealthCheck();
+        }
+        return added;
+    }
+    
+    // Takes a worker out of every ring. Requests already sent to it finish;
+    // its connections and counters are kept in case it comes back. False if
+    // it was not a member.
+    bool removeWorker(const std::string& worker) {
+        std::lock_guard<std::mutex> lock(membership_mutex_);
+        const WorkerTable& current = workerTable();
+        if (!current.count(worker)) {
+            return false;
         }
+        hash_ring_.removeNode(worker);
+        for (auto& [model, ring] : model_rings_) {
+            ring->removeNode(worker);
+        }
+        // after the rings, so a node a ring returns is in the table
+        WorkerTable table = current;
+        table.erase(worker);
+        publishTable(std::move(table));
+        std::cout << "Worker removed: " << worker << std::endl;
+        return true;
+    }
+    
+    // Runs change on a thread of the gateway's, one after another, for
+    // callers that must not block: adding a worker resolves its address and
+    // rebuilds rings. ~Gateway runs the queued ones before it stops.
+    void offMembershipThread(std::function<void()> change) {
+        membership_thread_.enqueue(std::move(change));
     }
     
-    json routeRequest(const json& request) {
-        std::string request_id = request["request_id"];
-        // target node using consistent hashing
-        std::string target_node = hash_ring_.getNode(request_id);
-        if (target_node.empty()) {
-            throw std::runtime_error("No workers available");
+    std::vector<std::string> workerNames() const { return hash_ring_.getAllNodes(); }
+    
+    // the loops forwarding requests; a front end serving on them keeps each
+    // request on one thread from client to worker and back
+    std::vector<EventLoop*> ioLoops() const { return io_.loops(); }
+    // blocks until the io loops stop
+    void join() { io_.join(); }
+    
+    // Decodes only what routing needs: the request_id, the model and, for
+    // content routing or the cache, the input digest. A binary payload is
+    // hashed in place; a JSON one as floats, so both forms of an input
+    // digest alike. done runs when a worker has answered, without a thread
+    // waiting on it.
+    void handleInferAsync(std::string body, bool binary, ResponseCallback done) {
+        auto timer = std::make_shared<StageTimer>(stages_.request);
+        auto in_flight = std::make_shared<GaugeScope>(requests_in_flight_);
+        std::string request_id;
+        std::string model;
+        std::optional<ContentDigest> digest;
+        try {
+            StageTimer decode(stages_.decode);
+            if (binary) {
+                TensorFrame frame;
+                decodeTensorFrame(body.data(), body.size(), frame);
+                request_id = frame.request_id;
+                model = frame.model;
+                if (needsDigest()) {
+                    digest = forModel(
+                        digestBytes(frame.payload, frame.payload_bytes, payloadDigestSeed(frame.dtype)), model);
+                }
+            } else {
+                auto request = json::parse(body);
+                request_id = request["request_id"];
+                model = request.value("model", "");
+                if (needsDigest()) {
+                    auto input = request["input_data"].get<std::vector<float>>();
+                    digest = forModel(digestFloats(input.data(), input.size()), model);
+                }
+            }
+        } catch (const std::exception& e) {
+            done(nullptr, std::make_exception_ptr(RouteError(400, std::string("Malformed request: ") + e.what())));
+            return;
+        }
+        inferAsync(request_id, model, digest, std::make_shared<const std::string>(std::move(body)),
+                   binary ? kTensorContentType : kJsonContentType,
+                   [timer, in_flight, done = std::move(done)](std::string* response, std::exception_ptr error) {
+                       timer->stop();
+                       done(response, error);
+                   });
+    }
+    
+    // model is the one the request names, empty for the default; digest is
+    // the (model, input) digest, or nullopt when neither content routing nor
+    // the cache needs it (see needsDigest)
+    void inferAsync(const std::string& request_id,
+                    const std::string& model,
+                    const std::optional<ContentDigest>& digest,
+                    std::shared_ptr<const std::string> body,
+                    const std::string& content_type,
+                    ResponseCallback done) {
+        total_requests_++;
+        if (cache_ && digest) {
+            StageTimer lookup(stages_.cache_lookup);
+            auto cached = cache_->get(*digest);
+            lookup.stop();
+            if (cached.has_value()) {
+                cache_hits_++;
+                StageTimer serialize(stages_.serialize);
+                std::string response = encodeCached(**cached, request_id, content_type);
+                serialize.stop();
+                done(&response, nullptr);
+                return;
+            }
+        }
+        std::string routing_key = request_id;
+        if (options_.route_by == RouteBy::CONTENT && digest) {
+            routing_key = digestKey(*digest);
+        }
+        ResponseCallback finish = [this, digest, content_type, done = std::move(done)](
+                std::string* response, std::exception_ptr error) {
+            if (response && cache_ && digest) {
+                try {
+                    cache_->put(*digest, decodeResult(*response, content_type));
+                } catch (const std::exception& e) {
+                    std::cerr << "Not caching unreadable worker response: " << e.what() << std::endl;
+                }
+            }
+            done(response, error);
+        };
+        if (options_.batch_size == 0 || !isTensorContentType(content_type)) {
+            routeRequestAsync(model, routing_key, std::move(body), content_type, std::move(finish));
+        } else {
+            routeBatchedAsync(model, routing_key, std::move(body), std::move(finish));
         }
-        // primary node with circuit breaker
-        auto result = tryNode(target_node, request);
-        if (result.has_value()) {
-            return *result;
+    }
+    
+    bool needsDigest() const {
+        return options_.route_by == RouteBy::CONTENT || cache_ != nullptr;
+    }
+    
+    // Bulk body of request frames in, response frames out as they complete.
+    // Cache hits are answered here; the rest are grouped by target worker and
+    // each group is streamed through that worker's /infer_stream at once,
+    // relaying response frames as they arrive. Requests a worker leaves
+    // unanswered, or answers with an error frame, are retried alone with the
+    // usual failover, and get an error frame only if that fails too.
+    std::shared_ptr<FrameStream> inferStream(const std::string& body) {
+        std::vector<StreamedRequest> requests;
+        for (size_t offset = 0; offset < body.size();) {
+            TensorFrame frame;
+            size_t length = decodeTensorFrame(body.data() + offset, body.size() - offset, frame);
+            if (frame.kind != FrameKind::REQUEST) {
+                throw std::runtime_error("Expected a request frame");
+            }
+            StreamedRequest request;
+            request.request_id = frame.request_id;
+            request.model = frame.model;
+            request.routing_key = frame.request_id;
+            request.frame = body.substr(offset, length);
+            if (needsDigest()) {
+                request.digest = forModel(
+                    digestBytes(frame.payload, frame.payload_bytes, payloadDigestSeed(frame.dtype)), request.model);
+                if (options_.route_by == RouteBy::CONTENT) {
+                    request.routing_key = digestKey(*request.digest);
+                }
+            }
+            requests.push_back(std::move(request));
+            offset += length;
         }
-        // primary failed
-        auto all_nodes = hash_ring_.getAllNodes();
-        for (const auto& node : all_nodes) {
-            if (node != target_node) {
-                auto retry_result = tryNode(node, request);
-                if (retry_result.has_value()) {
-                    return *retry_result;
+        total_requests_ += requests.size();
+        auto stream = std::make_shared<FrameStream>(requests.size());
+        
+        std::string hits;
+        size_t hit_count = 0;
+        std::map<const std::string*, std::vector<StreamedRequest>> groups;
+        for (auto& request : requests) {
+            if (cache_ && request.digest) {
+                auto cached = cache_->get(*request.digest);
+                if (cached.has_value()) {
+                    cache_hits_++;
+                    hits.append(encodeCached(**cached, request.request_id, kTensorContentType));
+                    hit_count++;
+                    continue;
                 }
             }
+            std::vector<const std::string*> order = routeOrder(request.model, request.routing_key);
+            if (order.empty()) {
+                appendErrorFrame(hits, request.request_id, "");
+                hit_count++;
+                continue;
+            }
+            groups[order[0]].push_back(std::move(request));
+        }
+        if (hit_count > 0) {
+            stream->push(std::move(hits), hit_count);
         }
-        throw std::runtime_error("All workers failed or circuit breakers open");
+        // with --deadline-ms the whole call has that budget on each worker
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        if (options_.deadline.count() > 0) {
+            deadline = std::chrono::steady_clock::now() + options_.deadline;
+        }
+        // the relays outlive this call, not the gateway: ~Gateway joins them
+        for (auto& [node, group] : groups) {
+            auto moved = std::make_shared<std::vector<StreamedRequest>>(std::move(group));
+            relays_.enqueue([this, node = node, moved, stream, deadline] {
+                relayStream(*node, std::move(*moved), deadline, stream);
+            });
+        }
+        return stream;
     }
     
+    // Forwards the client body unchanged and hands back the worker's body
+    // unchanged, so neither side of the gateway is re-serialized. Runs on an
+    // event loop: the owner on the model's ring first, the ring successors on
+    // failure, hedges and the deadline as timers.
+    void routeRequestAsync(const std::string& model,
+                           const std::string& routing_key,
+                           std::shared_ptr<const std::string> body,
+                           const std::string& content_type,
+                           ResponseCallback done) {
+        // target node using consistent hashing, then the ring successors
+        // for failover, reordered by load when balancing is on
+        std::vector<const std::string*> order = routeOrder(model, routing_key);
+        if (order.empty()) {
+            done(nullptr, std::make_exception_ptr(RouteError(503, "No workers available")));
+            return;
+        }
+        auto route = std::make_shared<Route>();
+        route->loop = &ioLoop();
+        route->order = std::move(order);
+        route->body = std::move(body);
+        route->content_type = content_type;
+        route->done = std::move(done);
+        if (route->loop->inLoopThread()) {
+            startRoute(route);
+        } else {
+            route->loop->post([this, route] { startRoute(route); });
+        }
+    }
+    
+    // blocking form, for callers already on a thread of their own
+    std::string routeRequest(const std::string& model,
+                             const std::string& routing_key,
+                             const std::string& body,
+                             const std::string& content_type) {
+        auto shared_body = std::make_shared<const std::string>(body);
+        return awaitCompletion<std::string>([&](ResponseCallback done) {
+            routeRequestAsync(model, routing_key, shared_body, content_type, std::move(done));
+        });
+    }
+    
+    size_t workerCount() const { return hash_ring_.nodeCount(); }
+    
     json getStats() {
         json stats;
-        stats["total_workers"] = hash_ring_.getAllNodes().size();
+        const WorkerTable& workers = workerTable();
+        stats["total_workers"] = workers.size();
         json circuit_states = json::array();
-        for (const auto& [node, breaker] : circuit_breakers_) {
+        for (const auto& [node, worker] : workers) {
             json state;
             state["node"] = node;
-            state["state"] = breaker->getStateString();
-            state["failures"] = breaker->getFailureCount();
-            state["successes"] = breaker->getSuccessCount();
+            state["state"] = worker->breaker.getStateString();
+            state["failures"] = worker->breaker.getFailureCount();
+            state["successes"] = worker->breaker.getSuccessCount();
+            state["in_flight"] = worker->load.inFlight();
+            state["ewma_latency_us"] = worker->load.ewmaLatencyUs();
+            state["ready"] = worker->ready.load();
+            state["reported_in_flight"] = worker->load.reportedInFlight();
+            state["probe_failures"] = worker->probes_failed.load();
+            size_t open = worker->clients->created();
+            size_t idle = worker->clients->idle();
+            for (const auto& [loop, client] : worker->async_clients) {
+                open += client->openConnections();
+                idle += client->idleConnections();
+            }
+            state["connections_open"] = open;
+            state["connections_idle"] = idle;
             circuit_states.push_back(state);
         }
         stats["circuit_breakers"] = circuit_states;
+        stats["health_interval_ms"] = options_.health_interval.count();
+        stats["route_by"] = options_.route_by == RouteBy::CONTENT ? "content" : "request_id";
+        stats["balance"] = balanceName(options_.balance);
+        if (!model_rings_.empty()) {
+            json models = json::object();
+            for (const auto& [model, ring] : model_rings_) {
+                models[model] = ring->getAllNodes();
+            }
+            stats["models"] = models;
+        }
+        if (options_.batch_size > 0) {
+            json batching;
+            batching["max_batch_size"] = options_.batch_size;
+            batching["fallbacks"] = batch_fallbacks_.load();
+            json per_worker = json::object();
+            for (const auto& [node, worker] : workers) {
+                auto metrics = worker->batcher->getMetrics();
+                json worker_stats;
+                worker_stats["total_batches"] = metrics.total_batches;
+                worker_stats["avg_batch_size"] = metrics.avg_batch_size;
+                per_worker[node] = worker_stats;
+            }
+            batching["workers"] = per_worker;
+            stats["batching"] = batching;
+        }
+        if (options_.deadline.count() > 0) {
+            stats["deadline_ms"] = options_.deadline.count();
+            stats["hedge_percentile"] = options_.hedge_percentile;
+            stats["hedges_sent"] = hedges_sent_.load();
+            stats["deadline_exceeded"] = deadline_exceeded_.load();
+        }
+        stats["total_requests"] = total_requests_.load();
+        stats["backpressure"] = backpressure_.load();
+        if (cache_) {
+            json cache;
+            cache["hits"] = cache_hits_.load();
+            cache["size"] = cache_->size();
+            cache["capacity"] = cache_->capacity();
+            cache["hit_rate"] = cache_->getHitRate();
+            stats["cache"] = cache;
+        }
         return stats;
     }
     
+    std::string getMetrics() {
+        PrometheusWriter out;
+        const std::string stage_help = "Time spent per gateway stage";
+        const char* stage_name = "gateway_stage_duration_seconds";
+        out.summary(stage_name, stage_help, stages_.decode, "stage=\"decode\"");
+        out.summary(stage_name, stage_help, stages_.cache_lookup, "stage=\"cache_lookup\"");
+        out.summary(stage_name, stage_help, stages_.forward, "stage=\"forward\"");
+        out.summary(stage_name, stage_help, stages_.serialize, "stage=\"serialize\"");
+        out.summary(stage_name, stage_help, stages_.request, "stage=\"request\"");
+        out.gauge("gateway_requests_in_flight", "Client requests being served", requests_in_flight_.load());
+        const WorkerTable& workers = workerTable();
+        out.gauge("gateway_workers", "Workers in the pool", static_cast<int64_t>(workers.size()));
+        for (const auto& [node, worker] : workers) {
+            std::string label = "worker=\"" + node + "\"";
+            out.gauge("gateway_worker_in_flight", "Requests in flight to a worker", worker->load.inFlight(), label);
+        }
+        for (const auto& [node, worker] : workers) {
+            std::string label = "worker=\"" + node + "\"";
+            out.gauge("gateway_worker_latency_ewma_seconds", "Smoothed worker response time",
+                      worker->load.ewmaLatencyUs() / 1e6, label);
+        }
+        for (const auto& [node, worker] : workers) {
+            std::string label = "worker=\"" + node + "\"";
+            out.gauge("gateway_worker_breaker_open", "1 while the worker's circuit breaker is open",
+                      worker->breaker.getState() == CircuitState::OPEN ? 1 : 0, label);
+        }
+        for (const auto& [node, worker] : workers) {
+            std::string label = "worker=\"" + node + "\"";
+            out.gauge("gateway_worker_ready", "1 while health checks find the worker ready",
+                      worker->ready.load() ? 1 : 0, label);
+        }
+        for (const auto& [node, worker] : workers) {
+            std::string label = "worker=\"" + node + "\"";
+            out.gauge("gateway_worker_reported_in_flight", "Requests the worker reported in flight, from every client",
+                      worker->load.reportedInFlight(), label);
+        }
+        for (const auto& [node, worker] : workers) {
+            if (!worker->batcher) continue;
+            std::string label = "worker=\"" + node + "\"";
+            out.gauge("gateway_batch_queue_depth", "Requests waiting for a gateway batch",
+                      worker->batcher->getMetrics().queue_depth, label);
+        }
+        for (const auto& [node, worker] : workers) {
+            std::string label = "worker=\"" + node + "\"";
+            out.counter("gateway_worker_probe_failures_total", "Health checks the worker failed",
+                        worker->probes_failed.load(), label);
+        }
+        out.counter("gateway_requests_total", "Requests received", total_requests_.load());
+        out.counter("gateway_cache_hits_total", "Requests answered from the gateway cache", cache_hits_.load());
+        out.counter("gateway_hedges_sent_total", "Duplicate attempts sent after the hedge delay",
+                    hedges_sent_.load());
+        out.counter("gateway_deadline_exceeded_total", "Requests that ran out of deadline",
+                    deadline_exceeded_.load());
+        out.counter("gateway_batch_fallbacks_total", "Batched requests resent on their own",
+                    batch_fallbacks_.load());
+        out.counter("gateway_backpressure_total", "Attempts a worker rejected as busy (429/503)",
+                    backpressure_.load());
+        return out.str();
+    }
+    
+    static const char* balanceName(Balance balance) {
+        switch (balance) {
+            case Balance::P2C: return "p2c";
+            case Balance::BOUNDED: return "bounded";
+            default: return "none";
+        }
+    }
+    
 private:
-    std::optional<json> tryNode(const std::string& node, const json& request) {
-        auto breaker_it = circuit_breakers_.find(node);
-        if (breaker_it == circuit_breakers_.end()) {
-            return std::nullopt;
+    // the model's own ring when the table lists it, otherwise every worker's
+    const ConsistentHash& ringFor(const std::string& model) const {
+        auto it = model_rings_.find(model);
+        return it != model_rings_.end() ? *it->second : hash_ring_;
+    }
+    
+    // every node serving the model, in the order to try them; the pointers
+    // are owned by the ring. Nodes health checks find down or not ready go
+    // last, in ring order, and balancing picks among the ready ones.
+    std::vector<const std::string*> routeOrder(const std::string& model, const std::string& routing_key) {
+        const ConsistentHash& ring = ringFor(model);
+        std::vector<const std::string*> order(ring.nodeCount());
+        order.resize(ring.getSuccessors(routing_key, order.data(), order.size()));
+        const WorkerTable& workers = workerTable();
+        auto worker = [&workers](const std::string* node) { return workers.at(*node); };
+        // a node removed between the two lookups is dropped
+        order.erase(std::remove_if(order.begin(), order.end(),
+                                   [&workers](const std::string* node) { return !workers.count(*node); }),
+                    order.end());
+        auto unready = std::stable_partition(order.begin(), order.end(), [&](const std::string* node) {
+            return worker(node)->ready.load(std::memory_order_relaxed);
+        });
+        size_t candidates = unready == order.begin() ? order.size() : static_cast<size_t>(unready - order.begin());
+        if (candidates < 2 || options_.balance == Balance::NONE) {
+            return order;
         }
-        auto& breaker = breaker_it->second;
-        if (!breaker->allowRequest()) {
-            std::cout << "Circuit breaker OPEN for " << node << ", skipping" << std::endl;
-            return std::nullopt;
+        if (options_.balance == Balance::P2C) {
+            // the owner keeps ties, so affinity only breaks under real imbalance
+            if (worker(order[1])->load.cost() < worker(order[0])->load.cost()) {
+                std::swap(order[0], order[1]);
+            }
+            return order;
         }
-        auto client_it = clients_.find(node);
-        if (client_it == clients_.end()) {
-            breaker->recordFailure();
-            return std::nullopt;
+        // bounded load: no node takes more than load_factor x its fair share
+        // of the backlog on the model's nodes, counting this request
+        int64_t total = 1;
+        for (size_t i = 0; i < candidates; ++i) {
+            total += worker(order[i])->load.backlog();
         }
+        double cap = std::ceil(options_.load_factor * total / candidates);
+        for (size_t i = 0; i < candidates; ++i) {
+            if (worker(order[i])->load.backlog() + 1 <= cap) {
+                std::rotate(order.begin(), order.begin() + i, order.begin() + i + 1);
+                break;
+            }
+        }
+        return order;
+    }
+    
+    struct StreamedRequest {
+        std::string request_id;
+        std::string model;
+        std::string routing_key;
+        std::optional<ContentDigest> digest;
+        std::string frame;
+    };
+    
+    // A worker's error frames, shed requests' included, are not final: those
+    // requests are retried like the ones it left unanswered.
+    void relayStream(const std::string& node, std::vector<StreamedRequest> group,
+                     std::optional<std::chrono::steady_clock::time_point> deadline,
+                     const std::shared_ptr<FrameStream>& stream) {
+        // request_id -> requests not answered yet
+        std::unordered_map<std::string, std::vector<const StreamedRequest*>> unanswered;
+        std::string body;
+        for (const auto& request : group) {
+            unanswered[request.request_id].push_back(&request);
+            body.append(request.frame);
+        }
+        streamFromNode(node, body, deadline, [&](const char* data, size_t size) {
+            std::string out;
+            size_t count = 0;
+            for (size_t offset = 0; offset < size;) {
+                TensorFrame frame;
+                size_t length = decodeTensorFrame(data + offset, size - offset, frame);
+                auto it = unanswered.find(frame.request_id);
+                if (it != unanswered.end() && !it->second.empty() && !(frame.flags & kFrameFlagError)) {
+                    const StreamedRequest* request = it->second.back();
+                    it->second.pop_back();
+                    if (cache_ && request->digest) {
+                        cache_->put(*request->digest, decodeResult(
+                            std::string(data + offset, length), kTensorContentType));
+                    }
+                    out.append(data + offset, length);
+                    count++;
+                }
+                offset += length;
+            }
+            if (count > 0) {
+                stream->push(std::move(out), count);
+            }
+        });
         
+        for (auto& [request_id, requests] : unanswered) {
+            for (const StreamedRequest* request : requests) {
+                std::string out;
+                try {
+                    out = routeRequest(request->model, request->routing_key, request->frame, kTensorContentType);
+                    if (cache_ && request->digest) {
+                        cache_->put(*request->digest, decodeResult(out, kTensorContentType));
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Streamed request " << request_id << " failed: " << e.what() << std::endl;
+                    out.clear();
+                    appendErrorFrame(out, request_id, "");
+                }
+                stream->push(std::move(out), 1);
+            }
+        }
+    }
+    
+    // POSTs body to the node's /infer_stream and calls on_frames with every
+    // run of whole response frames as it arrives. False if the stream failed
+    // or was cut short; the breaker sees the outcome like any other request.
+    // The time left before deadline goes along as X-Deadline-Ms.
+    bool streamFromNode(const std::string& node, const std::string& body,
+                        std::optional<std::chrono::steady_clock::time_point> deadline,
+                        const std::function<void(const char*, size_t)>& on_frames) {
+        Worker* worker = findWorker(node);
+        if (!worker || !worker->breaker.allowRequest()) {
+            return false;
+        }
+        CircuitBreaker* breaker = &worker->breaker;
         try {
-            std::cout << "Sending request to " << node << std::endl;
+            NodeLoad::Scope in_flight(worker->load);
+            // a whole stream says nothing about per-request latency
+            in_flight.skipLatency();
+            auto client = worker->clients->acquire();
             
-            auto result = client_it->second->Post(
-                "/infer",
-                request.dump(),
-                "application/json"
-            );
-            if (result && result->status == 200) {
-                std::cout << "Success from " << node << std::endl;
-                breaker->recordSuccess();
-                return json::parse(result->body);
-            } else {
-                if (result) {
-                    std::cerr << "Request to " << node << " failed with status: " 
-                              << result->status << std::endl;
-                    if (!result->body.empty()) {
-                        std::cerr << "Response body: " << result->body << std::endl;
+            std::string pending;
+            bool malformed = false;
+            httplib::Request req;
+            req.method = "POST";
+            req.path = "/infer_stream";
+            req.headers.emplace("Content-Type", kTensorContentType);
+            if (deadline) {
+                auto now = Clock::now();
+                if (*deadline <= now) {
+                    return false;
+                }
+                auto budget_ms = std::max<int64_t>(1,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - now).count());
+                req.headers.emplace(kDeadlineHeader, std::to_string(budget_ms));
+            }
+            req.body = body;
+            req.response_handler = [](const httplib::Response& response) {
+                return response.status == 200;
+            };
+            req.content_receiver = [&](const char* data, size_t size, uint64_t, uint64_t) {
+                pending.append(data, size);
+                try {
+                    size_t whole = 0;
+                    while (size_t length = tensorFrameSize(pending.data() + whole,
+                                                           pending.size() - whole)) {
+                        whole += length;
                     }
-                } else {
-                    std::cerr << "Request to " << node << " failed: no response" << std::endl;
-                    auto err = result.error();
-                    std::cerr << "Error: " << httplib::to_string(err) << std::endl;
+                    if (whole > 0) {
+                        on_frames(pending.data(), whole);
+                        pending.erase(0, whole);
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Bad frame in stream from " << node << ": " << e.what() << std::endl;
+                    malformed = true;
+                    return false;
                 }
+                return true;
+            };
+            httplib::Response res;
+            httplib::Error error = httplib::Error::Success;
+            bool sent = client->send(req, res, error);
+            if (isBackpressure(res.status)) {
+                backpressure_++;
+                std::cout << node << " busy (" << res.status << "), skipping" << std::endl;
+                return false;
+            }
+            if (res.status == 404) {
+                std::cerr << node << " does not serve the model, skipping" << std::endl;
+                return false;
+            }
+            if (!sent || res.status != 200 || malformed || !pending.empty()) {
+                std::cerr << "Stream from " << node << " failed: "
+                          << (sent ? "status " + std::to_string(res.status) : httplib::to_string(error))
+                          << std::endl;
                 breaker->recordFailure();
-                return std::nullopt;
+                return false;
             }
+            breaker->recordSuccess();
+            return true;
         } catch (const std::exception& e) {
-            std::cerr << "Request to " << node << " failed: " << e.what() << std::endl;
+            std::cerr << "Stream from " << node << " failed: " << e.what() << std::endl;
             breaker->recordFailure();
-            return std::nullopt;
+            return false;
         }
     }
     
+    // frame bodies stay owned by their requests' completions
+    using Batcher = BatchProcessor<const std::string*, std::string>;
+    using Clock = std::chrono::steady_clock;
+    // per attempt, when there is no request deadline
+    static constexpr std::chrono::seconds kAttemptTimeout{5};
+    // longest a health check waits for a worker
+    static constexpr std::chrono::milliseconds kProbeTimeout{1000};
+    
+    // Everything the gateway keeps for one worker. Made when the worker is
+    // first added and kept until the gateway goes, so a request holding one
+    // stays valid if the worker is removed meanwhile, and a worker that
+    // comes back gets its connections and counters again.
+    struct Worker {
+        std::string name;
+        CircuitBreaker breaker{5, 2, std::chrono::seconds(30)};
+        NodeLoad load;
+        // per loop, each driven by its own loop; fixed once made
+        std::unordered_map<EventLoop*, std::unique_ptr<AsyncHttpClient>> async_clients;
+        // for /infer_stream only
+        std::unique_ptr<ObjectPool<httplib::Client>> clients;
+        std::unique_ptr<Batcher> batcher;  // only with batching
+        // false while health checks find it down or not ready
+        std::atomic<bool> ready{true};
+        std::atomic<int64_t> probes_failed{0};
+        // health checks only, one connection on one loop
+        std::unique_ptr<AsyncHttpClient> probe;
+        int failed_in_a_row = 0;  // one probe at a time, so never contended
+    };
+    // member name -> worker, immutable once published
+    using WorkerTable = std::map<std::string, Worker*>;
+    
+    // The members, lock-free: every change publishes a new table with one
+    // atomic store, and superseded tables are kept like the ring's
+    // snapshots, so a reference stays valid for the gateway's lifetime.
+    const WorkerTable& workerTable() const {
+        return *workers_.load(std::memory_order_acquire);
+    }
+    
+    // a member, or null
+    Worker* findWorker(const std::string& node) const {
+        const WorkerTable& workers = workerTable();
+        auto it = workers.find(node);
+        return it != workers.end() ? it->second : nullptr;
+    }
+    
+    // caller holds membership_mutex_
+    void publishTable(WorkerTable table) {
+        tables_.push_back(std::make_unique<const WorkerTable>(std::move(table)));
+        workers_.store(tables_.back().get(), std::memory_order_release);
+    }
+    
+    // Makes the worker a member and puts it on the rings; ready says whether
+    // it takes requests before a probe. False if it already was a member.
+    // Caller holds membership_mutex_.
+    bool enroll(const std::string& name, const std::vector<std::string>& models, bool ready) {
+        bool added = false;
+        if (!workerTable().count(name)) {
+            auto& state = worker_states_[name];
+            if (!state) {
+                state = makeWorker(name);
+            }
+            state->ready.store(ready);
+            // the table first, so a node a ring returns is in it
+            WorkerTable table = workerTable();
+            table[name] = state.get();
+            publishTable(std::move(table));
+            added = true;
+        }
+        hash_ring_.addNode(name);
+        for (const auto& model : models) {
+            model_rings_.at(model)->addNode(name);
+        }
+        return added;
+    }
+    
+    std::unique_ptr<Worker> makeWorker(const std::string& name) {
+        auto worker = std::make_unique<Worker>();
+        worker->name = name;
+        if (options_.batch_size > 0) {
+            worker->batcher = std::make_unique<Batcher>(
+                options_.batch_size,
+                options_.batch_timeout,
+                [this, name](const std::vector<const std::string*>& bodies) {
+                    return forwardBatch(name, bodies);
+                },
+                options_.batch_workers);
+            worker->batcher->start();
+        }
+        // pool of keep-alive HTTP clients for each worker, opened on
+        // demand, so concurrent requests do not queue on one socket
+        auto url_parts = parseUrl(name);
+        std::cout << "Parsed URL: " << name << " -> host=" << url_parts.first
+                  << " port=" << url_parts.second << std::endl;
+        
+        // each loop gets its share of the pool, so requests are
+        // forwarded from the loop that took them in
+        size_t loops = loops_.size();
+        size_t per_loop = std::max<size_t>(1, (options_.pool_size + loops - 1) / loops);
+        for (EventLoop* loop : loops_) {
+            worker->async_clients[loop] = std::make_unique<AsyncHttpClient>(
+                *loop, url_parts.first, url_parts.second, per_loop);
+        }
+        // blocking clients for /infer_stream, which relays from a thread
+        worker->clients = std::make_unique<ObjectPool<httplib::Client>>(
+            options_.pool_size,
+            [host = url_parts.first, port = url_parts.second] {
+                auto client = std::make_unique<httplib::Client>(host, port);
+                client->set_keep_alive(true);
+                client->set_connection_timeout(5, 0);
+                client->set_read_timeout(5, 0);
+                return client;
+            });
+        worker->probe = std::make_unique<AsyncHttpClient>(io_.next(), url_parts.first, url_parts.second, 1);
+        std::cout << "Connection pool for worker: " << name
+                  << " (" << per_loop << " connections x " << loops << " loops)" << std::endl;
+        return worker;
+    }
+    
+    // Probes every member at once on the io loops, so a worker that does
+    // not answer holds up no other's check; waits for all of them, at most
+    // the probe timeout, then waits out the interval or a wake-up.
+    void healthLoop() {
+        auto probe_timeout = std::min(options_.health_interval, std::chrono::milliseconds(kProbeTimeout));
+        std::unique_lock<std::mutex> lock(health_mutex_);
+        while (!stopping_) {
+            probe_now_ = false;
+            lock.unlock();
+            const WorkerTable& workers = workerTable();
+            CountdownLatch latch(workers.size());
+            auto deadline = Clock::now() + probe_timeout;
+            for (const auto& [name, worker] : workers) {
+                worker->probe->get("/health", deadline, [this, worker = worker, &latch](HttpResult& response) {
+                    recordProbe(*worker, response);
+                    latch.countDown();
+                });
+            }
+            latch.wait();
+            lock.lock();
+            health_cv_.wait_for(lock, options_.health_interval, [this] { return stopping_ || probe_now_; });
+        }
+    }
+    
+    // a membership change probes at once rather than at the next interval
+    void wakeHealthCheck() {
+        {
+            std::lock_guard<std::mutex> lock(health_mutex_);
+            probe_now_ = true;
+        }
+        health_cv_.notify_all();
+    }
+    
+    // The outcome of one GET /health, on the probe's loop. An answer sets
+    // the worker's readiness and its own in-flight count, and a ready
+    // worker's open breaker goes half-open at once; health_failures
+    // unanswered probes in a row mark it not ready.
+    void recordProbe(Worker& worker, const HttpResult& response) {
+        json health;
+        if (response.ok && response.status == 200) {
+            health = json::parse(response.body, nullptr, false);
+        }
+        if (!health.is_object()) {
+            worker.probes_failed++;
+            if (++worker.failed_in_a_row >= options_.health_failures && worker.ready.exchange(false)) {
+                std::cerr << "Health check: " << worker.name << " is down, trying it last" << std::endl;
+            }
+            return;
+        }
+        worker.failed_in_a_row = 0;
+        bool ready = health.value("ready", false);
+        worker.load.setReportedInFlight(health.value("requests_in_flight", int64_t(0)));
+        if (ready) {
+            worker.breaker.recordProbeSuccess();
+        }
+        if (worker.ready.exchange(ready) != ready) {
+            std::cout << "Health check: " << worker.name << (ready ? " is ready" : " is not ready, trying it last")
+                      << std::endl;
+        }
+    }
+    
+    // Queues the request on its target worker's batcher. If the batch fails
+    // the request is routed on its own, with the usual failover.
+    void routeBatchedAsync(const std::string& model,
+                           const std::string& routing_key,
+                           std::shared_ptr<const std::string> body,
+                           ResponseCallback done) {
+        std::vector<const std::string*> order = routeOrder(model, routing_key);
+        if (order.empty()) {
+            done(nullptr, std::make_exception_ptr(std::runtime_error("No workers available")));
+            return;
+        }
+        Worker* worker = findWorker(*order[0]);
+        if (!worker) {
+            routeRequestAsync(model, routing_key, std::move(body), kTensorContentType, std::move(done));
+            return;
+        }
+        worker->batcher->submit(body.get(),
+            [this, model, routing_key, body, done = std::move(done)](
+                    std::string* response, std::exception_ptr error) {
+                if (response) {
+                    done(response, nullptr);
+                    return;
+                }
+                std::cerr << "Batched request failed (" << errorMessage(error)
+                          << "), sending it alone" << std::endl;
+                batch_fallbacks_++;
+                routeRequestAsync(model, routing_key, body, kTensorContentType, done);
+            });
+    }
+    
+    // one /infer_batch call for a batch; split back into one frame per request
+    std::vector<std::string> forwardBatch(const std::string& node,
+                                          const std::vector<const std::string*>& bodies) {
+        size_t total = 0;
+        for (const std::string* body : bodies) {
+            total += body->size();
+        }
+        auto batch = std::make_shared<std::string>();
+        batch->reserve(total);
+        for (const std::string* body : bodies) {
+            batch->append(*body);
+        }
+        // the batch thread waits; the requests in it do not hold threads
+        std::optional<std::string> result;
+        CountdownLatch latch(1);
+        bool started = tryNodeAsync(io_.next(), node, std::move(batch), kTensorContentType,
+            std::nullopt, "/infer_batch", [&result, &latch](std::optional<std::string>& response, int) {
+                result = std::move(response);
+                latch.countDown();
+            });
+        if (started) {
+            latch.wait();
+        }
+        if (!result) {
+            throw std::runtime_error("Batch to " + node + " failed");
+        }
+        std::vector<std::string> responses;
+        responses.reserve(bodies.size());
+        for (size_t offset = 0; offset < result->size();) {
+            TensorFrame frame;
+            size_t length = decodeTensorFrame(result->data() + offset, result->size() - offset, frame);
+            responses.push_back(result->substr(offset, length));
+            offset += length;
+        }
+        if (responses.size() != bodies.size()) {
+            throw std::runtime_error("Batch response from " + node + " has the wrong frame count");
+        }
+        return responses;
+    }
+    
+    // One client request's attempts, touched only on its loop. The first
+    // success wins; later results are dropped.
+    struct Route {
+        EventLoop* loop = nullptr;
+        std::vector<const std::string*> order;
+        size_t next = 0;      // first node in order not tried yet
+        int pending = 0;      // attempts in flight
+        bool finished = false;
+        std::shared_ptr<const std::string> body;
+        std::string content_type;
+        std::optional<Clock::time_point> deadline;
+        EventLoop::TimerId hedge_timer = 0;
+        EventLoop::TimerId deadline_timer = 0;
+        ResponseCallback done;
+        // what the workers that answered said, for the error if all fail
+        int answered = 0;
+        int shed = 0;           // 429 or 503
+        int missing_model = 0;  // 404
+        int shed_status = 0;    // the last 429 or 503
+    };
+    
+    // Sends to the owner. With a deadline: if the owner has not answered by
+    // its hedge percentile, the next successor gets a duplicate, and
+    // whenever every attempt so far has failed, the next failover_fanout
+    // successors are tried at once. Without one, nodes are tried one after
+    // another. Losing attempts are not cancelled but they never outlive the
+    // deadline.
+    void startRoute(const std::shared_ptr<Route>& route) {
+        if (options_.deadline.count() > 0) {
+            route->deadline = Clock::now() + options_.deadline;
+            route->deadline_timer = route->loop->runAfter(options_.deadline, [this, route] {
+                route->deadline_timer = 0;
+                if (!route->finished) {
+                    deadline_exceeded_++;
+                    finishRoute(*route, nullptr,
+                                std::make_exception_ptr(std::runtime_error("Deadline exceeded")));
+                }
+            });
+            Worker* owner = findWorker(*route->order[0]);
+            if (options_.hedge_percentile > 0 && route->order.size() > 1 && owner) {
+                int64_t hedge_us = owner->load.latencyQuantileUs(options_.hedge_percentile / 100.0);
+                if (hedge_us > 0) {
+                    route->hedge_timer = route->loop->runAfter(std::chrono::microseconds(hedge_us),
+                        [this, route] {
+                            route->hedge_timer = 0;
+                            if (!route->finished && route->next < route->order.size()) {
+                                hedges_sent_++;
+                                launchAttempts(route, 1);
+                            }
+                        });
+                }
+            }
+        }
+        launchAttempts(route, 1);
+    }
+    
+    // starts up to count attempts on the next untried nodes; nodes that
+    // cannot take one (breaker open, deadline gone) do not count
+    void launchAttempts(const std::shared_ptr<Route>& route, size_t count) {
+        while (count > 0 && route->next < route->order.size()) {
+            const std::string& node = *route->order[route->next++];
+            bool started = tryNodeAsync(*route->loop, node, route->body, route->content_type,
+                route->deadline, "/infer", [this, route](std::optional<std::string>& result, int status) {
+                    route->pending--;
+                    if (route->finished) {
+                        return;
+                    }
+                    if (status != 0 && !result) {
+                        route->answered++;
+                        if (isBackpressure(status)) {
+                            route->shed++;
+                            route->shed_status = status;
+                        } else if (status == 404) {
+                            route->missing_model++;
+                        }
+                    }
+                    if (result) {
+                        finishRoute(*route, &*result, nullptr);
+                    } else if (route->pending == 0) {
+                        launchAttempts(route, route->deadline ? options_.failover_fanout : 1);
+                    }
+                });
+            if (started) {
+                route->pending++;
+                count--;
+            }
+        }
+        if (route->pending == 0 && !route->finished) {
+            finishRoute(*route, nullptr, std::make_exception_ptr(routeFailure(*route)));
+        }
+    }
+    
+    // Every worker shedding is backpressure for the client too, and every
+    // worker lacking the model means the model is unknown; anything else
+    // (errors, open breakers, no answer) is the gateway's failure.
+    static RouteError routeFailure(const Route& route) {
+        if (route.answered > 0 && route.shed + route.missing_model == route.answered) {
+            if (route.shed > 0) {
+                return RouteError(route.shed_status, "All workers are busy");
+            }
+            return RouteError(404, "No worker serves the model");
+        }
+        return RouteError(500, "All workers failed or circuit breakers open");
+    }
+    
+    void finishRoute(Route& route, std::string* response, std::exception_ptr error) {
+        route.finished = true;
+        if (route.hedge_timer) {
+            route.loop->cancel(route.hedge_timer);
+        }
+        if (route.deadline_timer) {
+            route.loop->cancel(route.deadline_timer);
+        }
+        ResponseCallback done = std::move(route.done);
+        done(response, error);
+    }
+    
+    // the caller's loop when it is one of ours, so a request stays on the
+    // thread that accepted it; otherwise the next in turn
+    EventLoop& ioLoop() {
+        EventLoop* current = EventLoop::current();
+        if (current && std::find(loops_.begin(), loops_.end(), current) != loops_.end()) {
+            return *current;
+        }
+        return io_.next();
+    }
+    
+    // 503 while a worker warms up or cannot meet the deadline, 429 when its
+    // queue is full: the node is healthy but busy now
+    static bool isBackpressure(int status) {
+        return status == 503 || status == 429;
+    }
+    
+    // the cache and content routing key on (model, input): one input scored
+    // by two models is two entries
+    static ContentDigest forModel(ContentDigest digest, const std::string& model) {
+        if (!model.empty()) {
+            ContentDigest name = digestBytes(model.data(), model.size());
+            digest.lo ^= name.lo;
+            digest.hi ^= name.hi;
+        }
+        return digest;
+    }
+    
+    static std::string digestKey(const ContentDigest& digest) {
+        char key[33];
+        std::snprintf(key, sizeof(key), "%016llx%016llx",
+                      static_cast<unsigned long long>(digest.hi),
+                      static_cast<unsigned long long>(digest.lo));
+        return std::string(key, 32);
+    }
+    
+    static std::shared_ptr<const CachedResult> decodeResult(const std::string& response,
+                                                            const std::string& content_type) {
+        auto result = std::make_shared<CachedResult>();
+        if (isTensorContentType(content_type)) {
+            TensorFrame frame;
+            decodeTensorFrame(response.data(), response.size(), frame);
+            result->output = tensorFrameToFloats(frame);
+            result->node_id = frame.node_id;
+        } else {
+            auto parsed = json::parse(response);
+            result->output = parsed["output_data"].get<std::vector<float>>();
+            result->node_id = parsed.value("node_id", "");
+        }
+        return result;
+    }
+    
+    // same shape as a worker response, under the caller's request_id
+    static std::string encodeCached(const CachedResult& cached, const std::string& request_id,
+                                    const std::string& content_type) {
+        if (isTensorContentType(content_type)) {
+            TensorFrame frame;
+            frame.kind = FrameKind::RESPONSE;
+            frame.request_id = request_id;
+            frame.node_id = cached.node_id;
+            frame.flags = kFrameFlagCached;
+            frame.inference_time_us = 0;
+            return encodeTensorFrame(frame, cached.output.data(), cached.output.size());
+        }
+        json response;
+        response["request_id"] = request_id;
+        response["output_data"] = cached.output;
+        response["node_id"] = cached.node_id;
+        response["cached"] = true;
+        response["inference_time_us"] = 0;
+        return response.dump();
+    }
+    
+    // One attempt on node from loop's connections; done gets the body on a
+    // 200, nullopt otherwise, and the status the node answered with (0 if
+    // it did not), and always runs on loop. False, without calling done, if
+    // the attempt cannot start. deadline, when set, replaces the fixed
+    // per-attempt timeout.
+    bool tryNodeAsync(EventLoop& loop,
+                      const std::string& node,
+                      std::shared_ptr<const std::string> body,
+                      const std::string& content_type,
+                      std::optional<Clock::time_point> deadline,
+                      const char* path,
+                      std::function<void(std::optional<std::string>& result, int status)> done) {
+        Worker* worker = findWorker(node);
+        if (!worker) {
+            return false;
+        }
+        CircuitBreaker* breaker = &worker->breaker;
+        // runs on the loop for every attempt, so nothing here writes to
+        // stdout; skips and successes show in /stats and /metrics
+        if (!breaker->allowRequest()) {
+            return false;
+        }
+        auto client_it = worker->async_clients.find(&loop);
+        if (client_it == worker->async_clients.end()) {
+            breaker->recordFailure();
+            return false;
+        }
+        auto now = Clock::now();
+        auto until = deadline ? *deadline : now + kAttemptTimeout;
+        if (until <= now) {
+            return false;
+        }
+        
+        auto in_flight = std::make_shared<NodeLoad::Scope>(worker->load);
+        // the worker drops the request rather than run it after we stop waiting
+        auto budget_ms = std::max<int64_t>(1,
+            std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count());
+        HttpHeaders headers{{kDeadlineHeader, std::to_string(budget_ms)}};
+        client_it->second->post(path, std::move(body), content_type, headers, until,
+            [this, node, breaker, in_flight, now, done = std::move(done)](HttpResult& response) mutable {
+                stages_.forward.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - now).count());
+                std::optional<std::string> result;
+                if (response.ok && response.status == 200) {
+                    breaker->recordSuccess();
+                    result = std::move(response.body);
+                } else if (response.ok && isBackpressure(response.status)) {
+                    // warming up or shedding load: skip it without counting a failure
+                    in_flight->skipLatency();
+                    backpressure_++;
+                } else if (response.ok && response.status == 404) {
+                    // the node does not serve the request's model: misrouted, not unhealthy
+                    in_flight->skipLatency();
+                    std::cerr << node << " does not serve the model, skipping" << std::endl;
+                } else {
+                    if (response.ok) {
+                        std::cerr << "Request to " << node << " failed with status: "
+                                  << response.status << std::endl;
+                        if (!response.body.empty()) {
+                            std::cerr << "Response body: " << response.body << std::endl;
+                        }
+                    } else {
+                        std::cerr << "Request to " << node << " failed: " << response.error << std::endl;
+                    }
+                    breaker->recordFailure();
+                }
+                // the node's load drops before whatever done starts next
+                in_flight.reset();
+                done(result, response.ok ? response.status : 0);
+            });
+        return true;
+    }
+    
     std::pair<std::string, int> parseUrl(const std::string& url) {
         std::string cleaned_url = url;
         size_t proto_pos = cleaned_url.find("://");
@@ -153,48 +1295,396 @@ private:
         return {host, port};
     }
     
-    ConsistentHash hash_ring_;
-    std::map<std::string, std::unique_ptr<CircuitBreaker>> circuit_breakers_;
-    std::map<std::string, std::unique_ptr<httplib::Client>> clients_;
+    GatewayOptions options_;
+    ConsistentHash hash_ring_;  // every worker
+    std::map<std::string, std::unique_ptr<ConsistentHash>> model_rings_;  // per listed model
+    std::unique_ptr<ShardedCache<std::shared_ptr<const CachedResult>>> cache_;
+    std::atomic<int64_t> total_requests_{0};
+    std::atomic<int64_t> cache_hits_{0};
+    std::atomic<int64_t> hedges_sent_{0};
+    std::atomic<int64_t> batch_fallbacks_{0};
+    std::atomic<int64_t> deadline_exceeded_{0};
+    std::atomic<int64_t> backpressure_{0};  // attempts a busy worker turned away
+    std::atomic<int64_t> requests_in_flight_{0};
+    GatewayStages stages_;
+    // late attempts finish before the state they use is destroyed: the
+    // loops are stopped in ~Gateway, before any member goes
+    EventLoopGroup io_;
+    std::vector<EventLoop*> loops_;
+    // runs /infer_stream relays, which block on a pooled client; each one
+    // holds a thread for the whole stream, so they are capped
+    httplib::ThreadPool relays_;
+    httplib::ThreadPool membership_thread_;  // see offMembershipThread
+    // every worker ever added, members or not; their batchers are stopped
+    // first, in ~Gateway, and their clients go before the loops
+    std::map<std::string, std::unique_ptr<Worker>> worker_states_;
+    std::mutex membership_mutex_;  // add and remove only
+    std::atomic<const WorkerTable*> workers_{nullptr};
+    std::vector<std::unique_ptr<const WorkerTable>> tables_;  // current and retired
+    std::thread health_thread_;
+    std::mutex health_mutex_;
+    std::condition_variable health_cv_;
+    bool stopping_ = false;
+    bool probe_now_ = false;
 };
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <worker1:port> [worker2:port] ..." << std::endl;
-        std::cerr << "Example: " << argv[0] << " localhost:8001 localhost:8002 localhost:8003" << std::endl;
-        return 1;
+static std::string errorBody(const std::string& message) {
+    json error;
+    error["error"] = message;
+    return error.dump();
+}
+
+// a failed /infer's status: a RouteError's own, 500 for anything else
+static int errorStatus(std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const RouteError& e) {
+        return e.status();
+    } catch (...) {
+        return 500;
     }
-    
-    std::vector<std::string> workers;
-    for (int i = 1; i < argc; ++i) {
-        workers.push_back(argv[i]);
+}
+
+// shed requests tell the client when to come back, as the workers do
+static HttpHeaders errorHeaders(int status) {
+    if (status == 429 || status == 503) {
+        return {{"Retry-After", "1"}};
     }
-    
-    Gateway gateway(workers);
+    return {};
+}
+
+// POST /workers/add {"worker": "host:port", "models": [...]} or
+// POST /workers/remove {"worker": "host:port"}; the status and body to
+// answer with, 400 for a bad request
+static std::pair<int, std::string> changeMembership(Gateway& gateway, const std::string& body, bool add) {
+    try {
+        json request = json::parse(body);
+        if (!request.is_object() || !request.contains("worker") || !request["worker"].is_string() ||
+            request["worker"].get<std::string>().empty()) {
+            throw std::invalid_argument("Expected {\"worker\": \"host:port\"}");
+        }
+        std::string worker = request["worker"];
+        bool changed = add ? gateway.addWorker(worker, request.value("models", std::vector<std::string>()))
+                           : gateway.removeWorker(worker);
+        json reply;
+        reply["worker"] = worker;
+        reply["changed"] = changed;
+        reply["workers"] = gateway.workerNames();
+        return {200, reply.dump()};
+    } catch (const json::exception& e) {
+        return {400, errorBody(e.what())};
+    } catch (const std::invalid_argument& e) {
+        return {400, errorBody(e.what())};
+    } catch (const std::exception& e) {
+        return {500, errorBody(e.what())};
+    }
+}
+
+// httplib front end: every in-flight request holds a server thread, which
+// waits on the gateway's asynchronous path
+static void serveThreads(Gateway& gateway, size_t server_threads) {
     httplib::Server server;
+    server.new_task_queue = [server_threads] { return new httplib::ThreadPool(server_threads); };
     // inference endpoint
     server.Post("/infer", [&gateway](const httplib::Request& req, httplib::Response& res) {
         try {
-            auto request = json::parse(req.body);
-            auto response = gateway.routeRequest(request);
-            
-            res.set_content(response.dump(), "application/json");
+            bool binary = isTensorContentType(req.get_header_value("Content-Type"));
+            std::string body = awaitCompletion<std::string>([&](Gateway::ResponseCallback done) {
+                gateway.handleInferAsync(req.body, binary, std::move(done));
+            });
+            res.set_content(body, binary ? kTensorContentType : kJsonContentType);
+        } catch (const std::exception& e) {
+            res.status = errorStatus(std::current_exception());
+            for (const auto& [name, value] : errorHeaders(res.status)) {
+                res.set_header(name, value);
+            }
+            res.set_content(errorBody(e.what()), "application/json");
+        }
+    });
+    // bulk scoring: request frames in, response frames streamed back as chunks
+    // in completion order
+    server.Post("/infer_stream", [&gateway](const httplib::Request& req, httplib::Response& res) {
+        try {
+            if (!isTensorContentType(req.get_header_value("Content-Type"))) {
+                throw std::runtime_error("/infer_stream takes application/x-tensor frames");
+            }
+            auto stream = gateway.inferStream(req.body);
+            res.set_chunked_content_provider(
+                kTensorContentType,
+                [stream](size_t, httplib::DataSink& sink) {
+                    std::string chunk;
+                    if (!stream->next(chunk)) {
+                        sink.done();
+                        return true;
+                    }
+                    return sink.write(chunk.data(), chunk.size());
+                },
+                [stream](bool) { stream->close(); });
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
             res.status = 500;
-            res.set_content(error.dump(), "application/json");
+            res.set_content(errorBody(e.what()), "application/json");
         }
     });
+    // Prometheus scrape endpoint: per-stage latency quantiles and load gauges
+    server.Get("/metrics", [&gateway](const httplib::Request&, httplib::Response& res) {
+        res.set_content(gateway.getMetrics(), PrometheusWriter::kContentType);
+    });
     // stats endpoint
     server.Get("/stats", [&gateway](const httplib::Request&, httplib::Response& res) {
         auto stats = gateway.getStats();
         res.set_content(stats.dump(), "application/json");
     });
+    // membership, without a restart
+    server.Post("/workers/add", [&gateway](const httplib::Request& req, httplib::Response& res) {
+        auto [status, body] = changeMembership(gateway, req.body, true);
+        res.status = status;
+        res.set_content(body, "application/json");
+    });
+    server.Post("/workers/remove", [&gateway](const httplib::Request& req, httplib::Response& res) {
+        auto [status, body] = changeMembership(gateway, req.body, false);
+        res.status = status;
+        res.set_content(body, "application/json");
+    });
+    server.listen("0.0.0.0", 8000);
+}
+
+// epoll front end on the gateway's own io loops: a request is taken in,
+// forwarded and answered on one loop, and holds no thread while it waits.
+// An /infer_stream body is split, digested and looked up in the cache on a
+// pool of its own, so a big one does not stall the loop's other connections.
+static bool serveEvents(Gateway& gateway) {
+    httplib::ThreadPool bulk(gateway.ioLoops().size());
+    EventServer server(gateway.ioLoops());
+    server.handle("POST", "/infer", [&gateway](HttpRequest& req, HttpReply reply) {
+        bool binary = isTensorContentType(req.header("Content-Type"));
+        const char* content_type = binary ? kTensorContentType : kJsonContentType;
+        gateway.handleInferAsync(std::move(req.body), binary,
+            [reply, content_type](std::string* body, std::exception_ptr error) {
+                if (body) {
+                    reply.send(200, content_type, std::move(*body));
+                } else {
+                    int status = errorStatus(error);
+                    reply.send(status, "application/json", errorBody(errorMessage(error)), errorHeaders(status));
+                }
+            });
+    });
+    server.handle("POST", "/infer_stream", [&gateway, &bulk](HttpRequest& req, HttpReply reply) {
+        if (!isTensorContentType(req.header("Content-Type"))) {
+            reply.send(500, "application/json", errorBody("/infer_stream takes application/x-tensor frames"));
+            return;
+        }
+        bulk.enqueue([&gateway, body = std::move(req.body), reply] {
+            std::shared_ptr<FrameStream> stream;
+            try {
+                stream = gateway.inferStream(body);
+            } catch (const std::exception& e) {
+                reply.send(500, "application/json", errorBody(e.what()));
+                return;
+            }
+            reply.startStream(200, kTensorContentType);
+            stream->forwardTo([reply](std::string chunk, bool last) {
+                if (!chunk.empty()) {
+                    reply.write(std::move(chunk));
+                }
+                if (last) {
+                    reply.end();
+                }
+            });
+        });
+    });
+    server.handle("GET", "/metrics", [&gateway](HttpRequest&, HttpReply reply) {
+        reply.send(200, PrometheusWriter::kContentType, gateway.getMetrics());
+    });
+    server.handle("GET", "/stats", [&gateway](HttpRequest&, HttpReply reply) {
+        reply.send(200, "application/json", gateway.getStats().dump());
+    });
+    // a new worker's address is resolved and the rings rebuilt off the loop
+    for (bool add : {true, false}) {
+        server.handle("POST", add ? "/workers/add" : "/workers/remove",
+            [&gateway, add](HttpRequest& req, HttpReply reply) {
+                gateway.offMembershipThread([&gateway, add, body = std::move(req.body), reply] {
+                    auto [status, response] = changeMembership(gateway, body, add);
+                    reply.send(status, "application/json", std::move(response));
+                });
+            });
+    }
+    bool listening = server.listen("0.0.0.0", 8000);
+    if (listening) {
+        gateway.join();
+    }
+    bulk.shutdown();
+    return listening;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <worker1:port> [worker2:port] ... [options]" << std::endl;
+        std::cerr << "Example: " << argv[0] << " localhost:8001 localhost:8002 localhost:8003" << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --route-by request_id|content  routing key (default: request_id)" << std::endl;
+        std::cerr << "  --cache-entries N    gateway response cache, 0 = off (default: 0)" << std::endl;
+        std::cerr << "  --balance none|p2c|bounded  load-aware node choice (default: none)" << std::endl;
+        std::cerr << "  --load-factor X      bounded-load cap over the mean (default: 1.25)" << std::endl;
+        std::cerr << "  --batch N            batch binary requests per worker via /infer_batch, 0 = off (default: 0)" << std::endl;
+        std::cerr << "  --batch-timeout-ms N longest a gateway batch waits (default: 1)" << std::endl;
+        std::cerr << "  --batch-workers N    batches in flight per worker (default: 4)" << std::endl;
+        std::cerr << "  --pool-size N        keep-alive connections per worker (default: 32)" << std::endl;
+        std::cerr << "  --deadline-ms N      per-request budget over all attempts, 0 = off (default: 0)" << std::endl;
+        std::cerr << "  --hedge-percentile P hedge after the owner's P-th latency percentile (default: off)" << std::endl;
+        std::cerr << "  --failover-fanout N  nodes retried in parallel per failover (default: 2)" << std::endl;
+        std::cerr << "  --server-threads N   threads serving clients (default: 4 x pool size)" << std::endl;
+        std::cerr << "  --io-threads N       event loops forwarding to workers (default: 4)" << std::endl;
+        std::cerr << "  --stream-threads N   /infer_stream relays to workers at once (default: 8)" << std::endl;
+        std::cerr << "  --frontend threads|events  thread per client request or epoll on the io loops (default: threads)" << std::endl;
+        std::cerr << "  --model NAME=W1,W2   route model NAME only to these workers; repeatable (default: any worker)" << std::endl;
+        std::cerr << "  --health-interval-ms N  probe every worker's /health this often, 0 = off (default: 1000)" << std::endl;
+        std::cerr << "  --health-failures N  failed probes in a row before a worker is tried last (default: 2)" << std::endl;
+        return 1;
+    }
+    
+    std::vector<std::string> workers;
+    GatewayOptions options;
+    size_t server_threads = 0;
+    bool event_frontend = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            workers.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: missing value for " << arg << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--route-by") {
+            if (value != "request_id" && value != "content") {
+                std::cerr << "Error: unknown routing key " << value << std::endl;
+                return 1;
+            }
+            options.route_by = value == "content" ? RouteBy::CONTENT : RouteBy::REQUEST_ID;
+        } else if (arg == "--cache-entries") {
+            options.cache_entries = std::stoul(value);
+        } else if (arg == "--balance") {
+            if (value == "p2c") {
+                options.balance = Balance::P2C;
+            } else if (value == "bounded") {
+                options.balance = Balance::BOUNDED;
+            } else if (value == "none") {
+                options.balance = Balance::NONE;
+            } else {
+                std::cerr << "Error: unknown balance mode " << value << std::endl;
+                return 1;
+            }
+        } else if (arg == "--deadline-ms") {
+            options.deadline = std::chrono::milliseconds(std::stol(value));
+        } else if (arg == "--hedge-percentile") {
+            options.hedge_percentile = std::stod(value);
+        } else if (arg == "--failover-fanout") {
+            options.failover_fanout = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--batch") {
+            options.batch_size = std::stoul(value);
+        } else if (arg == "--batch-timeout-ms") {
+            options.batch_timeout = std::chrono::milliseconds(std::stol(value));
+        } else if (arg == "--batch-workers") {
+            options.batch_workers = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--pool-size") {
+            options.pool_size = std::stoul(value);
+        } else if (arg == "--server-threads") {
+            server_threads = std::stoul(value);
+        } else if (arg == "--io-threads") {
+            options.io_threads = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--stream-threads") {
+            options.stream_threads = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--frontend") {
+            if (value != "threads" && value != "events") {
+                std::cerr << "Error: unknown frontend " << value << std::endl;
+                return 1;
+            }
+            event_frontend = value == "events";
+        } else if (arg == "--model") {
+            size_t equals = value.find('=');
+            if (equals == std::string::npos || equals == 0 || equals + 1 == value.size()) {
+                std::cerr << "Error: --model takes NAME=WORKER[,WORKER...], got " << value << std::endl;
+                return 1;
+            }
+            std::stringstream hosts(value.substr(equals + 1));
+            std::string host;
+            auto& model_workers = options.model_workers[value.substr(0, equals)];
+            while (std::getline(hosts, host, ',')) {
+                if (!host.empty()) {
+                    model_workers.push_back(host);
+                }
+            }
+        } else if (arg == "--health-interval-ms") {
+            options.health_interval = std::chrono::milliseconds(std::stol(value));
+        } else if (arg == "--health-failures") {
+            options.health_failures = std::max(1, std::stoi(value));
+        } else if (arg == "--load-factor") {
+            options.load_factor = std::stod(value);
+            if (options.load_factor < 1.0) {
+                std::cerr << "Error: --load-factor must be at least 1" << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (workers.empty() && options.model_workers.empty()) {
+        std::cerr << "Error: no workers given" << std::endl;
+        return 1;
+    }
+    if (options.hedge_percentile > 0 && options.deadline.count() == 0) {
+        std::cerr << "Error: --hedge-percentile needs --deadline-ms" << std::endl;
+        return 1;
+    }
+    
+    Gateway gateway(workers, options);
+    // every in-flight request holds a server thread while it waits on a worker,
+    // so size the pool for the connections the gateway can have open
+    if (server_threads == 0) {
+        server_threads = 4 * options.pool_size;
+    }
     std::cout << "Gateway listening on port 8000" << std::endl;
-    std::cout << "Workers: " << workers.size() << std::endl;
+    std::cout << "Front end: " << (event_frontend
+        ? "epoll on " + std::to_string(options.io_threads) + " io loops"
+        : std::to_string(server_threads) + " server threads") << std::endl;
+    std::cout << "Workers: " << gateway.workerCount() << std::endl;
+    for (const auto& [model, hosts] : options.model_workers) {
+        std::cout << "Model " << model << ": " << hosts.size() << " workers" << std::endl;
+    }
     std::cout << "Circuit breakers enabled" << std::endl;
+    if (options.health_interval.count() > 0) {
+        std::cout << "Health checks: every " << options.health_interval.count() << "ms, down after "
+                  << options.health_failures << " failures" << std::endl;
+    } else {
+        std::cout << "Health checks: off" << std::endl;
+    }
+    std::cout << "Routing by: " << (options.route_by == RouteBy::CONTENT ? "input content" : "request_id") << std::endl;
+    std::cout << "Load balancing: " << Gateway::balanceName(options.balance) << std::endl;
+    if (options.batch_size > 0) {
+        std::cout << "Batching: up to " << options.batch_size << " requests per worker, "
+                  << options.batch_timeout.count() << "ms" << std::endl;
+    }
+    if (options.deadline.count() > 0) {
+        std::cout << "Deadline: " << options.deadline.count() << "ms";
+        if (options.hedge_percentile > 0) {
+            std::cout << ", hedging at p" << options.hedge_percentile;
+        }
+        std::cout << std::endl;
+    }
+    if (options.cache_entries > 0) {
+        std::cout << "Response cache: " << options.cache_entries << " entries" << std::endl;
+    }
     std::cout << "Ready!" << std::endl;
-    server.listen("0.0.0.0", 8000);
+    if (event_frontend) {
+        if (!serveEvents(gateway)) {
+            std::cerr << "Error: cannot listen on port 8000" << std::endl;
+            return 1;
+        }
+    } else {
+        serveThreads(gateway, server_threads);
+    }
     return 0;
 }
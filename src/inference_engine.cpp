@@ -2,33 +2,148 @@
 #include <iostream>
 #include <algorithm>
 #include <numeric>
+#include <cstdlib>
+#include <stdexcept>
+#include <chrono>
+#ifdef INFERENCE_ENGINE_CUDA
+#include <cuda_runtime_api.h>
+#endif
 
-InferenceEngine::InferenceEngine(const std::string& model_path, int shard_id)
-    : model_path_(model_path), shard_id_(shard_id) {
-    env_ = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "InferenceEngine");
+#ifdef INFERENCE_ENGINE_CUDA
+namespace {
+
+void checkCuda(cudaError_t status, const char* what) {
+    if (status != cudaSuccess) {
+        throw std::runtime_error(std::string(what) + ": " + cudaGetErrorString(status));
+    }
+}
+
+}  // namespace
+#endif
+
+HostBufferPool::HostBufferPool(size_t buffer_floats, AllocFn alloc, FreeFn free)
+    : buffer_floats_(buffer_floats), alloc_(std::move(alloc)), free_(std::move(free)) {}
+
+HostBufferPool::~HostBufferPool() {
+    for (float* buffer : idle_) {
+        free_(buffer);
+    }
+}
+
+std::shared_ptr<float> HostBufferPool::acquire(size_t count) {
+    if (count > buffer_floats_) {
+        auto self = shared_from_this();
+        return std::shared_ptr<float>(alloc_(count), [self](float* p) { self->free_(p); });
+    }
+    float* buffer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            buffer = idle_.back();
+            idle_.pop_back();
+        }
+    }
+    if (!buffer) {
+        buffer = alloc_(buffer_floats_);
+    }
+    auto self = shared_from_this();
+    return std::shared_ptr<float>(buffer, [self](float* p) {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->idle_.push_back(p);
+    });
+}
+
+InferenceEngine::InferenceEngine(const std::string& model_path, int shard_id,
+                                 const EngineOptions& options)
+    : model_path_(model_path), shard_id_(shard_id), options_(options) {
+    // buckets: sorted, distinct, within [1, max_batch_size]
+    auto& buckets = options_.batch_buckets;
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+    buckets.erase(std::remove_if(buckets.begin(), buckets.end(), [this](size_t b) {
+        return b == 0 || b > options_.max_batch_size;
+    }), buckets.end());
+    env_ = sharedEnv();
     initializeSession();
+    initializeBuffers();
+}
+
+std::shared_ptr<Ort::Env> InferenceEngine::sharedEnv() {
+    static std::shared_ptr<Ort::Env> env =
+        std::make_shared<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "InferenceEngine");
+    return env;
 }
 
 InferenceEngine::~InferenceEngine() {
-    // cleanup handled by unique_ptr
+    // ORT objects are cleaned up by unique_ptr, raw CUDA resources here
+    io_binding_.reset();
+#ifdef INFERENCE_ENGINE_CUDA
+    if (device_input_) cudaFree(device_input_);
+    if (device_output_) cudaFree(device_output_);
+    if (cuda_stream_) cudaStreamDestroy(static_cast<cudaStream_t>(cuda_stream_));
+#endif
 }
 
 void InferenceEngine::initializeSession() {
     std::lock_guard<std::mutex> lock(mutex_);
     session_options_ = std::make_unique<Ort::SessionOptions>();
-    session_options_->SetIntraOpNumThreads(4);
-    session_options_->SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
-    try {
-        OrtCUDAProviderOptions cuda_options;
-        cuda_options.device_id = 0;
-        session_options_->AppendExecutionProvider_CUDA(cuda_options);
-        std::cout << "CUDA Provider successfully loaded." << std::endl;
-    } catch (const Ort::Exception& e) {
-        std::cerr << "CUDA failed to load: " << e.what() << std::endl;
-        std::cerr << "Falling back to CPU Provider..." << std::endl;
+    int intra_op_threads = options_.intra_op_threads;
+    if (intra_op_threads == 0 && !options_.cpus.empty()) {
+        intra_op_threads = static_cast<int>(options_.cpus.size());
+    }
+    session_options_->SetIntraOpNumThreads(intra_op_threads);
+    if (options_.inter_op_threads > 1) {
+        session_options_->SetExecutionMode(ExecutionMode::ORT_PARALLEL);
+        session_options_->SetInterOpNumThreads(options_.inter_op_threads);
+    }
+    if (!options_.cpus.empty() && intra_op_threads > 1) {
+        // one entry per pool thread, ';'-separated; the calling thread is the
+        // first intra-op thread and is not listed. ORT counts CPUs from 1.
+        std::string affinities;
+        for (int i = 1; i < intra_op_threads; ++i) {
+            if (i > 1) affinities += ';';
+            affinities += std::to_string(options_.cpus[i % options_.cpus.size()] + 1);
+        }
+        session_options_->AddConfigEntry("session.intra_op_thread_affinities", affinities.c_str());
+    }
+    if (!options_.load_optimized_path.empty()) {
+        // already optimized when it was saved
+        session_options_->SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+    } else {
+        session_options_->SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+        if (!options_.save_optimized_path.empty()) {
+            session_options_->SetOptimizedModelFilePath(options_.save_optimized_path.c_str());
+        }
+    }
+    // ORT assigns each node to the first provider that takes it, and adds
+    // its CPU provider last on its own, so anything after CPU would never run
+    bool cpu_allowed = options_.providers.empty();
+    bool accelerated = false;
+    for (ExecutionProvider provider : options_.providers) {
+        if (provider == ExecutionProvider::CPU) {
+            cpu_allowed = true;
+            break;
+        }
+        try {
+            appendProvider(provider);
+            accelerated = true;
+            std::cout << executionProviderName(provider) << " Provider successfully loaded." << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << executionProviderName(provider) << " failed to load: " << e.what() << std::endl;
+        }
+    }
+    if (!accelerated) {
+        if (!cpu_allowed) {
+            throw std::runtime_error("None of the configured execution providers could be loaded");
+        }
+        if (!options_.providers.empty() && options_.providers.front() != ExecutionProvider::CPU) {
+            std::cerr << "Falling back to CPU Provider..." << std::endl;
+        }
     }
     // session creation
-    session_ = std::make_unique<Ort::Session>(*env_, model_path_.c_str(), *session_options_);
+    const std::string& load_path =
+        options_.load_optimized_path.empty() ? model_path_ : options_.load_optimized_path;
+    session_ = std::make_unique<Ort::Session>(*env_, load_path.c_str(), *session_options_);
     
     // input info
     Ort::AllocatorWithDefaultOptions allocator;
@@ -43,6 +158,7 @@ void InferenceEngine::initializeSession() {
         auto input_type_info = session_->GetInputTypeInfo(0);
         auto tensor_info = input_type_info.GetTensorTypeAndShapeInfo();
         input_shape_ = tensor_info.GetShape();
+        input_fp16_ = tensor_info.GetElementType() == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
         // Handle dynamic dimensions (-1)
         for (auto& dim : input_shape_) {
             if (dim == -1) {
@@ -60,14 +176,36 @@ void InferenceEngine::initializeSession() {
         auto output_type_info = session_->GetOutputTypeInfo(0);
         auto tensor_info = output_type_info.GetTensorTypeAndShapeInfo();
         output_shape_ = tensor_info.GetShape();
+        output_fp16_ = tensor_info.GetElementType() == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
         //dynamic dimensions
-        for (auto& dim : output_shape_) {
-            if (dim == -1) {
-                dim = 1;
+        for (size_t i = 0; i < output_shape_.size(); ++i) {
+            if (output_shape_[i] == -1) {
+                output_shape_[i] = 1;
+                output_shape_dynamic_ = output_shape_dynamic_ || i > 0;
             }
         }
     }
     
+    input_sample_size_ = input_shape_.empty() ? 0 : std::accumulate(
+        input_shape_.begin() + 1,  // batch dimension skipped
+        input_shape_.end(),
+        1LL,
+        std::multiplies<int64_t>()
+    );
+    output_sample_size_ = output_shape_.empty() ? 0 : std::accumulate(
+        output_shape_.begin() + 1,
+        output_shape_.end(),
+        1LL,
+        std::multiplies<int64_t>()
+    );
+    // image inputs fill the channel dimension: 1 for NCHW, last for NHWC
+    size_t channels = 1;
+    if (input_shape_.size() > 1) {
+        channels = static_cast<size_t>(options_.image_nhwc ? input_shape_.back() : input_shape_[1]);
+    }
+    image_transform_ = ImageTransform(std::max<size_t>(channels, 1), !options_.image_nhwc,
+                                      options_.image_mean, options_.image_std);
+    
     std::cout << "ONNX model loaded: " << model_path_ << std::endl;
     std::cout << "  Input name: " << (input_names_.empty() ? "NONE" : input_names_[0]) << std::endl;
     std::cout << "  Input shape: [";
@@ -75,7 +213,7 @@ void InferenceEngine::initializeSession() {
         std::cout << input_shape_[i];
         if (i < input_shape_.size() - 1) std::cout << ", ";
     }
-    std::cout << "]" << std::endl;
+    std::cout << "]" << (input_fp16_ ? " float16" : "") << std::endl;
     
     std::cout << "  Output name: " << (output_names_.empty() ? "NONE" : output_names_[0]) << std::endl;
     std::cout << "  Output shape: [";
@@ -86,7 +224,157 @@ void InferenceEngine::initializeSession() {
     std::cout << "]" << std::endl;
 }
 
+const char* executionProviderName(ExecutionProvider provider) {
+    switch (provider) {
+        case ExecutionProvider::TENSORRT: return "TensorRT";
+        case ExecutionProvider::CUDA: return "CUDA";
+        case ExecutionProvider::OPENVINO: return "OpenVINO";
+        case ExecutionProvider::CPU: return "CPU";
+    }
+    return "unknown";
+}
+
+ExecutionProvider parseExecutionProvider(const std::string& name) {
+    if (name == "tensorrt") return ExecutionProvider::TENSORRT;
+    if (name == "cuda") return ExecutionProvider::CUDA;
+    if (name == "openvino") return ExecutionProvider::OPENVINO;
+    if (name == "cpu") return ExecutionProvider::CPU;
+    throw std::invalid_argument("Unknown execution provider: " + name);
+}
+
+void* InferenceEngine::userComputeStream() {
+#ifdef INFERENCE_ENGINE_CUDA
+    // ORT computes on our stream, so our async copies are ordered with it
+    if (options_.io_binding && !cuda_stream_) {
+        cudaStream_t stream;
+        checkCuda(cudaSetDevice(options_.device_id), "cudaSetDevice");
+        checkCuda(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking), "cudaStreamCreate");
+        cuda_stream_ = stream;
+    }
+#endif
+    return cuda_stream_;
+}
+
+void InferenceEngine::appendProvider(ExecutionProvider provider) {
+    const OrtApi& api = Ort::GetApi();
+    std::string device = std::to_string(options_.device_id);
+    switch (provider) {
+    case ExecutionProvider::TENSORRT: {
+        OrtTensorRTProviderOptionsV2* trt = nullptr;
+        Ort::ThrowOnError(api.CreateTensorRTProviderOptions(&trt));
+        std::unique_ptr<OrtTensorRTProviderOptionsV2, void (*)(OrtTensorRTProviderOptionsV2*)>
+            trt_guard(trt, api.ReleaseTensorRTProviderOptions);
+        std::vector<const char*> keys = {"device_id"};
+        std::vector<const char*> values = {device.c_str()};
+        // engines take minutes to build; keep them next to the optimized graphs
+        if (!options_.optimized_model_dir.empty()) {
+            keys.insert(keys.end(), {"trt_engine_cache_enable", "trt_engine_cache_path"});
+            values.insert(values.end(), {"1", options_.optimized_model_dir.c_str()});
+        }
+        Ort::ThrowOnError(api.UpdateTensorRTProviderOptions(trt, keys.data(), values.data(), keys.size()));
+        if (void* stream = userComputeStream()) {
+            Ort::ThrowOnError(api.UpdateTensorRTProviderOptionsWithValue(trt, "user_compute_stream", stream));
+        }
+        session_options_->AppendExecutionProvider_TensorRT_V2(*trt);
+        cuda_enabled_ = true;  // runs on CUDA memory like the CUDA provider
+        break;
+    }
+    case ExecutionProvider::CUDA: {
+        OrtCUDAProviderOptions cuda_options;
+        cuda_options.device_id = options_.device_id;
+#ifdef INFERENCE_ENGINE_CUDA
+        if (void* stream = userComputeStream()) {
+            cuda_options.has_user_compute_stream = 1;
+            cuda_options.user_compute_stream = stream;
+        }
+        // graph capture is only exposed through the V2 provider options
+        if (options_.cuda_graphs && cuda_stream_ && !options_.batch_buckets.empty()) {
+            OrtCUDAProviderOptionsV2* cuda_v2 = nullptr;
+            Ort::ThrowOnError(api.CreateCUDAProviderOptions(&cuda_v2));
+            std::unique_ptr<OrtCUDAProviderOptionsV2, void (*)(OrtCUDAProviderOptionsV2*)>
+                cuda_v2_guard(cuda_v2, api.ReleaseCUDAProviderOptions);
+            const char* keys[] = {"device_id", "enable_cuda_graph"};
+            const char* values[] = {device.c_str(), "1"};
+            Ort::ThrowOnError(api.UpdateCUDAProviderOptions(cuda_v2, keys, values, 2));
+            Ort::ThrowOnError(api.UpdateCUDAProviderOptionsWithValue(
+                cuda_v2, "user_compute_stream", cuda_stream_));
+            session_options_->AppendExecutionProvider_CUDA_V2(*cuda_v2);
+            cuda_graphs_enabled_ = true;
+        } else {
+            session_options_->AppendExecutionProvider_CUDA(cuda_options);
+        }
+#else
+        session_options_->AppendExecutionProvider_CUDA(cuda_options);
+#endif
+        cuda_enabled_ = true;
+        break;
+    }
+    case ExecutionProvider::OPENVINO: {
+        OrtOpenVINOProviderOptions openvino_options;
+        session_options_->AppendExecutionProvider_OpenVINO(openvino_options);
+        break;
+    }
+    case ExecutionProvider::CPU:
+        break;
+    }
+}
+
+void InferenceEngine::initializeBuffers() {
+    HostBufferPool::AllocFn alloc;
+    HostBufferPool::FreeFn free;
+    if (cuda_enabled_) {
+        // page-locked host memory, so the host-to-device copy is a plain DMA
+        Ort::MemoryInfo pinned_info("CudaPinned", OrtDeviceAllocator, options_.device_id, OrtMemTypeCPUOutput);
+        pinned_allocator_ = std::make_unique<Ort::Allocator>(*session_, pinned_info);
+        Ort::Allocator* allocator = pinned_allocator_.get();
+        alloc = [allocator](size_t count) {
+            return static_cast<float*>(allocator->Alloc(count * sizeof(float)));
+        };
+        free = [allocator](float* p) { allocator->Free(p); };
+    } else {
+        alloc = [](size_t count) {
+            size_t bytes = (count * sizeof(float) + 63) / 64 * 64;
+            return static_cast<float*>(std::aligned_alloc(64, bytes));
+        };
+        free = [](float* p) { std::free(p); };
+    }
+    input_buffers_ = std::make_shared<HostBufferPool>(
+        options_.max_batch_size * input_sample_size_, alloc, free);
+    output_buffers_ = std::make_shared<HostBufferPool>(
+        options_.max_batch_size * output_sample_size_, alloc, free);
+    
+    // binding a preallocated output needs its shape before Run
+    use_io_binding_ = options_.io_binding && !output_shape_dynamic_ &&
+                      input_sample_size_ > 0 && output_sample_size_ > 0;
+#ifdef INFERENCE_ENGINE_CUDA
+    // device buffers only pay off with our own stream to order copies on
+    use_io_binding_ = use_io_binding_ && (!cuda_enabled_ || cuda_stream_);
+    if (use_io_binding_ && cuda_enabled_) {
+        checkCuda(cudaMalloc(reinterpret_cast<void**>(&device_input_),
+                             options_.max_batch_size * input_sample_size_ * inputElementSize()),
+                  "cudaMalloc input");
+        checkCuda(cudaMalloc(reinterpret_cast<void**>(&device_output_),
+                             options_.max_batch_size * output_sample_size_ * outputElementSize()),
+                  "cudaMalloc output");
+    }
+#else
+    // without the CUDA runtime we cannot manage device memory ourselves
+    use_io_binding_ = use_io_binding_ && !cuda_enabled_;
+#endif
+    // a captured graph replays fixed addresses, so it needs the bound buffers
+    cuda_graphs_enabled_ = cuda_graphs_enabled_ && use_io_binding_;
+    if (use_io_binding_) {
+        io_binding_ = std::make_unique<Ort::IoBinding>(*session_);
+        std::cout << "  IoBinding: " << (cuda_enabled_ ? "device-resident buffers" : "host buffers")
+                  << std::endl;
+    }
+}
+
 std::vector<float> InferenceEngine::predict(const std::vector<float>& input) {
+    if (input_fp16_ || output_fp16_) {
+        // the batch path does the conversions
+        return batchPredict({input}).front();
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     
     int64_t expected_size = std::accumulate(
@@ -133,43 +421,69 @@ std::vector<float> InferenceEngine::predict(const std::vector<float>& input) {
 
 std::vector<std::vector<float>> InferenceEngine::batchPredict(
     const std::vector<std::vector<float>>& inputs) {
-    std::lock_guard<std::mutex> lock(mutex_);
     if (inputs.empty()) {
         return {};
     }
-    
-    size_t batch_size = inputs.size();
-    
-    // input size per sample
-    int64_t per_sample_size = std::accumulate(
-        input_shape_.begin() + 1,  // batch dimension skipped
-        input_shape_.end(),
-        1LL,
-        std::multiplies<int64_t>()
-    );
-    
-    // all inputs are flattened into single batch
-    std::vector<float> batch_input;
-    batch_input.reserve(batch_size * per_sample_size);
+    std::vector<InputSpan> spans;
+    spans.reserve(inputs.size());
     for (const auto& input : inputs) {
-        batch_input.insert(batch_input.end(), input.begin(), input.end());
-        // pad if needed
-        if (static_cast<int64_t>(input.size()) < per_sample_size) {
-            batch_input.resize(batch_input.size() + (per_sample_size - input.size()), 0.0f);
-        }
+        spans.push_back(InputSpan{input.data(), input.size()});
+    }
+    PackedInput packed = packBatch(spans);
+    std::vector<std::vector<float>> results;
+    results.reserve(inputs.size());
+    for (const auto& view : runBatch(packed)) {
+        results.push_back(view.toVector());
+    }
+    return results;
+}
+
+PackedInput InferenceEngine::packBatch(const std::vector<InputSpan>& inputs) const {
+    PackedInput packed;
+    packed.num_samples = inputs.size();
+    packed.batch_size = inputs.size();
+    // smallest bucket that fits; larger batches run at their own size
+    packed.bucket = pickBucket(options_.batch_buckets, inputs.size());
+    if (packed.bucket >= 0) {
+        packed.batch_size = options_.batch_buckets[packed.bucket];
+    }
+    packed.size = packed.batch_size * input_sample_size_;
+    packed.data = input_buffers_->acquire(packed.size);
+    
+    // all inputs are converted and flattened into single batch, short ones
+    // zero padded, plus padding rows up to the bucket size; a float16 model
+    // gets halves, in the first half of the float buffer
+    if (input_fp16_) {
+        packHalfRows(inputs, input_sample_size_, packed.batch_size,
+                     reinterpret_cast<uint16_t*>(packed.data.get()), image_transform_);
+    } else {
+        packRows(inputs, input_sample_size_, packed.batch_size, packed.data.get(), image_transform_);
     }
+    return packed;
+}
+
+std::vector<TensorView> InferenceEngine::runBatch(PackedInput& input) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (input.batch_size == 0) {
+        return {};
+    }
+    if (use_io_binding_ && input.batch_size <= options_.max_batch_size) {
+        return runBound(input);
+    }
+    size_t batch_size = input.batch_size;
     
     // batch input shape creation
     std::vector<int64_t> batch_input_shape = input_shape_;
     batch_input_shape[0] = batch_size;  // batch dimension set
     // input tensor creation
     auto memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
+    Ort::Value input_tensor = Ort::Value::CreateTensor(
         memory_info,
-        batch_input.data(),
-        batch_input.size(),
+        input.data.get(),
+        input.size * inputElementSize(),
         batch_input_shape.data(),
-        batch_input_shape.size()
+        batch_input_shape.size(),
+        inputElementType()
     );
     
     // inference
@@ -182,8 +496,9 @@ std::vector<std::vector<float>> InferenceEngine::batchPredict(
         1
     );
     
-    float* output_data = output_tensors[0].GetTensorMutableData<float>();
-    auto output_shape = output_tensors[0].GetTensorTypeAndShapeInfo().GetShape();
+    // the output tensor itself is the shared owner, results are views into it
+    auto output = std::make_shared<Ort::Value>(std::move(output_tensors[0]));
+    auto output_shape = output->GetTensorTypeAndShapeInfo().GetShape();
     
     int64_t per_output_size = std::accumulate(
         output_shape.begin() + 1,  // batch dimension skipped
@@ -192,20 +507,110 @@ std::vector<std::vector<float>> InferenceEngine::batchPredict(
         std::multiplies<int64_t>()
     );
     
-    // batch output is split into individual results
-    std::vector<std::vector<float>> results;
-    results.reserve(batch_size);
+    // batch output is split into individual results, padding rows dropped
+    if (output_fp16_) {
+        // widened into a float buffer, which the views share instead
+        size_t count = input.num_samples * per_output_size;
+        std::shared_ptr<float> widened = output_buffers_->acquire(count);
+        halvesToFloats(reinterpret_cast<const uint16_t*>(output->GetTensorData<Ort::Float16_t>()),
+                       widened.get(), count);
+        return sliceRows(widened, widened.get(), input.num_samples, per_output_size);
+    }
+    return sliceRows(output, output->GetTensorData<float>(), input.num_samples, per_output_size);
+}
+
+// Runs with input and output bound to preallocated buffers. With CUDA the
+// packed (pinned) input is copied to the device on this engine's stream, ORT
+// computes on the same stream and the result is copied back into a pinned
+// buffer, so engines on other streams overlap their copies with this compute.
+std::vector<TensorView> InferenceEngine::runBound(PackedInput& input) {
+    size_t batch_size = input.batch_size;
+    std::vector<int64_t> batch_input_shape = input_shape_;
+    batch_input_shape[0] = batch_size;
+    std::vector<int64_t> batch_output_shape = output_shape_;
+    batch_output_shape[0] = batch_size;
+    size_t output_count = batch_size * output_sample_size_;
+    std::shared_ptr<float> output = output_buffers_->acquire(output_count);
+    // a float16 output lands here first and is widened into output
+    std::shared_ptr<float> halves;
+    if (output_fp16_) {
+        halves = output_buffers_->acquire((output_count + 1) / 2);
+    }
     
-    for (size_t i = 0; i < batch_size; ++i) {
-        size_t offset = i * per_output_size;
-        std::vector<float> result(
-            output_data + offset,
-            output_data + offset + per_output_size
-        );
-        results.push_back(std::move(result));
+    Ort::RunOptions run_options;
+    float* bound_input = input.data.get();
+    float* bound_output = output_fp16_ ? halves.get() : output.get();
+    auto memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+#ifdef INFERENCE_ENGINE_CUDA
+    cudaStream_t stream = static_cast<cudaStream_t>(cuda_stream_);
+    if (cuda_enabled_) {
+        // batcher threads run batches on every device of the worker
+        checkCuda(cudaSetDevice(options_.device_id), "cudaSetDevice");
+        memory_info = Ort::MemoryInfo("Cuda", OrtDeviceAllocator, options_.device_id, OrtMemTypeDefault);
+        checkCuda(cudaMemcpyAsync(device_input_, input.data.get(), input.size * inputElementSize(),
+                                  cudaMemcpyHostToDevice, stream),
+                  "cudaMemcpyAsync input");
+        bound_input = device_input_;
+        bound_output = device_output_;
+        // we synchronize the stream ourselves after the copy back
+        run_options.AddConfigEntry("disable_synchronize_execution_providers", "1");
+    }
+    // one captured graph per bucket; -1 tells ORT not to capture or replay
+    if (cuda_graphs_enabled_) {
+        std::string graph_id = std::to_string(input.bucket);
+        run_options.AddConfigEntry("gpu_graph_id", graph_id.c_str());
     }
+#endif
+    Ort::Value input_tensor = Ort::Value::CreateTensor(
+        memory_info, bound_input, input.size * inputElementSize(),
+        batch_input_shape.data(), batch_input_shape.size(), inputElementType());
+    Ort::Value output_tensor = Ort::Value::CreateTensor(
+        memory_info, bound_output, output_count * outputElementSize(),
+        batch_output_shape.data(), batch_output_shape.size(), outputElementType());
+    io_binding_->BindInput(input_names_[0], input_tensor);
+    io_binding_->BindOutput(output_names_[0], output_tensor);
     
-    return results;
+    // inference
+    session_->Run(run_options, *io_binding_);
+    
+#ifdef INFERENCE_ENGINE_CUDA
+    if (cuda_enabled_) {
+        checkCuda(cudaMemcpyAsync(output_fp16_ ? halves.get() : output.get(), device_output_,
+                                  output_count * outputElementSize(), cudaMemcpyDeviceToHost, stream),
+                  "cudaMemcpyAsync output");
+        checkCuda(cudaStreamSynchronize(stream), "cudaStreamSynchronize");
+    }
+#endif
+    io_binding_->ClearBoundInputs();
+    io_binding_->ClearBoundOutputs();
+    if (output_fp16_) {
+        halvesToFloats(reinterpret_cast<const uint16_t*>(halves.get()), output.get(), output_count);
+    }
+    
+    return sliceRows(output, output.get(), input.num_samples, output_sample_size_);
+}
+
+void InferenceEngine::warmup() {
+    // ORT does at least one regular run before it captures a graph
+    constexpr int kRunsPerSize = 3;
+    std::vector<size_t> sizes = options_.batch_buckets;
+    if (sizes.empty()) {
+        for (size_t size = 1; size < options_.max_batch_size; size *= 2) {
+            sizes.push_back(size);
+        }
+        sizes.push_back(options_.max_batch_size);
+    }
+    for (size_t size : sizes) {
+        std::vector<InputSpan> inputs(size, InputSpan{nullptr, 0});
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kRunsPerSize; ++i) {
+            PackedInput packed = packBatch(inputs);
+            runBatch(packed);
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "  Warmed batch size " << size << " in " << elapsed << "ms" << std::endl;
+    }
 }
 
 std::vector<int64_t> InferenceEngine::getInputShape() const {
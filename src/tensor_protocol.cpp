@@ -0,0 +1,212 @@
+#include "tensor_protocol.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t kMagic = 0x524E5354;  // "TNSR"
+constexpr uint8_t kVersion = 1;
+constexpr size_t kFixedHeaderSize = 24;
+constexpr size_t kMaxDims = 8;
+
+template<typename T>
+T readField(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template<typename T>
+void writeField(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+}  // namespace
+
+size_t TensorFrame::elementCount() const {
+    size_t count = 1;
+    for (int64_t dim : shape) {
+        count *= static_cast<size_t>(dim);
+    }
+    return count;
+}
+
+bool isTensorContentType(const std::string& content_type) {
+    return content_type.compare(0, std::strlen(kTensorContentType), kTensorContentType) == 0;
+}
+
+size_t dtypeSize(TensorDType dtype) {
+    switch (dtype) {
+        case TensorDType::FLOAT32: return sizeof(float);
+        case TensorDType::UINT8: return sizeof(uint8_t);
+        case TensorDType::FLOAT16: return sizeof(uint16_t);
+    }
+    throw std::runtime_error("Unsupported tensor dtype");
+}
+
+size_t decodeTensorFrame(const char* data, size_t size, TensorFrame& frame) {
+    if (size < kFixedHeaderSize) {
+        throw std::runtime_error("Tensor frame truncated");
+    }
+    if (readField<uint32_t>(data) != kMagic) {
+        throw std::runtime_error("Bad tensor frame magic");
+    }
+    if (static_cast<uint8_t>(data[4]) != kVersion) {
+        throw std::runtime_error("Unsupported tensor frame version");
+    }
+    frame.kind = static_cast<FrameKind>(data[5]);
+    frame.dtype = static_cast<TensorDType>(data[6]);
+    size_t ndim = static_cast<uint8_t>(data[7]);
+    frame.flags = static_cast<uint8_t>(data[8]);
+    size_t id_len = readField<uint16_t>(data + 10);
+    size_t node_len = readField<uint16_t>(data + 12);
+    frame.inference_time_us = readField<int64_t>(data + 16);
+    if (ndim == 0 || ndim > kMaxDims) {
+        throw std::runtime_error("Invalid tensor rank");
+    }
+
+    size_t offset = kFixedHeaderSize;
+    if (size < offset + ndim * sizeof(int64_t) + id_len + node_len) {
+        throw std::runtime_error("Tensor frame truncated");
+    }
+    frame.shape.resize(ndim);
+    size_t elements = 1;
+    for (size_t i = 0; i < ndim; ++i) {
+        frame.shape[i] = readField<int64_t>(data + offset);
+        if (frame.shape[i] < 0) {
+            throw std::runtime_error("Negative tensor dimension");
+        }
+        size_t dim = static_cast<size_t>(frame.shape[i]);
+        if (dim != 0 && elements > size / dim) {
+            // more elements than bytes in the body: cannot be valid
+            throw std::runtime_error("Tensor payload truncated");
+        }
+        elements *= dim;
+        offset += sizeof(int64_t);
+    }
+    frame.request_id.assign(data + offset, id_len);
+    offset += id_len;
+    // the same slot carries the model name of a request
+    (frame.kind == FrameKind::REQUEST ? frame.model : frame.node_id).assign(data + offset, node_len);
+    offset += node_len;
+
+    frame.payload_bytes = elements * dtypeSize(frame.dtype);
+    if (size - offset < frame.payload_bytes) {
+        throw std::runtime_error("Tensor payload truncated");
+    }
+    frame.payload = data + offset;
+    return offset + frame.payload_bytes;
+}
+
+size_t tensorFrameSize(const char* data, size_t size) {
+    if (size < kFixedHeaderSize) {
+        return 0;
+    }
+    if (readField<uint32_t>(data) != kMagic) {
+        throw std::runtime_error("Bad tensor frame magic");
+    }
+    size_t ndim = static_cast<uint8_t>(data[7]);
+    if (ndim == 0 || ndim > kMaxDims) {
+        throw std::runtime_error("Invalid tensor rank");
+    }
+    size_t header = kFixedHeaderSize + ndim * sizeof(int64_t) +
+                    readField<uint16_t>(data + 10) + readField<uint16_t>(data + 12);
+    if (size < kFixedHeaderSize + ndim * sizeof(int64_t)) {
+        return 0;
+    }
+    size_t elements = 1;
+    for (size_t i = 0; i < ndim; ++i) {
+        int64_t dim = readField<int64_t>(data + kFixedHeaderSize + i * sizeof(int64_t));
+        if (dim < 0) {
+            throw std::runtime_error("Negative tensor dimension");
+        }
+        size_t width = static_cast<size_t>(dim);
+        if (width != 0 && elements > (SIZE_MAX >> 4) / width) {
+            throw std::runtime_error("Tensor frame too large");
+        }
+        elements *= width;
+    }
+    size_t total = header + elements * dtypeSize(static_cast<TensorDType>(data[6]));
+    return size >= total ? total : 0;
+}
+
+namespace {
+
+void appendFrame(std::string& out, const TensorFrame& frame, TensorDType dtype,
+                 const void* data, size_t count) {
+    const std::string& name = frame.kind == FrameKind::REQUEST ? frame.model : frame.node_id;
+    if (frame.request_id.size() > UINT16_MAX || name.size() > UINT16_MAX) {
+        throw std::runtime_error("Tensor frame id too long");
+    }
+    // a missing shape means a flat vector
+    std::vector<int64_t> shape = frame.shape;
+    if (shape.empty()) {
+        shape.push_back(static_cast<int64_t>(count));
+    }
+    if (shape.size() > kMaxDims) {
+        throw std::runtime_error("Invalid tensor rank");
+    }
+
+    size_t payload_bytes = count * dtypeSize(dtype);
+    out.reserve(out.size() + kFixedHeaderSize + shape.size() * sizeof(int64_t) +
+                frame.request_id.size() + name.size() + payload_bytes);
+    writeField<uint32_t>(out, kMagic);
+    writeField<uint8_t>(out, kVersion);
+    writeField<uint8_t>(out, static_cast<uint8_t>(frame.kind));
+    writeField<uint8_t>(out, static_cast<uint8_t>(dtype));
+    writeField<uint8_t>(out, static_cast<uint8_t>(shape.size()));
+    writeField<uint8_t>(out, frame.flags);
+    writeField<uint8_t>(out, 0);
+    writeField<uint16_t>(out, static_cast<uint16_t>(frame.request_id.size()));
+    writeField<uint16_t>(out, static_cast<uint16_t>(name.size()));
+    writeField<uint16_t>(out, 0);
+    writeField<int64_t>(out, frame.inference_time_us);
+    for (int64_t dim : shape) {
+        writeField<int64_t>(out, dim);
+    }
+    out.append(frame.request_id);
+    out.append(name);
+    out.append(static_cast<const char*>(data), payload_bytes);
+}
+
+}  // namespace
+
+void appendTensorFrame(std::string& out, const TensorFrame& frame,
+                       const float* data, size_t count) {
+    appendFrame(out, frame, TensorDType::FLOAT32, data, count);
+}
+
+void appendTensorFrameRaw(std::string& out, const TensorFrame& frame,
+                          const void* data, size_t count) {
+    appendFrame(out, frame, frame.dtype, data, count);
+}
+
+std::string encodeTensorFrame(const TensorFrame& frame,
+                              const float* data, size_t count) {
+    std::string out;
+    appendTensorFrame(out, frame, data, count);
+    return out;
+}
+
+void appendErrorFrame(std::string& out, const std::string& request_id,
+                      const std::string& node_id) {
+    TensorFrame frame;
+    frame.kind = FrameKind::RESPONSE;
+    frame.flags = kFrameFlagError;
+    frame.request_id = request_id;
+    frame.node_id = node_id;
+    frame.shape = {0};
+    static const float kNoData = 0.0f;
+    appendTensorFrame(out, frame, &kNoData, 0);
+}
+
+std::vector<float> tensorFrameToFloats(const TensorFrame& frame) {
+    if (frame.dtype != TensorDType::FLOAT32) {
+        throw std::runtime_error("Expected float32 tensor");
+    }
+    std::vector<float> values(frame.payload_bytes / sizeof(float));
+    if (!values.empty()) {
+        std::memcpy(values.data(), frame.payload, frame.payload_bytes);
+    }
+    return values;
+}
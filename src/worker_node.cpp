@@ -1,161 +1,1601 @@
-#include "inference_engine.h"
-#include "lru_cache.h"
+#include "engine_pool.h"
+#include "slab_cache.h"
+#include "single_flight.h"
 #include "batch_processor.h"
+#include "tensor_protocol.h"
+#include "frame_stream.h"
+#include "stage_metrics.h"
+#include "completion.h"
+#include "event_server.h"
+#include "cpu_affinity.h"
 #include <iostream>
 #include <memory>
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
 #include <httplib.h>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
 
+// serialize straight from the shared output, without an intermediate vector
+void to_json(json& j, const TensorView& view) {
+    j = json::array();
+    auto& values = j.get_ref<json::array_t&>();
+    values.reserve(view.size);
+    for (float v : view) {
+        values.emplace_back(v);
+    }
+}
+
+// A request's input as it arrived: float32 values, or the payload of a
+// float16 tensor or uint8 image as is, converted only when it is packed
+struct RequestInput {
+    TensorDType dtype = TensorDType::FLOAT32;
+    std::vector<float> values;  // FLOAT32
+    std::string raw;            // the other dtypes
+
+    InputSpan span() const {
+        switch (dtype) {
+            case TensorDType::FLOAT16:
+                return InputSpan{raw.data(), raw.size() / sizeof(uint16_t), InputEncoding::FLOAT16};
+            case TensorDType::UINT8:
+                return InputSpan{raw.data(), raw.size(), InputEncoding::IMAGE_U8};
+            default:
+                return InputSpan{values.data(), values.size(), InputEncoding::FLOAT32};
+        }
+    }
+    // the cache key; float32 digests like the same frame payload would
+    ContentDigest digest() const {
+        if (dtype == TensorDType::FLOAT32) {
+            return digestFloats(values.data(), values.size());
+        }
+        return digestBytes(raw.data(), raw.size(), payloadDigestSeed(dtype));
+    }
+};
+
+static std::shared_ptr<const RequestInput> frameInput(const TensorFrame& frame) {
+    auto input = std::make_shared<RequestInput>();
+    input->dtype = frame.dtype;
+    if (frame.dtype == TensorDType::FLOAT32) {
+        input->values = tensorFrameToFloats(frame);
+    } else {
+        input->raw.assign(frame.payload, frame.payload_bytes);
+    }
+    return input;
+}
+
 // request/response types for batch processor
+// input is decoded once and shared, never copied, until it is packed
 struct InferenceRequest {
     std::string request_id;
-    std::vector<float> input_data;
+    std::shared_ptr<const RequestInput> input;
 };
 
+// output_data is a view into the batch's shared output tensor;
+// inference_time_us is the pack + Run time of the batch the request ran in,
+// or the cache lookup time for a hit
 struct InferenceResponse {
     std::string request_id;
-    std::vector<float> output_data;
+    TensorView output_data;
     int64_t inference_time_us;
     bool cached;
 };
 
-class WorkerNode {
+// where a request's time goes, stage by stage (queue wait is kept by the
+// batch processor)
+struct WorkerStages {
+    LatencyHistogram decode;        // JSON parse or frame decode, per call
+    LatencyHistogram cache_lookup;  // digest + lookup, per request
+    LatencyHistogram pack;          // per batch
+    LatencyHistogram run;           // ORT Run, per batch
+    LatencyHistogram unpack;        // batch output into responses, per batch
+    LatencyHistogram serialize;     // JSON dump or frame encode, per call
+};
+
+struct WorkerConfig {
+    std::string node_id;
+    int port = 0;
+    // name and ONNX path of every model served, the default first: requests
+    // that name no model get it
+    std::vector<std::pair<std::string, std::string>> models;
+    size_t max_batch_size = 32;
+    std::chrono::milliseconds batch_timeout{20};
+    bool adaptive_batching = false;
+    std::chrono::milliseconds latency_target{50};  // p99 goal for adaptive batching
+    size_t num_sessions = 1;   // concurrent ORT sessions, per device
+    size_t batch_workers = 0;  // threads running batches, 0 = one per session
+    bool pipeline = false;     // pack the next batch while the current one runs
+    std::vector<int> device_ids = {0};  // one engine pool per device, per model
+    std::vector<ExecutionProvider> providers = {ExecutionProvider::CUDA, ExecutionProvider::CPU};
+    int intra_op_threads = 4;  // per session
+    int inter_op_threads = 0;
+    CpuList cpus;  // split among devices, then sessions; batcher threads may use all
+    bool io_binding = true;    // preallocated (device) buffers bound per Run
+    bool lock_free_queue = false;
+    size_t queue_capacity = 4096;  // slots in the lock-free ring
+    size_t queue_limit = 1024;     // queued requests per priority lane, 0 = unbounded
+    size_t bulk_window = 512;      // misses of one /infer_batch or /infer_stream call queued at once
+    std::vector<size_t> batch_buckets;  // padded batch sizes, empty = no padding
+    bool cuda_graphs = false;  // one captured graph per bucket
+    std::string optimized_model_dir;  // saved optimized graphs, empty = optimize every load
+    // normalization of uint8 image inputs, per channel; empty = 0 and 1
+    std::vector<float> image_mean;
+    std::vector<float> image_std;
+    bool image_nhwc = false;
+    size_t cache_entries = 1000;
+    size_t cache_bytes = 0;    // > 0 = byte-budgeted slab cache instead of cache_entries
+    CacheValueType cache_value_type = CacheValueType::FLOAT32;
+    bool event_frontend = false;  // epoll server instead of a thread per request
+    size_t event_threads = 2;     // event loops for the epoll server
+};
+
+// for the device_index-th of config.device_ids
+static EngineOptions engineOptions(const WorkerConfig& config, size_t device_index) {
+    EngineOptions options;
+    options.max_batch_size = config.max_batch_size;
+    options.device_id = config.device_ids[device_index];
+    options.providers = config.providers;
+    options.intra_op_threads = config.intra_op_threads;
+    options.inter_op_threads = config.inter_op_threads;
+    options.cpus = cpuSlice(config.cpus, config.device_ids.size(), device_index);
+    options.io_binding = config.io_binding;
+    options.batch_buckets = config.batch_buckets;
+    options.cuda_graphs = config.cuda_graphs;
+    options.optimized_model_dir = config.optimized_model_dir;
+    options.image_mean = config.image_mean;
+    options.image_std = config.image_std;
+    options.image_nhwc = config.image_nhwc;
+    return options;
+}
+
+static std::unique_ptr<ResultCache> makeResultCache(const WorkerConfig& config) {
+    constexpr size_t kShards = 16;
+    if (config.cache_bytes > 0) {
+        return std::make_unique<SlabCache>(config.cache_bytes, config.cache_value_type, kShards);
+    }
+    return std::make_unique<ShardedResultCache>(config.cache_entries, kShards);
+}
+
+// a request named a model this worker does not serve
+class UnknownModelError : public std::runtime_error {
+public:
+    explicit UnknownModelError(const std::string& name)
+        : std::runtime_error("Unknown model: " + name) {}
+};
+
+using InferenceBatcher = BatchProcessor<InferenceRequest, InferenceResponse>;
+
+// One loaded version of a model: its sessions and the results they
+// produced. A reload builds the next version while this one keeps serving;
+// a retired version is freed once the requests that looked it up are done
+// and the responses and cache entries holding its outputs are gone.
+struct ModelVersion {
+    uint64_t number = 0;
+    std::string model_path;
+    std::vector<std::shared_ptr<EnginePool>> engines;  // one per device
+    // keyed by input digest; entry-count (values share the batch outputs)
+    // or byte-budgeted (values packed into a slab). A version starts empty,
+    // so no result of an older one is ever served.
+    std::unique_ptr<ResultCache> cache;
+    // a request joins an identical one only in the same lane and with no
+    // later deadline, so it is never shed or delayed on another's terms
+    SingleFlight<ContentDigest, InferenceResponse, DigestHash, SubmitOptions> in_flight;
+
+    size_t sessions() const {
+        size_t total = 0;
+        for (const auto& engine : engines) total += engine->size();
+        return total;
+    }
+    size_t busySessions() const {
+        size_t total = 0;
+        for (const auto& engine : engines) total += engine->busyCount();
+        return total;
+    }
+    // devices one after another, each pool's sessions in parallel
+    void warmup() {
+        for (auto& engine : engines) engine->warmup();
+    }
+};
+
+static std::shared_ptr<ModelVersion> loadVersion(uint64_t number, const std::string& model_path,
+                                                 int shard_id, const WorkerConfig& config) {
+    auto version = std::make_shared<ModelVersion>();
+    version->number = number;
+    version->model_path = model_path;
+    for (size_t i = 0; i < config.device_ids.size(); ++i) {
+        version->engines.push_back(std::make_shared<EnginePool>(
+            model_path, config.num_sessions, shard_id, engineOptions(config, i)));
+    }
+    version->cache = makeResultCache(config);
+    return version;
+}
+
+// One model the worker serves: its own versions (sessions, result cache,
+// in-flight table) and batcher, so requests for different models never
+// share a batch or a cache entry. Every model gets the worker's batching,
+// session and cache settings.
+class HostedModel {
 public:
-    WorkerNode(const std::string& node_id, int port, const std::string& model_path)
-        : node_id_(node_id),
-          port_(port),
-          engine_(model_path, port % 3),
-          cache_(1000),  // capacity: 1000 entries
+    HostedModel(const std::string& name, const std::string& model_path, int shard_id,
+                const WorkerConfig& config, WorkerStages& stages)
+        : name_(name),
+          shard_id_(shard_id),
+          config_(config),
+          stages_(stages),
+          current_(loadVersion(1, model_path, shard_id, config)),
           batch_processor_(
-              32,  // max_batch_size
-              std::chrono::milliseconds(20),  // timeout
+              config.max_batch_size,
+              config.batch_timeout,
               [this](const std::vector<InferenceRequest>& reqs) {
                   return this->processBatch(reqs);
-              }
+              },
+              config.batch_workers > 0 ? config.batch_workers : sessionCount(config)
           ) {
-        total_requests_.store(0);
-        cache_hits_.store(0);
+        if (config.adaptive_batching) {
+            batch_processor_.enableAdaptiveBatching(config.latency_target);
+        }
+        if (config.lock_free_queue) {
+            batch_processor_.useLockFreeQueue(config.queue_capacity);
+        }
+        batch_processor_.setQueueLimit(config.queue_limit);
+        if (config.pipeline) {
+            batch_processor_.enablePipeline(
+                [this](const std::vector<InferenceRequest>& reqs) {
+                    return this->packBatch(reqs);
+                },
+                sessionCount(config)  // keep one packed batch ready per session
+            );
+        }
+        if (!config.cpus.empty()) {
+            CpuList cpus = config.cpus;
+            batch_processor_.setThreadInit([cpus] {
+                if (!pinCurrentThread(cpus)) {
+                    std::cerr << "Cannot pin batcher thread to its CPUs" << std::endl;
+                }
+            });
+        }
         batch_processor_.start();
     }
-    
-    ~WorkerNode() {
+
+    ~HostedModel() {
         batch_processor_.stop();
     }
-    
-    json handleInfer(const json& request) {
-        total_requests_++;
-        
-        std::string request_id = request["request_id"];
-        std::vector<float> input_data = request["input_data"];
+
+    const std::string& name() const { return name_; }
+    // the version serving new requests; a request looks it up once and
+    // keeps using that snapshot
+    std::shared_ptr<ModelVersion> current() const { return std::atomic_load(&current_); }
+    InferenceBatcher& batcher() { return batch_processor_; }
+
+    // Loads model_path (the current version's when empty) as the next
+    // version on the calling thread, warms it and swaps it in, while the
+    // current version goes on serving. Batches already packed finish on the
+    // old version; later ones run on the new. Throws, leaving the current
+    // version in place, when the model fails to load or another reload of
+    // this model is under way.
+    std::shared_ptr<ModelVersion> reload(const std::string& model_path) {
+        std::unique_lock<std::mutex> lock(reload_mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            throw std::runtime_error("A reload of " + name_ + " is already in progress");
+        }
+        auto previous = current();
+        auto next = loadVersion(previous->number + 1,
+                                model_path.empty() ? previous->model_path : model_path,
+                                shard_id_, config_);
+        try {
+            next->warmup();
+        } catch (const std::exception& e) {
+            // as at startup: synthetic inputs failing says little about real ones
+            std::cerr << "Warmup of " << name_ << " v" << next->number << " failed: "
+                      << e.what() << std::endl;
+        }
+        std::atomic_store(&current_, next);
+        reloads++;
+        return next;
+    }
+
+    // per model; the worker's totals are their sums
+    std::atomic<int64_t> total_requests{0};
+    std::atomic<int64_t> cache_hits{0};
+    std::atomic<int64_t> coalesced_requests{0};  // served by an identical request in flight
+    std::atomic<int64_t> reloads{0};
+
+private:
+    // what a packed batch holds on to until it has run; the input buffer
+    // goes back to its engine's pool before the engine can go
+    struct PackedBatch {
+        std::shared_ptr<EnginePool> engine;
+        PackedInput input;
+    };
+    // owner of a batch's output views: they keep the engine whose buffers
+    // they point into alive, however long a cache entry holds them
+    struct BatchOutput {
+        std::shared_ptr<EnginePool> engine;
+        std::vector<TensorView> views;
+    };
+
+    static size_t sessionCount(const WorkerConfig& config) {
+        return config.num_sessions * config.device_ids.size();
+    }
+
+    // the device with the fewest sessions busy, taking turns among ties
+    std::shared_ptr<EnginePool> pickEngine(const ModelVersion& version) {
+        const auto& engines = version.engines;
+        size_t start = next_engine_.fetch_add(1, std::memory_order_relaxed);
+        size_t best = start % engines.size();
+        for (size_t i = 1; i < engines.size(); ++i) {
+            size_t candidate = (start + i) % engines.size();
+            if (engines[candidate]->busyCount() < engines[best]->busyCount()) {
+                best = candidate;
+            }
+        }
+        return engines[best];
+    }
+
+    std::vector<InferenceResponse> processBatch(
+        const std::vector<InferenceRequest>& requests) {
+        return packBatch(requests)();
+    }
+
+    // Packs the inputs into one tensor now and returns the closure that runs it,
+    // so in pipelined mode packing overlaps the previous batch's Run. The batch
+    // runs on the version current when it is packed.
+    InferenceBatcher::BatchRunner packBatch(const std::vector<InferenceRequest>& requests) {
+        StageTimer pack(stages_.pack);
+        std::vector<InputSpan> inputs;
+        std::vector<std::string> request_ids;
+        inputs.reserve(requests.size());
+        request_ids.reserve(requests.size());
+        for (const auto& req : requests) {
+            inputs.push_back(req.input->span());
+            request_ids.push_back(req.request_id);
+        }
+        auto batch = std::make_shared<PackedBatch>();
+        batch->engine = pickEngine(*current());
+        batch->input = batch->engine->packBatch(inputs);
+        int64_t pack_us = pack.stop();
         
-        // Check cache first
-        auto cached = cache_.get(input_data);
-        if (cached.has_value()) {
-            cache_hits_++;
-            json response;
-            response["request_id"] = request_id;
-            response["output_data"] = *cached;
-            response["node_id"] = node_id_;
-            response["cached"] = true;
-            response["inference_time_us"] = 50;  // Cache hit is very fast
+        return [this, batch, request_ids, pack_us]() {
+            StageTimer run(stages_.run);
+            // batch inference
+            auto output = std::make_shared<BatchOutput>();
+            output->engine = batch->engine;
+            output->views = batch->engine->runBatch(batch->input);
+            int64_t run_us = run.stop();
             
-            return response;
+            // every request in the batch waited for all of it
+            StageTimer unpack(stages_.unpack);
+            std::vector<InferenceResponse> responses;
+            responses.reserve(request_ids.size());
+            for (size_t i = 0; i < request_ids.size(); ++i) {
+                const TensorView& view = output->views[i];
+                InferenceResponse resp;
+                resp.request_id = request_ids[i];
+                resp.output_data = TensorView{
+                    std::shared_ptr<const float>(output, view.data.get()), view.size};
+                resp.inference_time_us = pack_us + run_us;
+                resp.cached = false;
+                responses.push_back(std::move(resp));
+            }
+            return responses;
+        };
+    }
+
+    std::string name_;
+    int shard_id_;
+    WorkerConfig config_;   // to load later versions the same way
+    WorkerStages& stages_;  // shared by the worker's models
+    std::shared_ptr<ModelVersion> current_;  // std::atomic_load/store only
+    std::mutex reload_mutex_;
+    std::atomic<size_t> next_engine_{0};
+    InferenceBatcher batch_processor_;
+};
+
+class WorkerNode {
+public:
+    explicit WorkerNode(const WorkerConfig& config)
+        : node_id_(config.node_id), bulk_window_(config.bulk_window) {
+        for (const auto& [name, path] : config.models) {
+            if (!model_index_.emplace(name, models_.size()).second) {
+                throw std::runtime_error("Model listed twice: " + name);
+            }
+            // the shard id is the model's slot in the registry
+            models_.push_back(std::make_unique<HostedModel>(
+                name, path, static_cast<int>(models_.size()), config, stages_));
+        }
+        if (models_.empty()) {
+            throw std::runtime_error("No models to serve");
+        }
+    }
+
+    ~WorkerNode() {
+        if (warmup_thread_.joinable()) {
+            warmup_thread_.join();
+        }
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        for (auto& reload : reload_threads_) {
+            reload.thread.join();
+        }
+    }
+
+    // Runs synthetic batches at every batch size of every model in the
+    // background; the node is live meanwhile but only ready, and accepting
+    // /infer, once it is done
+    void startWarmup() {
+        warmup_thread_ = std::thread([this] {
+            auto start = std::chrono::steady_clock::now();
+            for (auto& model : models_) {
+                try {
+                    model->current()->warmup();
+                } catch (const std::exception& e) {
+                    // synthetic inputs failing says little about real ones
+                    std::cerr << "Warmup of " << model->name() << " failed: " << e.what() << std::endl;
+                }
+            }
+            warmup_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            ready_.store(true);
+            std::cout << "Warmup done in " << warmup_ms_ << "ms, ready to accept requests!" << std::endl;
+        });
+    }
+
+    bool isReady() const { return ready_.load(); }
+    std::string cacheDescription() const { return models_.front()->current()->cache->describe(); }
+
+    // gets the encoded response body, or the error that failed the request
+    using ReplyCallback = std::function<void(std::string* body, std::exception_ptr error)>;
+    using Completion = InferenceBatcher::Completion;
+
+    // One request, JSON or an application/x-tensor frame; the response is in
+    // the same encoding. done runs once the request's batch finishes (or at
+    // once for a cache hit, a bad body or a rejection), so no thread waits
+    // meanwhile. The model ("model", or the frame's model name) and the
+    // batch lane ("priority": "batch", or the frame's batch priority flag)
+    // are chosen by the request; a request not batched by deadline is
+    // dropped.
+    void inferAsync(const std::string& body, bool binary,
+                    std::chrono::steady_clock::time_point deadline, ReplyCallback done) {
+        auto in_flight = std::make_shared<GaugeScope>(requests_in_flight_);
+        std::string request_id;
+        std::shared_ptr<const RequestInput> input;
+        HostedModel* model = nullptr;
+        SubmitOptions options;
+        options.deadline = deadline;
+        try {
+            StageTimer decode(stages_.decode);
+            if (binary) {
+                TensorFrame request;
+                decodeTensorFrame(body.data(), body.size(), request);
+                if (request.kind != FrameKind::REQUEST) {
+                    throw std::runtime_error("Expected a request frame");
+                }
+                request_id = request.request_id;
+                model = &modelFor(request.model);
+                input = frameInput(request);
+                if (request.flags & kFrameFlagBatchPriority) {
+                    options.priority = Priority::BATCH;
+                }
+            } else {
+                auto request = json::parse(body);
+                request_id = request["request_id"];
+                model = &modelFor(request.value("model", ""));
+                auto values = std::make_shared<RequestInput>();
+                values->values = request["input_data"].get<std::vector<float>>();
+                input = std::move(values);
+                options.priority = parsePriority(request.value("priority", "interactive"));
+            }
+        } catch (...) {
+            done(nullptr, std::current_exception());
+            return;
+        }
+        infer(*model, request_id, std::move(input), options,
+              [this, binary, model, done = std::move(done), in_flight](
+                      InferenceResponse* inf_resp, std::exception_ptr error) {
+            if (!inf_resp) {
+                done(nullptr, error);
+                return;
+            }
+            std::string out;
+            try {
+                StageTimer serialize(stages_.serialize);
+                if (binary) {
+                    appendResponseFrame(out, *inf_resp);
+                } else {
+                    json response;
+                    response["request_id"] = inf_resp->request_id;
+                    response["output_data"] = inf_resp->output_data;
+                    response["node_id"] = node_id_;
+                    response["model"] = model->name();
+                    response["cached"] = inf_resp->cached;
+                    response["inference_time_us"] = inf_resp->inference_time_us;
+                    out = response.dump();
+                }
+            } catch (...) {
+                done(nullptr, std::current_exception());
+                return;
+            }
+            done(&out, nullptr);
+        });
+    }
+
+    // {"model": name, "path": onnx path}, both optional: reloads the model
+    // (the default one) from path (the file it was loaded from) on a thread of
+    // its own while it goes on serving, and replies with the version swapped
+    // in once it is warm
+    void reloadAsync(const std::string& body, ReplyCallback done) {
+        HostedModel* model = nullptr;
+        std::string path;
+        try {
+            auto request = body.empty() ? json::object() : json::parse(body);
+            model = &modelFor(request.value("model", ""));
+            path = request.value("path", "");
+        } catch (...) {
+            done(nullptr, std::current_exception());
+            return;
+        }
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        // threads of earlier reloads that are done are joined here, so a
+        // worker reloaded again and again does not pile them up
+        reload_threads_.erase(std::remove_if(reload_threads_.begin(), reload_threads_.end(),
+            [](ReloadThread& reload) {
+                if (!reload.finished->load()) return false;
+                reload.thread.join();
+                return true;
+            }), reload_threads_.end());
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([model, path, finished, done = std::move(done)] {
+            runReload(*model, path, done);
+            finished->store(true);
+        });
+        reload_threads_.push_back(ReloadThread{std::move(thread), std::move(finished)});
+    }
+
+    static void runReload(HostedModel& model, const std::string& path, const ReplyCallback& done) {
+        std::string out;
+        try {
+            auto start = std::chrono::steady_clock::now();
+            auto version = model.reload(path);
+            json response;
+            response["model"] = model.name();
+            response["version"] = version->number;
+            response["model_path"] = version->model_path;
+            response["reload_ms"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            out = response.dump();
+        } catch (...) {
+            done(nullptr, std::current_exception());
+            return;
+        }
+        std::cout << "Reloaded " << model.name() << ": " << out << std::endl;
+        done(&out, nullptr);
+    }
+
+    // Concatenated request frames in, concatenated response frames out, in the
+    // same order. Cache hits are answered directly; the misses go into their
+    // models' batch processors together, once per distinct input, and done
+    // runs when the last of them finishes. They take the batch lane only if
+    // every frame asks for it.
+    void inferBatchAsync(const std::string& body, std::chrono::steady_clock::time_point deadline,
+                         ReplyCallback done) {
+        std::vector<TensorFrame> frames;
+        std::vector<HostedModel*> frame_models;
+        try {
+            StageTimer decode(stages_.decode);
+            frames = decodeRequestFrames(body);
+            frame_models = modelsFor(frames);
+        } catch (...) {
+            done(nullptr, std::current_exception());
+            return;
         }
         
-        // Cache miss - use batch processor
-        InferenceRequest inf_req{request_id, input_data};
-        InferenceResponse inf_resp = batch_processor_.process(inf_req);
-        cache_.put(input_data, inf_resp.output_data);
+        auto reply = std::make_shared<BatchReply>();
+        reply->responses.resize(frames.size());
+        reply->miss_of.assign(frames.size(), -1);
+        reply->done = std::move(done);
+        reply->in_flight = std::make_unique<GaugeScope>(requests_in_flight_, static_cast<int64_t>(frames.size()));
         
-        json response;
-        response["request_id"] = inf_resp.request_id;
-        response["output_data"] = inf_resp.output_data;
-        response["node_id"] = node_id_;
-        response["cached"] = false;
-        response["inference_time_us"] = inf_resp.inference_time_us;
+        SubmitOptions options;
+        options.deadline = deadline;
+        options.priority = Priority::BATCH;
+        std::unordered_map<HostedModel*, MissGroup> groups;
+        size_t miss_count = 0;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            if (!(frames[i].flags & kFrameFlagBatchPriority)) {
+                options.priority = Priority::INTERACTIVE;
+            }
+            HostedModel& model = *frame_models[i];
+            model.total_requests++;
+            MissGroup& group = groupFor(groups, model);
+            StageTimer lookup(stages_.cache_lookup);
+            ContentDigest key = digestBytes(frames[i].payload, frames[i].payload_bytes,
+                                            payloadDigestSeed(frames[i].dtype));
+            auto cached = group.version->cache->get(key);
+            int64_t lookup_us = lookup.stop();
+            // the request_id goes in for misses too, for finishBatch to keep
+            reply->responses[i].request_id = frames[i].request_id;
+            if (cached.has_value()) {
+                model.cache_hits++;
+                reply->responses[i] = InferenceResponse{frames[i].request_id, std::move(*cached), lookup_us, true};
+                continue;
+            }
+            auto [it, inserted] = group.index.emplace(key, miss_count);
+            if (inserted) {
+                group.requests.push_back(InferenceRequest{frames[i].request_id, frameInput(frames[i])});
+                group.keys.push_back(key);
+                group.slots.push_back(miss_count++);
+            } else {
+                model.coalesced_requests++;
+            }
+            reply->miss_of[i] = static_cast<int>(it->second);
+        }
+        if (miss_count == 0) {
+            finishBatch(*reply);
+            return;
+        }
+        
+        reply->computed.resize(miss_count);
+        reply->remaining.store(miss_count);
+        for (auto& [model, group] : groups) {
+            if (group.requests.empty()) continue;
+            std::vector<Completion> completions;
+            completions.reserve(group.requests.size());
+            for (size_t m = 0; m < group.requests.size(); ++m) {
+                completions.push_back([this, reply, version = group.version, slot = group.slots[m],
+                                       key = group.keys[m]](
+                        InferenceResponse* response, std::exception_ptr error) {
+                    if (response) {
+                        version->cache->put(key, response->output_data);
+                        reply->computed[slot] = std::move(*response);
+                    } else {
+                        std::lock_guard<std::mutex> lock(reply->error_mutex);
+                        if (!reply->error) reply->error = error;
+                    }
+                    if (reply->remaining.fetch_sub(1) == 1) {
+                        finishBatch(*reply);
+                    }
+                });
+            }
+            model->batcher().submitWindowed(std::move(group.requests), std::move(completions), options,
+                                            bulk_window_);
+        }
+    }
+
+    // Same input as /infer_batch, but nothing waits for the whole body: cache
+    // hits go out first and every other response frame is handed to the
+    // returned stream as soon as its batch finishes, so responses arrive in
+    // completion order and the caller matches them up by request_id. A
+    // request whose batch failed, or that was shed, gets an error frame
+    // instead. Bulk scoring always takes the batch lane.
+    std::shared_ptr<FrameStream> handleInferStream(const std::string& body,
+                                                   std::chrono::steady_clock::time_point deadline) {
+        StageTimer decode(stages_.decode);
+        std::vector<TensorFrame> frames = decodeRequestFrames(body);
+        std::vector<HostedModel*> frame_models = modelsFor(frames);
+        decode.stop();
+        auto stream = std::make_shared<FrameStream>(frames.size());
+        
+        std::string hits;
+        size_t hit_count = 0;
+        std::unordered_map<HostedModel*, MissGroup> groups;
+        // request_ids waiting on each distinct miss, by slot
+        std::vector<std::vector<std::string>> waiting;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const TensorFrame& frame = frames[i];
+            HostedModel& model = *frame_models[i];
+            model.total_requests++;
+            MissGroup& group = groupFor(groups, model);
+            StageTimer lookup(stages_.cache_lookup);
+            ContentDigest key = digestBytes(frame.payload, frame.payload_bytes, payloadDigestSeed(frame.dtype));
+            auto cached = group.version->cache->get(key);
+            int64_t lookup_us = lookup.stop();
+            if (cached.has_value()) {
+                model.cache_hits++;
+                appendResponseFrame(hits, InferenceResponse{frame.request_id, std::move(*cached), lookup_us, true});
+                hit_count++;
+                continue;
+            }
+            auto [it, inserted] = group.index.emplace(key, waiting.size());
+            if (inserted) {
+                group.requests.push_back(InferenceRequest{frame.request_id, frameInput(frame)});
+                group.keys.push_back(key);
+                group.slots.push_back(waiting.size());
+                waiting.emplace_back();
+            } else {
+                model.coalesced_requests++;
+            }
+            waiting[it->second].push_back(frame.request_id);
+        }
+        if (hit_count > 0) {
+            stream->push(std::move(hits), hit_count);
+        }
+        requests_in_flight_ += static_cast<int64_t>(frames.size() - hit_count);
         
-        return response;
+        SubmitOptions options;
+        options.priority = Priority::BATCH;
+        options.deadline = deadline;
+        // one log line per call, not per shed request; the batcher counts them
+        auto logged = std::make_shared<std::atomic<bool>>(false);
+        for (auto& [model, group] : groups) {
+            if (group.requests.empty()) continue;
+            std::vector<Completion> done;
+            done.reserve(group.requests.size());
+            for (size_t m = 0; m < group.requests.size(); ++m) {
+                done.push_back([this, stream, logged, version = group.version, key = group.keys[m],
+                                ids = std::move(waiting[group.slots[m]])](
+                        InferenceResponse* response, std::exception_ptr error) {
+                    std::string out;
+                    if (response) {
+                        version->cache->put(key, response->output_data);
+                        StageTimer serialize(stages_.serialize);
+                        for (const auto& id : ids) {
+                            response->request_id = id;
+                            appendResponseFrame(out, *response);
+                        }
+                    } else {
+                        try {
+                            std::rethrow_exception(error);
+                        } catch (const std::exception& e) {
+                            if (!logged->exchange(true)) {
+                                std::cerr << "Streamed requests failed: " << e.what() << std::endl;
+                            }
+                        }
+                        for (const auto& id : ids) {
+                            appendErrorFrame(out, id, node_id_);
+                        }
+                    }
+                    requests_in_flight_ -= static_cast<int64_t>(ids.size());
+                    stream->push(std::move(out), ids.size());
+                });
+            }
+            model->batcher().submitWindowed(std::move(group.requests), std::move(done), options, bulk_window_);
+        }
+        return stream;
     }
-    
+
     json getHealth() {
-        auto batch_metrics = batch_processor_.getMetrics();
         json health;
-        health["healthy"] = true;
+        health["healthy"] = true;  // liveness: the process is up and serving
+        health["ready"] = isReady();
+        if (isReady()) {
+            health["warmup_ms"] = warmup_ms_;
+        }
         health["node_id"] = node_id_;
-        health["total_requests"] = total_requests_.load();
-        health["cache_hits"] = cache_hits_.load();
-        health["cache_size"] = cache_.size();
-        health["cache_hit_rate"] = cache_.getHitRate();
+        health["default_model"] = models_.front()->name();
+        // queued or running, from every client; gateways weigh routing by it
+        health["requests_in_flight"] = requests_in_flight_.load();
+        int64_t total_requests = 0;
+        int64_t cache_hits = 0;
+        int64_t coalesced_requests = 0;
+        size_t cache_size = 0;
+        json models = json::object();
+        for (auto& model : models_) {
+            models[model->name()] = modelHealth(*model);
+            total_requests += model->total_requests.load();
+            cache_hits += model->cache_hits.load();
+            coalesced_requests += model->coalesced_requests.load();
+            cache_size += model->current()->cache->size();
+        }
+        // totals over every model
+        health["total_requests"] = total_requests;
+        health["cache_hits"] = cache_hits;
+        health["cache_size"] = cache_size;
+        health["coalesced_requests"] = coalesced_requests;
+        health["models"] = models;
+        return health;
+    }
+
+    // per-model series carry a model label
+    std::string getMetrics() {
+        std::vector<InferenceBatcher::Metrics> batch_metrics;
+        std::vector<std::string> labels;
+        for (auto& model : models_) {
+            batch_metrics.push_back(model->batcher().getMetrics());
+            labels.push_back("model=\"" + model->name() + "\"");
+        }
+        PrometheusWriter out;
+        const std::string stage_help = "Time spent per worker stage";
+        const char* stage_name = "worker_stage_duration_seconds";
+        out.summary(stage_name, stage_help, stages_.decode, "stage=\"decode\"");
+        out.summary(stage_name, stage_help, stages_.cache_lookup, "stage=\"cache_lookup\"");
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.summary(stage_name, stage_help, models_[i]->batcher().queueWaitHistogram(),
+                        "stage=\"queue_wait\"," + labels[i]);
+        }
+        out.summary(stage_name, stage_help, stages_.pack, "stage=\"pack\"");
+        out.summary(stage_name, stage_help, stages_.run, "stage=\"run\"");
+        out.summary(stage_name, stage_help, stages_.unpack, "stage=\"unpack\"");
+        out.summary(stage_name, stage_help, stages_.serialize, "stage=\"serialize\"");
+        out.gauge("worker_ready", "1 once warmup is done", isReady() ? 1 : 0);
+        out.gauge("worker_requests_in_flight", "Requests received and not yet answered", requests_in_flight_.load());
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.gauge("worker_queue_depth", "Requests waiting to be batched", batch_metrics[i].queue_depth, labels[i]);
+        }
+        const std::string lane_help = "Requests waiting to be batched, per priority lane";
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.gauge("worker_lane_queue_depth", lane_help, batch_metrics[i].interactive_queued,
+                      labels[i] + ",lane=\"interactive\"");
+            out.gauge("worker_lane_queue_depth", lane_help, batch_metrics[i].batch_queued,
+                      labels[i] + ",lane=\"batch\"");
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.gauge("worker_batches_in_flight", "Batches being run", batch_metrics[i].batches_in_flight, labels[i]);
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            for (const auto& engine : models_[i]->current()->engines) {
+                out.gauge("worker_sessions_busy", "Inference sessions running a batch", engine->busyCount(),
+                          labels[i] + ",device=\"" + std::to_string(engine->deviceId()) + "\"");
+            }
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.counter("worker_requests_total", "Requests received", models_[i]->total_requests.load(), labels[i]);
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.counter("worker_cache_hits_total", "Requests answered from the result cache",
+                        models_[i]->cache_hits.load(), labels[i]);
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.counter("worker_coalesced_requests_total", "Misses served by an identical request in flight",
+                        models_[i]->coalesced_requests.load(), labels[i]);
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.counter("worker_batches_total", "Batches run", batch_metrics[i].total_batches, labels[i]);
+        }
+        const std::string shed_help = "Requests shed instead of run";
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.counter("worker_shed_requests_total", shed_help, batch_metrics[i].rejected_queue_full,
+                        labels[i] + ",reason=\"queue_full\"");
+            out.counter("worker_shed_requests_total", shed_help, batch_metrics[i].rejected_deadline,
+                        labels[i] + ",reason=\"deadline\"");
+            out.counter("worker_shed_requests_total", shed_help, batch_metrics[i].expired,
+                        labels[i] + ",reason=\"expired\"");
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.gauge("worker_cache_entries", "Entries in the result cache",
+                      models_[i]->current()->cache->size(), labels[i]);
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.gauge("worker_model_version", "Version of the model serving requests, 1 until reloaded",
+                      models_[i]->current()->number, labels[i]);
+        }
+        for (size_t i = 0; i < models_.size(); ++i) {
+            out.counter("worker_model_reloads_total", "Reloads swapped in", models_[i]->reloads.load(), labels[i]);
+        }
+        return out.str();
+    }
+
+private:
+    // the model a request names; the default one for an empty name
+    HostedModel& modelFor(const std::string& name) {
+        if (name.empty()) {
+            return *models_.front();
+        }
+        auto it = model_index_.find(name);
+        if (it == model_index_.end()) {
+            throw UnknownModelError(name);
+        }
+        return *models_[it->second];
+    }
+
+    // every frame's model, so an unknown one fails the call before any of it runs
+    std::vector<HostedModel*> modelsFor(const std::vector<TensorFrame>& frames) {
+        std::vector<HostedModel*> models;
+        models.reserve(frames.size());
+        for (const TensorFrame& frame : frames) {
+            models.push_back(&modelFor(frame.model));
+        }
+        return models;
+    }
+
+    json modelHealth(HostedModel& model) {
+        auto batch_metrics = model.batcher().getMetrics();
+        auto version = model.current();
+        ResultCache& cache = *version->cache;
+        json health;
+        health["model_path"] = version->model_path;
+        health["version"] = version->number;
+        health["reloads"] = model.reloads.load();
+        health["total_requests"] = model.total_requests.load();
+        health["cache_hits"] = model.cache_hits.load();
+        health["cache_size"] = cache.size();
+        health["cache_hit_rate"] = cache.getHitRate();
+        health["coalesced_requests"] = model.coalesced_requests.load();
+        if (cache.capacityBytes() > 0) {
+            health["cache_bytes"] = cache.bytesUsed();
+            health["cache_capacity_bytes"] = cache.capacityBytes();
+        }
         // batch processor metrics
         json batch_stats;
         batch_stats["total_batches"] = batch_metrics.total_batches;
         batch_stats["avg_batch_size"] = batch_metrics.avg_batch_size;
         batch_stats["timeout_batches"] = batch_metrics.timeout_batches;
         batch_stats["full_batches"] = batch_metrics.full_batches;
+        batch_stats["batches_in_flight"] = batch_metrics.batches_in_flight;
+        batch_stats["queue_depth"] = batch_metrics.queue_depth;
+        batch_stats["interactive_queued"] = batch_metrics.interactive_queued;
+        batch_stats["batch_queued"] = batch_metrics.batch_queued;
+        batch_stats["rejected_queue_full"] = batch_metrics.rejected_queue_full;
+        batch_stats["rejected_deadline"] = batch_metrics.rejected_deadline;
+        batch_stats["expired"] = batch_metrics.expired;
+        batch_stats["run_time_ewma_us"] = batch_metrics.run_time_ewma_us;
+        batch_stats["adaptive"] = batch_metrics.adaptive;
+        if (batch_metrics.adaptive) {
+            json adaptive;
+            adaptive["target_batch_size"] = batch_metrics.target_batch_size;
+            adaptive["batch_wait_us"] = batch_metrics.batch_wait_us;
+            adaptive["arrival_rate"] = batch_metrics.arrival_rate;
+            adaptive["observed_p99_us"] = batch_metrics.observed_p99_us;
+            adaptive["latency_target_us"] = batch_metrics.latency_target_us;
+            adaptive["budget_scale"] = batch_metrics.budget_scale;
+            // measured run time per batch size, index = batch size
+            adaptive["run_time_us_by_size"] = batch_metrics.run_time_us_by_size;
+            batch_stats["adaptive_policy"] = adaptive;
+        }
         health["batch_processor"] = batch_stats;
+        json pool_stats;
+        pool_stats["sessions"] = version->sessions();
+        pool_stats["busy"] = version->busySessions();
+        pool_stats["batch_buckets"] = version->engines.front()->getBatchBuckets();
+        pool_stats["cuda_graphs"] = version->engines.front()->isCudaGraphEnabled();
+        pool_stats["float16"] = version->engines.front()->isFloat16Model();
+        json devices = json::array();
+        for (const auto& engine : version->engines) {
+            json device;
+            device["device_id"] = engine->deviceId();
+            device["accelerated"] = engine->isCudaEnabled();
+            device["sessions"] = engine->size();
+            device["busy"] = engine->busyCount();
+            devices.push_back(device);
+        }
+        pool_stats["devices"] = devices;
+        health["engine_pool"] = pool_stats;
         
         return health;
     }
-    
-private:
-    std::vector<InferenceResponse> processBatch(
-        const std::vector<InferenceRequest>& requests) {
-        auto start = std::chrono::high_resolution_clock::now();
-        std::vector<std::vector<float>> inputs;
-        inputs.reserve(requests.size());
-        for (const auto& req : requests) {
-            inputs.push_back(req.input_data);
+
+    static Priority parsePriority(const std::string& name) {
+        if (name == "interactive") return Priority::INTERACTIVE;
+        if (name == "batch") return Priority::BATCH;
+        throw std::runtime_error("Unknown priority: " + name);
+    }
+
+    static std::vector<TensorFrame> decodeRequestFrames(const std::string& body) {
+        std::vector<TensorFrame> frames;
+        for (size_t offset = 0; offset < body.size();) {
+            TensorFrame frame;
+            offset += decodeTensorFrame(body.data() + offset, body.size() - offset, frame);
+            if (frame.kind != FrameKind::REQUEST) {
+                throw std::runtime_error("Expected a request frame");
+            }
+            frames.push_back(std::move(frame));
         }
+        return frames;
+    }
+
+    void appendResponseFrame(std::string& out, const InferenceResponse& inf_resp) const {
+        TensorFrame response;
+        response.kind = FrameKind::RESPONSE;
+        response.request_id = inf_resp.request_id;
+        response.node_id = node_id_;
+        response.flags = inf_resp.cached ? kFrameFlagCached : 0;
+        response.inference_time_us = inf_resp.inference_time_us;
+        appendTensorFrame(out, response, inf_resp.output_data.begin(), inf_resp.output_data.size);
+    }
+
+    // The model's cache, then its batch processor, once per distinct input in
+    // flight; identical concurrent requests in the same lane, with no later
+    // deadline, get that result. Both are the current version's, so a reload starts from an empty cache.
+    void infer(HostedModel& model, const std::string& request_id,
+               std::shared_ptr<const RequestInput> input,
+               const SubmitOptions& options, Completion done) {
+        model.total_requests++;
+        auto version = model.current();
         
-        // batch inference
-        auto outputs = engine_.batchPredict(inputs);
+        // Check cache first; the input is hashed once, here
+        StageTimer lookup(stages_.cache_lookup);
+        ContentDigest key = input->digest();
+        auto cached = version->cache->get(key);
+        int64_t lookup_us = lookup.stop();
+        if (cached.has_value()) {
+            model.cache_hits++;
+            InferenceResponse hit{request_id, std::move(*cached), lookup_us, true};
+            done(&hit, nullptr);
+            return;
+        }
         
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-            end - start).count();
+        using Flight = SingleFlight<ContentDigest, InferenceResponse, DigestHash, SubmitOptions>;
+        auto suits = [&options](const SubmitOptions& first) {
+            return first.priority == options.priority && options.deadline <= first.deadline;
+        };
+        bool shared = version->in_flight.join(key, options, suits,
+            [request_id, done = std::move(done)](const InferenceResponse* value, std::exception_ptr error) {
+                if (!value) {
+                    done(nullptr, error);
+                    return;
+                }
+                InferenceResponse inf_resp = *value;
+                inf_resp.request_id = request_id;
+                done(&inf_resp, nullptr);
+            },
+            [&model, &version, key, &request_id, &input, &options](Flight::Finish finish) {
+                model.batcher().submit(InferenceRequest{request_id, input},
+                    [version, key, finish = std::move(finish)](InferenceResponse* computed, std::exception_ptr error) {
+                        if (computed) {
+                            version->cache->put(key, computed->output_data);
+                        }
+                        finish(computed, error);
+                    }, options);
+            });
+        if (shared) {
+            model.coalesced_requests++;
+        }
+    }
+
+    // one model's share of a multi-frame call, each distinct missed input once
+    struct MissGroup {
+        std::shared_ptr<ModelVersion> version;  // looked up once per call
+        std::vector<InferenceRequest> requests;
+        std::vector<ContentDigest> keys;
+        std::vector<size_t> slots;  // per request: where the call keeps its result
+        std::unordered_map<ContentDigest, size_t, DigestHash> index;  // digest -> slot
+    };
+
+    static MissGroup& groupFor(std::unordered_map<HostedModel*, MissGroup>& groups, HostedModel& model) {
+        MissGroup& group = groups[&model];
+        if (!group.version) {
+            group.version = model.current();
+        }
+        return group;
+    }
+
+    // an inferBatchAsync call, shared by its misses' completions
+    struct BatchReply {
         std::vector<InferenceResponse> responses;
-        responses.reserve(requests.size());
-        int64_t per_request_time = duration / requests.size();
-        for (size_t i = 0; i < requests.size(); ++i) {
-            InferenceResponse resp;
-            resp.request_id = requests[i].request_id;
-            resp.output_data = outputs[i];
-            resp.inference_time_us = per_request_time;
-            resp.cached = false;
-            responses.push_back(resp);
-        }
-        return responses;
-    }
-    
+        // index into computed, per frame; -1 = answered from the cache
+        std::vector<int> miss_of;
+        std::vector<InferenceResponse> computed;
+        std::atomic<size_t> remaining{0};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        ReplyCallback done;
+        std::unique_ptr<GaugeScope> in_flight;
+    };
+
+    // encodes the frames once every miss is in, or fails the whole batch
+    void finishBatch(BatchReply& reply) {
+        if (reply.error) {
+            reply.in_flight.reset();
+            reply.done(nullptr, reply.error);
+            return;
+        }
+        std::string out;
+        {
+            StageTimer serialize(stages_.serialize);
+            for (size_t i = 0; i < reply.responses.size(); ++i) {
+                if (reply.miss_of[i] >= 0) {
+                    std::string request_id = std::move(reply.responses[i].request_id);
+                    reply.responses[i] = reply.computed[reply.miss_of[i]];
+                    reply.responses[i].request_id = std::move(request_id);
+                }
+                appendResponseFrame(out, reply.responses[i]);
+            }
+        }
+        reply.in_flight.reset();
+        reply.done(&out, nullptr);
+    }
+
     std::string node_id_;
-    int port_;
-    InferenceEngine engine_;
-    LRUCache<std::vector<float>, std::vector<float>, VectorHash> cache_;
-    BatchProcessor<InferenceRequest, InferenceResponse> batch_processor_;
-    
-    std::atomic<int64_t> total_requests_;
-    std::atomic<int64_t> cache_hits_;
+    size_t bulk_window_;
+    std::atomic<int64_t> requests_in_flight_{0};  // requests received and not yet answered
+    WorkerStages stages_;
+    // in registration order, the default first; stopped before stages_ goes
+    std::vector<std::unique_ptr<HostedModel>> models_;
+    std::unordered_map<std::string, size_t> model_index_;
+    std::thread warmup_thread_;
+    std::mutex reload_mutex_;
+    struct ReloadThread {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;  // set as the thread's last act
+    };
+    std::vector<ReloadThread> reload_threads_;  // joined on the next reload or on shutdown
+    std::atomic<bool> ready_{false};
+    int64_t warmup_ms_ = 0;  // written before ready_ is set
 };
 
+static std::string errorBody(const std::string& message) {
+    json error;
+    error["error"] = message;
+    return error.dump();
+}
+
+// 503 + Retry-After while warming up, so callers move on to another node
+static void rejectNotReady(httplib::Response& res) {
+    res.status = 503;
+    res.set_header("Retry-After", "1");
+    res.set_content(errorBody("warming up"), "application/json");
+}
+
+static void rejectNotReady(const HttpReply& reply) {
+    reply.send(503, "application/json", errorBody("warming up"), {{"Retry-After", "1"}});
+}
+
+static void rejectBadRequest(httplib::Response& res, const std::string& message) {
+    res.status = 400;
+    res.set_content(errorBody(message), "application/json");
+}
+
+// an unknown model is 404: the gateway moves on to a worker that serves it
+static void rejectUnknownModel(httplib::Response& res, const UnknownModelError& e) {
+    res.status = 404;
+    res.set_content(errorBody(e.what()), "application/json");
+}
+
+// Shed load: 429 for a full lane, 503 when the deadline cannot be met. Both
+// carry Retry-After, and the gateway takes either as backpressure and moves
+// on to another node, not as a failure.
+static int shedStatus(const RejectedError& e) {
+    return e.reason() == RejectedError::Reason::QUEUE_FULL ? 429 : 503;
+}
+
+// longest X-Deadline-Ms budget taken as given; larger ones are cut to it,
+// so adding one to now() cannot overflow
+constexpr int64_t kMaxDeadlineMs = 24 * 3600 * 1000;
+
+// From the caller's X-Deadline-Ms budget; none without the header. nullopt
+// when the budget is not a positive number of milliseconds.
+static std::optional<std::chrono::steady_clock::time_point> requestDeadline(const std::string& budget_ms) {
+    if (budget_ms.empty()) {
+        return std::chrono::steady_clock::time_point::max();
+    }
+    int64_t budget = 0;
+    try {
+        size_t parsed = 0;
+        budget = std::stoll(budget_ms, &parsed);
+        if (parsed != budget_ms.size()) return std::nullopt;
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+    if (budget <= 0) {
+        return std::nullopt;
+    }
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(std::min(budget, kMaxDeadlineMs));
+}
+
+static const char* kBadDeadline = "X-Deadline-Ms must be a positive number of milliseconds";
+
+// httplib front end: every request holds a server thread, which waits on the
+// worker's asynchronous path
+static void serveThreads(WorkerNode& worker, int port) {
+    httplib::Server server;
+    // inference endpoint
+    server.Post("/infer", [&worker](const httplib::Request& req, httplib::Response& res) {
+        if (!worker.isReady()) {
+            rejectNotReady(res);
+            return;
+        }
+        auto deadline = requestDeadline(req.get_header_value(kDeadlineHeader));
+        if (!deadline) {
+            rejectBadRequest(res, kBadDeadline);
+            return;
+        }
+        try {
+            bool binary = isTensorContentType(req.get_header_value("Content-Type"));
+            std::string body = awaitCompletion<std::string>([&](WorkerNode::ReplyCallback done) {
+                worker.inferAsync(req.body, binary, *deadline, std::move(done));
+            });
+            res.set_content(body, binary ? kTensorContentType : "application/json");
+        } catch (const RejectedError& e) {
+            res.status = shedStatus(e);
+            res.set_header("Retry-After", "1");
+            res.set_content(errorBody(e.what()), "application/json");
+        } catch (const UnknownModelError& e) {
+            rejectUnknownModel(res, e);
+        } catch (const std::exception& e) {
+            res.status = 500;
+            res.set_content(errorBody(e.what()), "application/json");
+        }
+    });
+    // batch of binary requests, e.g. from the gateway's batcher
+    server.Post("/infer_batch", [&worker](const httplib::Request& req, httplib::Response& res) {
+        if (!worker.isReady()) {
+            rejectNotReady(res);
+            return;
+        }
+        auto deadline = requestDeadline(req.get_header_value(kDeadlineHeader));
+        if (!deadline) {
+            rejectBadRequest(res, kBadDeadline);
+            return;
+        }
+        try {
+            if (!isTensorContentType(req.get_header_value("Content-Type"))) {
+                throw std::runtime_error("/infer_batch takes application/x-tensor frames");
+            }
+            std::string body = awaitCompletion<std::string>([&](WorkerNode::ReplyCallback done) {
+                worker.inferBatchAsync(req.body, *deadline, std::move(done));
+            });
+            res.set_content(body, kTensorContentType);
+        } catch (const RejectedError& e) {
+            res.status = shedStatus(e);
+            res.set_header("Retry-After", "1");
+            res.set_content(errorBody(e.what()), "application/json");
+        } catch (const UnknownModelError& e) {
+            rejectUnknownModel(res, e);
+        } catch (const std::exception& e) {
+            res.status = 500;
+            res.set_content(errorBody(e.what()), "application/json");
+        }
+    });
+    // bulk scoring: one long body of request frames, response frames streamed
+    // back as chunks in completion order
+    server.Post("/infer_stream", [&worker](const httplib::Request& req, httplib::Response& res) {
+        if (!worker.isReady()) {
+            rejectNotReady(res);
+            return;
+        }
+        auto deadline = requestDeadline(req.get_header_value(kDeadlineHeader));
+        if (!deadline) {
+            rejectBadRequest(res, kBadDeadline);
+            return;
+        }
+        try {
+            if (!isTensorContentType(req.get_header_value("Content-Type"))) {
+                throw std::runtime_error("/infer_stream takes application/x-tensor frames");
+            }
+            auto stream = worker.handleInferStream(req.body, *deadline);
+            res.set_chunked_content_provider(
+                kTensorContentType,
+                [stream](size_t, httplib::DataSink& sink) {
+                    std::string chunk;
+                    if (!stream->next(chunk)) {
+                        sink.done();
+                        return true;
+                    }
+                    return sink.write(chunk.data(), chunk.size());
+                },
+                [stream](bool) { stream->close(); });
+        } catch (const UnknownModelError& e) {
+            rejectUnknownModel(res, e);
+        } catch (const std::exception& e) {
+            res.status = 500;
+            res.set_content(errorBody(e.what()), "application/json");
+        }
+    });
+    // swap in a freshly loaded version of a model without dropping requests
+    server.Post("/reload", [&worker](const httplib::Request& req, httplib::Response& res) {
+        try {
+            std::string body = awaitCompletion<std::string>([&](WorkerNode::ReplyCallback done) {
+                worker.reloadAsync(req.body, std::move(done));
+            });
+            res.set_content(body, "application/json");
+        } catch (const UnknownModelError& e) {
+            rejectUnknownModel(res, e);
+        } catch (const std::exception& e) {
+            res.status = 500;
+            res.set_content(errorBody(e.what()), "application/json");
+        }
+    });
+    // health endpoint
+    server.Get("/health", [&worker](const httplib::Request&, httplib::Response& res) {
+        auto health = worker.getHealth();
+        res.set_content(health.dump(), "application/json");
+    });
+    // Prometheus scrape endpoint: per-stage latency quantiles and load gauges
+    server.Get("/metrics", [&worker](const httplib::Request&, httplib::Response& res) {
+        res.set_content(worker.getMetrics(), PrometheusWriter::kContentType);
+    });
+    // readiness probe for load balancers: 200 once warm, 503 before
+    server.Get("/ready", [&worker](const httplib::Request&, httplib::Response& res) {
+        json ready;
+        ready["ready"] = worker.isReady();
+        res.status = worker.isReady() ? 200 : 503;
+        res.set_content(ready.dump(), "application/json");
+    });
+    server.listen("0.0.0.0", port);
+}
+
+// replies with the encoded body, or the error: shed load as in
+// shedStatus, an unknown model as a 404, anything else as a 500
+static WorkerNode::ReplyCallback replyWith(HttpReply reply, const char* content_type) {
+    return [reply, content_type](std::string* body, std::exception_ptr error) {
+        if (body) {
+            reply.send(200, content_type, std::move(*body));
+            return;
+        }
+        try {
+            std::rethrow_exception(error);
+        } catch (const RejectedError& e) {
+            reply.send(shedStatus(e), "application/json", errorBody(e.what()), {{"Retry-After", "1"}});
+        } catch (const UnknownModelError& e) {
+            reply.send(404, "application/json", errorBody(e.what()));
+        } catch (...) {
+            reply.send(500, "application/json", errorBody(errorMessage(error)));
+        }
+    };
+}
+
+// epoll front end: handlers return as soon as the request is queued and the
+// reply goes out from the batch thread's completion, so requests waiting on
+// a batch hold a connection each but no thread. /infer_batch and
+// /infer_stream bodies (up to 1 GiB) are decoded, digested and looked up on
+// a pool of their own, not on the loop serving every other connection.
+static bool serveEvents(WorkerNode& worker, int port, size_t threads) {
+    EventLoopGroup loops(threads);
+    loops.start();
+    httplib::ThreadPool bulk(threads);
+    EventServer server(loops.loops());
+    server.handle("POST", "/infer", [&worker](HttpRequest& req, HttpReply reply) {
+        if (!worker.isReady()) {
+            rejectNotReady(reply);
+            return;
+        }
+        auto deadline = requestDeadline(req.header(kDeadlineHeader));
+        if (!deadline) {
+            reply.send(400, "application/json", errorBody(kBadDeadline));
+            return;
+        }
+        bool binary = isTensorContentType(req.header("Content-Type"));
+        worker.inferAsync(req.body, binary, *deadline,
+                          replyWith(reply, binary ? kTensorContentType : "application/json"));
+    });
+    server.handle("POST", "/infer_batch", [&worker, &bulk](HttpRequest& req, HttpReply reply) {
+        if (!worker.isReady()) {
+            rejectNotReady(reply);
+            return;
+        }
+        if (!isTensorContentType(req.header("Content-Type"))) {
+            reply.send(500, "application/json", errorBody("/infer_batch takes application/x-tensor frames"));
+            return;
+        }
+        auto deadline = requestDeadline(req.header(kDeadlineHeader));
+        if (!deadline) {
+            reply.send(400, "application/json", errorBody(kBadDeadline));
+            return;
+        }
+        bulk.enqueue([&worker, body = std::move(req.body), deadline, reply] {
+            worker.inferBatchAsync(body, *deadline, replyWith(reply, kTensorContentType));
+        });
+    });
+    server.handle("POST", "/infer_stream", [&worker, &bulk](HttpRequest& req, HttpReply reply) {
+        if (!worker.isReady()) {
+            rejectNotReady(reply);
+            return;
+        }
+        if (!isTensorContentType(req.header("Content-Type"))) {
+            reply.send(500, "application/json", errorBody("/infer_stream takes application/x-tensor frames"));
+            return;
+        }
+        auto deadline = requestDeadline(req.header(kDeadlineHeader));
+        if (!deadline) {
+            reply.send(400, "application/json", errorBody(kBadDeadline));
+            return;
+        }
+        bulk.enqueue([&worker, body = std::move(req.body), deadline, reply] {
+            std::shared_ptr<FrameStream> stream;
+            try {
+                stream = worker.handleInferStream(body, *deadline);
+            } catch (const UnknownModelError& e) {
+                reply.send(404, "application/json", errorBody(e.what()));
+                return;
+            } catch (const std::exception& e) {
+                reply.send(500, "application/json", errorBody(e.what()));
+                return;
+            }
+            reply.startStream(200, kTensorContentType);
+            // frames for a client that has gone are dropped by the reply
+            stream->forwardTo([reply](std::string chunk, bool last) {
+                if (!chunk.empty()) {
+                    reply.write(std::move(chunk));
+                }
+                if (last) {
+                    reply.end();
+                }
+            });
+        });
+    });
+    server.handle("POST", "/reload", [&worker](HttpRequest& req, HttpReply reply) {
+        worker.reloadAsync(req.body, replyWith(reply, "application/json"));
+    });
+    server.handle("GET", "/health", [&worker](HttpRequest&, HttpReply reply) {
+        reply.send(200, "application/json", worker.getHealth().dump());
+    });
+    server.handle("GET", "/metrics", [&worker](HttpRequest&, HttpReply reply) {
+        reply.send(200, PrometheusWriter::kContentType, worker.getMetrics());
+    });
+    server.handle("GET", "/ready", [&worker](HttpRequest&, HttpReply reply) {
+        json ready;
+        ready["ready"] = worker.isReady();
+        reply.send(worker.isReady() ? 200 : 503, "application/json", ready.dump());
+    });
+    bool listening = server.listen("0.0.0.0", port);
+    if (listening) {
+        loops.join();
+    }
+    bulk.shutdown();
+    return listening;
+}
+
 int main(int argc, char** argv) {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <port> <node_id> [model_path]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <port> <node_id> [model_path] [options]" << std::endl;
         std::cerr << "  Or set MODEL_PATH environment variable" << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --max-batch N        largest batch (default: 32)" << std::endl;
+        std::cerr << "  --batch-timeout-ms N longest wait for a batch (default: 20)" << std::endl;
+        std::cerr << "  --adaptive 0|1       tune batch size and wait online (default: 0)" << std::endl;
+        std::cerr << "  --latency-target-ms N  p99 target for adaptive batching (default: 50)" << std::endl;
+        std::cerr << "  --sessions N         concurrent inference sessions (default: 1)" << std::endl;
+        std::cerr << "  --batch-workers N    threads running batches (default: one per session)" << std::endl;
+        std::cerr << "  --pipeline 0|1       pack the next batch while one runs (default: 0)" << std::endl;
+        std::cerr << "  --device N           CUDA device id (default: 0)" << std::endl;
+        std::cerr << "  --devices 0,1,...    one engine pool per device, batches spread over them (default: 0)" << std::endl;
+        std::cerr << "  --providers LIST     execution providers to try in order: tensorrt,cuda,openvino,cpu (default: cuda,cpu)" << std::endl;
+        std::cerr << "  --intra-op-threads N ORT threads per session, 0 = ORT default (default: 4)" << std::endl;
+        std::cerr << "  --inter-op-threads N run graph branches in parallel on N threads (default: off)" << std::endl;
+        std::cerr << "  --cpus LIST          pin ORT and batcher threads to these CPUs, e.g. 0-15,32-47 (default: off)" << std::endl;
+        std::cerr << "  --numa-node N        pin them to the CPUs of NUMA node N (default: off)" << std::endl;
+        std::cerr << "  --io-binding 0|1     bind preallocated device buffers (default: 1)" << std::endl;
+        std::cerr << "  --queue mutex|lockfree  request queue backend (default: mutex)" << std::endl;
+        std::cerr << "  --queue-capacity N   lock-free ring slots (default: 4096)" << std::endl;
+        std::cerr << "  --queue-limit N      queued requests per priority lane, 0 = unbounded (default: 1024)" << std::endl;
+        std::cerr << "  --bulk-window N      misses of one bulk call queued at once (default: 512)" << std::endl;
+        std::cerr << "  --buckets 1,2,4,...  pad batches up to these sizes (default: none)" << std::endl;
+        std::cerr << "  --cuda-graphs 0|1    capture a CUDA graph per bucket (default: 0)" << std::endl;
+        std::cerr << "  --cache-entries N    result cache entries (default: 1000)" << std::endl;
+        std::cerr << "  --cache-mb N         byte-budgeted result cache instead (default: off)" << std::endl;
+        std::cerr << "  --cache-dtype f32|f16|int8  value storage with --cache-mb (default: f32)" << std::endl;
+        std::cerr << "  --frontend threads|events  thread per request or epoll (default: threads)" << std::endl;
+        std::cerr << "  --event-threads N    event loops with --frontend events (default: 2)" << std::endl;
+        std::cerr << "  --model NAME=PATH    serve another model, selected by a request's model field; repeatable" << std::endl;
+        std::cerr << "  --optimized-cache DIR  save optimized graphs here and load them next time (default: off)" << std::endl;
+        std::cerr << "  --image-mean a,b,c   per-channel mean subtracted from uint8 images scaled to [0,1] (default: 0)" << std::endl;
+        std::cerr << "  --image-std a,b,c    per-channel std they are divided by (default: 1)" << std::endl;
+        std::cerr << "  --image-layout nchw|nhwc  model input layout for uint8 images (default: nchw)" << std::endl;
         return 1;
     }
+    WorkerConfig config;
     int port = std::stoi(argv[1]);
     std::string node_id = argv[2];
-    
-    // model path from argument or environment
+
+    int next_arg = 3;
     std::string model_path;
-    if (argc >= 4) {
+    if (argc > 3 && std::string(argv[3]).rfind("--", 0) != 0) {
         model_path = argv[3];
-    } else {
+        next_arg = 4;
+    }
+    for (int i = next_arg; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Error: missing value for " << flag << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--max-batch") {
+            config.max_batch_size = std::stoul(value);
+        } else if (flag == "--batch-timeout-ms") {
+            config.batch_timeout = std::chrono::milliseconds(std::stol(value));
+        } else if (flag == "--adaptive") {
+            config.adaptive_batching = value == "1" || value == "true";
+        } else if (flag == "--latency-target-ms") {
+            config.latency_target = std::chrono::milliseconds(std::stol(value));
+        } else if (flag == "--sessions") {
+            config.num_sessions = std::stoul(value);
+        } else if (flag == "--batch-workers") {
+            config.batch_workers = std::stoul(value);
+        } else if (flag == "--pipeline") {
+            config.pipeline = value == "1" || value == "true";
+        } else if (flag == "--device") {
+            config.device_ids = {std::stoi(value)};
+        } else if (flag == "--devices") {
+            config.device_ids.clear();
+            std::stringstream ids(value);
+            std::string id;
+            while (std::getline(ids, id, ',')) {
+                config.device_ids.push_back(std::stoi(id));
+            }
+            if (config.device_ids.empty()) {
+                std::cerr << "Error: --devices needs at least one device" << std::endl;
+                return 1;
+            }
+        } else if (flag == "--providers") {
+            config.providers.clear();
+            std::stringstream names(value);
+            std::string name;
+            try {
+                while (std::getline(names, name, ',')) {
+                    config.providers.push_back(parseExecutionProvider(name));
+                }
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        } else if (flag == "--intra-op-threads") {
+            config.intra_op_threads = std::stoi(value);
+        } else if (flag == "--inter-op-threads") {
+            config.inter_op_threads = std::stoi(value);
+        } else if (flag == "--cpus" || flag == "--numa-node") {
+            try {
+                config.cpus = flag == "--cpus" ? parseCpuList(value) : numaNodeCpus(std::stoi(value));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        } else if (flag == "--io-binding") {
+            config.io_binding = value == "1" || value == "true";
+        } else if (flag == "--queue") {
+            config.lock_free_queue = value == "lockfree";
+        } else if (flag == "--queue-capacity") {
+            config.queue_capacity = std::stoul(value);
+        } else if (flag == "--queue-limit") {
+            config.queue_limit = std::stoul(value);
+        } else if (flag == "--bulk-window") {
+            config.bulk_window = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--buckets") {
+            std::stringstream sizes(value);
+            std::string size;
+            while (std::getline(sizes, size, ',')) {
+                config.batch_buckets.push_back(std::stoul(size));
+            }
+        } else if (flag == "--cuda-graphs") {
+            config.cuda_graphs = value == "1" || value == "true";
+        } else if (flag == "--cache-entries") {
+            config.cache_entries = std::stoul(value);
+        } else if (flag == "--cache-mb") {
+            config.cache_bytes = std::stoul(value) << 20;
+        } else if (flag == "--cache-dtype") {
+            if (value == "f16") {
+                config.cache_value_type = CacheValueType::FLOAT16;
+            } else if (value == "int8") {
+                config.cache_value_type = CacheValueType::INT8;
+            } else if (value == "f32") {
+                config.cache_value_type = CacheValueType::FLOAT32;
+            } else {
+                std::cerr << "Error: unknown cache dtype " << value << std::endl;
+                return 1;
+            }
+        } else if (flag == "--frontend") {
+            if (value != "threads" && value != "events") {
+                std::cerr << "Error: unknown frontend " << value << std::endl;
+                return 1;
+            }
+            config.event_frontend = value == "events";
+        } else if (flag == "--event-threads") {
+            config.event_threads = std::stoul(value);
+        } else if (flag == "--model") {
+            size_t equals = value.find('=');
+            if (equals == std::string::npos || equals == 0 || equals + 1 == value.size()) {
+                std::cerr << "Error: --model takes NAME=PATH, got " << value << std::endl;
+                return 1;
+            }
+            config.models.emplace_back(value.substr(0, equals), value.substr(equals + 1));
+        } else if (flag == "--optimized-cache") {
+            config.optimized_model_dir = value;
+        } else if (flag == "--image-mean" || flag == "--image-std") {
+            std::vector<float>& values = flag == "--image-mean" ? config.image_mean : config.image_std;
+            values.clear();
+            std::stringstream list(value);
+            std::string number;
+            while (std::getline(list, number, ',')) {
+                values.push_back(std::stof(number));
+            }
+        } else if (flag == "--image-layout") {
+            if (value != "nchw" && value != "nhwc") {
+                std::cerr << "Error: unknown image layout " << value << std::endl;
+                return 1;
+            }
+            config.image_nhwc = value == "nhwc";
+        } else {
+            std::cerr << "Error: unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    // default model path from argument or environment, unless --model gave
+    // the models instead
+    if (model_path.empty() && config.models.empty()) {
         const char* env_path = std::getenv("MODEL_PATH");
         if (env_path) {
             model_path = env_path;
@@ -166,39 +1606,84 @@ int main(int argc, char** argv) {
             return 1;
         }
     }
-    
-    std::cout << "Using model: " << model_path << std::endl;
-    WorkerNode worker(node_id, port, model_path);
-    httplib::Server server;
-    // inference endpoint
-    server.Post("/infer", [&worker](const httplib::Request& req, httplib::Response& res) {
-        try {
-            auto request = json::parse(req.body);
-            auto response = worker.handleInfer(request);
-            
-            res.set_content(response.dump(), "application/json");
-        } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.status = 500;
-            res.set_content(error.dump(), "application/json");
-        }
-    });
-    // health endpoint
-    server.Get("/health", [&worker](const httplib::Request&, httplib::Response& res) {
-        auto health = worker.getHealth();
-        res.set_content(health.dump(), "application/json");
-    });
+
+    if (!model_path.empty()) {
+        config.models.insert(config.models.begin(), {"default", model_path});
+    }
+    for (const auto& [name, path] : config.models) {
+        std::cout << "Using model: " << name << " (" << path << ")" << std::endl;
+    }
+    config.node_id = node_id;
+    config.port = port;
+    WorkerNode worker(config);
     std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
     std::cout << "Worker Node: " << node_id << std::endl;
     std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
     std::cout << "   Port:              " << port << std::endl;
-    std::cout << "   Cache Capacity:    1000 entries" << std::endl;
-    std::cout << "   Batch Size:        32 requests" << std::endl;
-    std::cout << "   Batch Timeout:     20ms" << std::endl;
+    std::cout << "   Sessions:          " << config.num_sessions;
+    if (config.device_ids.size() > 1) {
+        std::cout << " on each of devices ";
+        for (size_t i = 0; i < config.device_ids.size(); ++i) {
+            std::cout << (i ? "," : "") << config.device_ids[i];
+        }
+    }
+    std::cout << std::endl;
+    std::cout << "   Providers:         ";
+    for (size_t i = 0; i < config.providers.size(); ++i) {
+        std::cout << (i ? ", " : "") << executionProviderName(config.providers[i]);
+    }
+    std::cout << std::endl;
+    std::cout << "   ORT Threads:       " << config.intra_op_threads << " intra-op"
+              << (config.inter_op_threads > 1 ? ", " + std::to_string(config.inter_op_threads) + " inter-op" : "")
+              << (config.cpus.empty() ? "" : ", pinned to " + std::to_string(config.cpus.size()) + " CPUs")
+              << std::endl;
+    std::cout << "   Front End:         " << (config.event_frontend
+        ? "epoll, " + std::to_string(config.event_threads) + " loops" : std::string("thread per request")) << std::endl;
+    std::cout << "   Pipelined:         " << (config.pipeline ? "yes" : "no") << std::endl;
+    std::cout << "   Request Queue:     " << (config.lock_free_queue ? "lock-free ring" : "mutex")
+              << ", " << (config.queue_limit > 0 ? std::to_string(config.queue_limit) + " per lane"
+                                                  : std::string("unbounded")) << std::endl;
+    std::cout << "   Models:            " << config.models.size() << ", default " << config.models.front().first << std::endl;
+    std::cout << "   Cache Capacity:    " << worker.cacheDescription()
+              << (config.models.size() > 1 ? " per model" : "") << std::endl;
+    std::cout << "   Batch Size:        " << config.max_batch_size << " requests" << std::endl;
+    std::cout << "   Batch Timeout:     " << config.batch_timeout.count() << "ms" << std::endl;
+    if (!config.batch_buckets.empty()) {
+        std::cout << "   Batch Buckets:     ";
+        for (size_t i = 0; i < config.batch_buckets.size(); ++i) {
+            std::cout << (i ? "," : "") << config.batch_buckets[i];
+        }
+        std::cout << (config.cuda_graphs ? " (CUDA graphs)" : "") << std::endl;
+    }
+    if (config.adaptive_batching) {
+        std::cout << "   Adaptive Batching: p99 target " << config.latency_target.count() << "ms" << std::endl;
+    }
+    if (!config.optimized_model_dir.empty()) {
+        std::cout << "   Optimized Graphs:  " << config.optimized_model_dir << std::endl;
+    }
+    if (!config.image_mean.empty() || !config.image_std.empty() || config.image_nhwc) {
+        std::cout << "   Image Inputs:      " << (config.image_nhwc ? "NHWC" : "NCHW");
+        for (const auto& [name, values] : {std::make_pair("mean", &config.image_mean),
+                                           std::make_pair("std", &config.image_std)}) {
+            if (values->empty()) continue;
+            std::cout << ", " << name << " ";
+            for (size_t i = 0; i < values->size(); ++i) {
+                std::cout << (i ? "," : "") << (*values)[i];
+            }
+        }
+        std::cout << std::endl;
+    }
     std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-    std::cout << "Ready to accept requests!" << std::endl;
+    std::cout << "Listening, warming up..." << std::endl;
     std::cout << std::endl;
-    server.listen("0.0.0.0", port);
+    worker.startWarmup();
+    if (config.event_frontend) {
+        if (!serveEvents(worker, port, config.event_threads)) {
+            std::cerr << "Error: cannot listen on port " << port << std::endl;
+            return 1;
+        }
+    } else {
+        serveThreads(worker, port);
+    }
     return 0;
 }
\ No newline at end of file